@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// Returns a 32 byte aligned pointer into a fresh allocation of the given size, and the allocation itself in
+// *allocation, to be released with free(). For arrays that AVX2 code loads with aligned loads.
+static inline char *aligned_alloc_32(size_t size, void **allocation)
+{
+  *allocation = malloc(size + 31);
+  return *allocation ? (char *)(((uintptr_t)*allocation + 31) & ~(uintptr_t)31) : 0;
+}
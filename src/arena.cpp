@@ -0,0 +1,64 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_BLOCK_SIZE (1 << 20)
+#define ARENA_ALIGNMENT 16
+#define BLOCK_HEADER_SIZE ((sizeof(Block) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+
+Arena::Arena():first(0), current(0), cursor(0), limit(0), blockBytes(0)
+{
+}
+
+Arena::~Arena()
+{
+  while(first)
+  {
+    Block *next = first->next;
+    free(first);
+    first = next;
+  }
+}
+
+void *Arena::alloc(size_t size)
+{
+  size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+  while((size_t)(limit - cursor) < size)
+  {
+    // Move on to the next kept block if it is large enough, otherwise insert a new one after the current block.
+    Block *next = current ? current->next : first;
+    if (!next || next->size < size)
+    {
+      size_t blockSize = (size > ARENA_BLOCK_SIZE) ? size : ARENA_BLOCK_SIZE;
+      Block *block = (Block *)malloc(BLOCK_HEADER_SIZE + blockSize);
+      if (!block) return 0;
+      block->size = blockSize;
+      block->next = next;
+      if (current) current->next = block;
+      else first = block;
+      blockBytes += blockSize;
+      next = block;
+    }
+    current = next;
+    cursor = (char *)current + BLOCK_HEADER_SIZE;
+    limit = cursor + current->size;
+  }
+  void *p = cursor;
+  cursor += size;
+  return p;
+}
+
+const char *Arena::copy_string(const char *str, size_t len)
+{
+  char *copy = (char *)alloc(len + 1);
+  if (!copy) return 0;
+  memcpy(copy, str, len);
+  copy[len] = 0;
+  return copy;
+}
+
+void Arena::reset()
+{
+  current = 0;
+  cursor = limit = 0;
+}
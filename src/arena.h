@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>
+
+// Bump allocator for many small objects that are all released at once. Memory is taken from the system
+// in large blocks, which reset() keeps for reuse, so a steady workload stops allocating after warming up.
+// Destructors of the allocated objects are never run.
+struct Arena
+{
+  Arena();
+  ~Arena();
+
+  // Returns uninitialized memory for size bytes, aligned to 16 bytes, or null if out of memory.
+  void *alloc(size_t size);
+
+  template<typename T>
+  T *alloc_array(size_t count) { return (T *)alloc(count * sizeof(T)); }
+
+  // Copies len chars of str and a terminating zero into the arena.
+  const char *copy_string(const char *str, size_t len);
+
+  // Releases everything allocated so far, keeping the blocks.
+  void reset();
+
+  // Total bytes of the blocks taken from the system.
+  size_t capacity() const { return blockBytes; }
+
+private:
+  struct Block
+  {
+    Block *next;
+    size_t size;
+  };
+  Block *first, *current;
+  char *cursor, *limit;
+  size_t blockBytes;
+
+  Arena(const Arena &);
+  Arena &operator=(const Arena &);
+};
@@ -0,0 +1,275 @@
+#include "batch.h"
+#include "aligned_alloc.h"
+#include "evaluate.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#define NUM_BITBOARD_ARRAYS 14 // pieces[2][7]
+#define NUM_BYTE_ARRAYS 5 // sideToMove, castlingPiecesAtHome[2], enpassantSquare, halfmoveClock
+
+PositionBatch::PositionBatch():size(0), capacity(0), sideToMove(0), enpassantSquare(0), halfmoveClock(0), allocation(0)
+{
+  memset(pieces, 0, sizeof(pieces));
+  castlingPiecesAtHome[0] = castlingPiecesAtHome[1] = 0;
+}
+
+PositionBatch::~PositionBatch()
+{
+  free(allocation);
+}
+
+bool PositionBatch::reserve(int newCapacity)
+{
+  if (newCapacity <= capacity) return true;
+  newCapacity = (newCapacity + 31) & ~31; // Keeps every array 32 byte aligned
+
+  void *newAllocation;
+  char *p = aligned_alloc_32((size_t)newCapacity * (NUM_BITBOARD_ARRAYS * sizeof(bitboard_t) + NUM_BYTE_ARRAYS), &newAllocation);
+  if (!p) return false;
+
+  for(int side = 0; side < 2; ++side)
+    for(int pieceType = 0; pieceType < 7; ++pieceType)
+    {
+      if (size) memcpy(p, pieces[side][pieceType], size * sizeof(bitboard_t));
+      pieces[side][pieceType] = (bitboard_t *)p;
+      p += newCapacity * sizeof(bitboard_t);
+    }
+  uint8_t **byteArrays[NUM_BYTE_ARRAYS] = { &sideToMove, &castlingPiecesAtHome[0], &castlingPiecesAtHome[1], (uint8_t **)&enpassantSquare, &halfmoveClock };
+  for(int i = 0; i < NUM_BYTE_ARRAYS; ++i)
+  {
+    if (size) memcpy(p, *byteArrays[i], size);
+    *byteArrays[i] = (uint8_t *)p;
+    p += newCapacity;
+  }
+
+  free(allocation);
+  allocation = newAllocation;
+  capacity = newCapacity;
+  return true;
+}
+
+int PositionBatch::add(const Board &board)
+{
+  if (size == capacity && !reserve(capacity ? capacity * 2 : 1024)) return -1;
+  int i = size++;
+  for(int side = 0; side < 2; ++side)
+    for(int pieceType = 0; pieceType < 7; ++pieceType)
+      pieces[side][pieceType][i] = board.pieces[side][pieceType];
+  sideToMove[i] = COLOR_INDEX(board.currentPlayer);
+  castlingPiecesAtHome[0][i] = board.castlingPiecesAtHome[0];
+  castlingPiecesAtHome[1][i] = board.castlingPiecesAtHome[1];
+  enpassantSquare[i] = (board.enpassantX >= 0) ? SQUARE(board.enpassantX, board.enpassantY) : -1;
+  halfmoveClock[i] = board.halfmoveClock;
+  return i;
+}
+
+void PositionBatch::get(int i, Board &board) const
+{
+  board.out = OUT_OF_BOARD;
+  memset(board.board, 0, sizeof(board.board));
+  for(int side = 0; side < 2; ++side)
+    for(int pieceType = KING; pieceType <= PAWN; ++pieceType)
+      for(bitboard_t b = pieces[side][pieceType][i]; b; )
+      {
+        int sq = pop_lsb(&b);
+        board.board[SQUARE_Y(sq)][SQUARE_X(sq)] = (side ? BLACK : WHITE) | pieceType;
+      }
+  board.currentPlayer = sideToMove[i] ? BLACK : WHITE;
+  board.castlingPiecesAtHome[0] = castlingPiecesAtHome[0][i];
+  board.castlingPiecesAtHome[1] = castlingPiecesAtHome[1][i];
+  board.enpassantX = (enpassantSquare[i] >= 0) ? SQUARE_X(enpassantSquare[i]) : -1;
+  board.enpassantY = (enpassantSquare[i] >= 0) ? SQUARE_Y(enpassantSquare[i]) : -1;
+  board.halfmoveClock = halfmoveClock[i];
+  board.fullmoveNumber = 1;
+  board.historyLength = 0;
+  board.update_bitboards();
+}
+
+BatchResults::BatchResults():capacity(0), legalMoves(0), inCheck(0), scores(0), allocation(0)
+{
+}
+
+BatchResults::~BatchResults()
+{
+  free(allocation);
+}
+
+bool BatchResults::reserve(int newCapacity)
+{
+  if (newCapacity <= capacity) return true;
+  newCapacity = (newCapacity + 31) & ~31;
+  void *newAllocation;
+  char *p = aligned_alloc_32((size_t)newCapacity * (sizeof(int16_t) + 2), &newAllocation);
+  if (!p) return false;
+  free(allocation);
+  allocation = newAllocation;
+  scores = (int16_t *)p;
+  legalMoves = (uint8_t *)(p + newCapacity * sizeof(int16_t));
+  inCheck = legalMoves + newCapacity;
+  capacity = newCapacity;
+  return true;
+}
+
+// The kernel below is written once against these few operations, and instantiated both for plain
+// uint64_t (one position per call) and, with AVX2, for Lanes (four positions per call).
+static inline uint64_t load_lanes(const uint64_t *p, uint64_t *) { return *p; }
+static inline uint64_t load_side_mask(const uint8_t *p, uint64_t *) { return 0 - (uint64_t)*p; }
+static inline uint64_t broadcast(uint64_t x, uint64_t *) { return x; }
+static inline uint64_t shift_by(uint64_t b, int s) { return (s > 0) ? b << s : b >> -s; }
+static inline uint64_t count_bits(uint64_t b) { return popcount(b); }
+static inline void store_lanes(uint64_t *p, uint64_t v) { *p = v; }
+
+#ifdef __AVX2__
+struct Lanes
+{
+  __m256i v;
+  Lanes() {}
+  Lanes(__m256i x):v(x) {}
+};
+static inline Lanes operator&(Lanes a, Lanes b) { return _mm256_and_si256(a.v, b.v); }
+static inline Lanes operator|(Lanes a, Lanes b) { return _mm256_or_si256(a.v, b.v); }
+static inline Lanes operator^(Lanes a, Lanes b) { return _mm256_xor_si256(a.v, b.v); }
+static inline Lanes operator~(Lanes a) { return _mm256_xor_si256(a.v, _mm256_set1_epi64x(-1)); }
+static inline Lanes operator+(Lanes a, Lanes b) { return _mm256_add_epi64(a.v, b.v); }
+static inline Lanes operator-(Lanes a, Lanes b) { return _mm256_sub_epi64(a.v, b.v); }
+static inline Lanes operator*(Lanes a, uint64_t k) { return _mm256_mul_epu32(a.v, _mm256_set1_epi64x(k)); } // Low 32 bits of each lane only
+
+static inline Lanes load_lanes(const uint64_t *p, Lanes *) { return _mm256_loadu_si256((const __m256i *)p); }
+static inline Lanes load_side_mask(const uint8_t *p, Lanes *)
+{
+  int32_t bytes;
+  memcpy(&bytes, p, 4);
+  return _mm256_sub_epi64(_mm256_setzero_si256(), _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(bytes)));
+}
+static inline Lanes broadcast(uint64_t x, Lanes *) { return _mm256_set1_epi64x(x); }
+static inline Lanes shift_by(Lanes b, int s)
+{
+  return (s > 0) ? _mm256_sll_epi64(b.v, _mm_cvtsi32_si128(s)) : _mm256_srl_epi64(b.v, _mm_cvtsi32_si128(-s));
+}
+static inline void store_lanes(uint64_t *p, Lanes v) { _mm256_storeu_si256((__m256i *)p, v.v); }
+
+// Per lane popcount: look up the bit count of each nibble with a byte shuffle, then sum the bytes of each lane.
+static inline Lanes count_bits(Lanes b)
+{
+  const __m256i nibbleCounts = _mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4, 0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+  const __m256i low4 = _mm256_set1_epi8(0x0F);
+  __m256i lo = _mm256_shuffle_epi8(nibbleCounts, _mm256_and_si256(b.v, low4));
+  __m256i hi = _mm256_shuffle_epi8(nibbleCounts, _mm256_and_si256(_mm256_srli_epi64(b.v, 4), low4));
+  return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+}
+#endif
+
+#define FILE_B (FILE_A << 1)
+#define FILE_G (FILE_H >> 1)
+
+// Kogge-Stone fill: attacks of all the given sliders in the direction of the given square step at once, stopping
+// at the first occupied square. wrap masks out the squares a step in that direction wraps around the board to.
+template<typename V>
+static inline V slide(V sliders, V empty, int step, V wrap)
+{
+  empty = empty & wrap;
+  sliders = sliders | (empty & shift_by(sliders, step));
+  empty = empty & shift_by(empty, step);
+  sliders = sliders | (empty & shift_by(sliders, 2*step));
+  empty = empty & shift_by(empty, 2*step);
+  sliders = sliders | (empty & shift_by(sliders, 4*step));
+  return shift_by(sliders, step) & wrap;
+}
+
+// Same set as Board::controlled_squares, computed with shifts instead of per piece table lookups.
+template<typename V>
+static inline V controlled_squares(const V *p, int side, V empty)
+{
+  V *tag = 0;
+  V notA = broadcast(~FILE_A, tag), notH = broadcast(~FILE_H, tag), all = broadcast(~0ULL, tag);
+  V notAB = broadcast(~(FILE_A|FILE_B), tag), notGH = broadcast(~(FILE_G|FILE_H), tag);
+
+  V squares = side ? (shift_by(p[PAWN] & notA, -9) | shift_by(p[PAWN] & notH, -7))
+                   : (shift_by(p[PAWN] & notA, 7) | shift_by(p[PAWN] & notH, 9));
+
+  V n = p[KNIGHT];
+  squares = squares | shift_by(n & notH, 17) | shift_by(n & notA, 15) | shift_by(n & notGH, 10) | shift_by(n & notAB, 6)
+                    | shift_by(n & notGH, -6) | shift_by(n & notAB, -10) | shift_by(n & notH, -15) | shift_by(n & notA, -17);
+
+  V k = p[KING];
+  squares = squares | shift_by(k, 8) | shift_by(k, -8) | shift_by(k & notH, 1) | shift_by(k & notA, -1)
+                    | shift_by(k & notH, 9) | shift_by(k & notA, 7) | shift_by(k & notH, -7) | shift_by(k & notA, -9);
+
+  V orthogonal = p[ROOK] | p[QUEEN], diagonal = p[BISHOP] | p[QUEEN];
+  squares = squares | slide(orthogonal, empty, 8, all) | slide(orthogonal, empty, -8, all)
+                    | slide(orthogonal, empty, 1, notA) | slide(orthogonal, empty, -1, notH)
+                    | slide(diagonal, empty, 9, notA) | slide(diagonal, empty, 7, notH)
+                    | slide(diagonal, empty, -7, notA) | slide(diagonal, empty, -9, notH);
+  return squares;
+}
+
+// Computes in-check flags and scores of the positions starting at index i, as many as V has lanes.
+template<typename V>
+static inline void evaluate_lanes(const PositionBatch &batch, int i, BatchResults &results)
+{
+  const int numLanes = sizeof(V) / sizeof(uint64_t);
+  V *tag = 0;
+  V p[2][7];
+  for(int side = 0; side < 2; ++side)
+    for(int pieceType = 0; pieceType < 7; ++pieceType)
+      p[side][pieceType] = load_lanes(batch.pieces[side][pieceType] + i, tag);
+  V empty = ~(p[0][NO_UNIT] | p[1][NO_UNIT]);
+  V blackToMove = load_side_mask(batch.sideToMove + i, tag);
+
+  V controlled[2], score = broadcast(0, tag);
+  for(int side = 0; side < 2; ++side)
+  {
+    controlled[side] = controlled_squares(p[side], side, empty);
+    V material = count_bits(controlled[side] & ~p[side][NO_UNIT]) * BATCH_MOBILITY_WEIGHT;
+    for(int pieceType = QUEEN; pieceType <= PAWN; ++pieceType)
+      material = material + count_bits(p[side][pieceType]) * pieceValues[pieceType];
+    score = side ? score - material : material;
+  }
+  score = (score ^ blackToMove) - blackToMove; // Negate where black is to move
+
+  // The king of the player to move, against the squares the opponent controls.
+  V checks = (((p[0][KING] & controlled[1]) & ~blackToMove) | ((p[1][KING] & controlled[0]) & blackToMove));
+
+  uint64_t scoreLanes[numLanes], checkLanes[numLanes];
+  store_lanes(scoreLanes, score);
+  store_lanes(checkLanes, checks);
+  for(int lane = 0; lane < numLanes; ++lane)
+  {
+    results.scores[i + lane] = (int16_t)(int64_t)scoreLanes[lane];
+    results.inCheck[i + lane] = checkLanes[lane] != 0;
+  }
+}
+
+void evaluate_batch(const PositionBatch &batch, int begin, int end, BatchResults &results)
+{
+  int i = begin;
+#ifdef __AVX2__
+  for(; i + 4 <= end; i += 4)
+    evaluate_lanes<Lanes>(batch, i, results);
+#endif
+  for(; i < end; ++i)
+    evaluate_lanes<uint64_t>(batch, i, results);
+
+  // The legal move generator only reads the bitboards and the game state, so skip setting up board[][]
+  // and the hash key as get() would. That would take as long as generating the moves.
+  Board board;
+  MoveList list;
+  for(i = begin; i < end; ++i)
+  {
+    for(int side = 0; side < 2; ++side)
+      for(int pieceType = 0; pieceType < 7; ++pieceType)
+        board.pieces[side][pieceType] = batch.pieces[side][pieceType][i];
+    board.occupied = board.pieces[0][NO_UNIT] | board.pieces[1][NO_UNIT];
+    board.currentPlayer = batch.sideToMove[i] ? BLACK : WHITE;
+    board.castlingPiecesAtHome[0] = batch.castlingPiecesAtHome[0][i];
+    board.castlingPiecesAtHome[1] = batch.castlingPiecesAtHome[1][i];
+    board.enpassantX = (batch.enpassantSquare[i] >= 0) ? SQUARE_X(batch.enpassantSquare[i]) : -1;
+    board.enpassantY = (batch.enpassantSquare[i] >= 0) ? SQUARE_Y(batch.enpassantSquare[i]) : -1;
+    board.generate_all_moves(list);
+    results.legalMoves[i] = (uint8_t)list.size;
+  }
+}
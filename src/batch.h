@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include "board.h"
+
+// Many unrelated positions stored as a structure of arrays: the same field of consecutive positions is
+// contiguous in memory, so that evaluate_batch() can load it for several positions with one vector load.
+struct PositionBatch
+{
+  PositionBatch();
+  ~PositionBatch();
+
+  // Grows the storage to hold at least the given number of positions, keeping the ones already added.
+  // Returns false if the memory could not be allocated, in which case the batch is unchanged.
+  bool reserve(int capacity);
+
+  // Forgets all positions but keeps the storage.
+  void clear() { size = 0; }
+
+  // Appends the position of the given board, growing the storage if needed. Returns its index, or -1 if out of memory.
+  int add(const Board &board);
+
+  // Sets up the given board to the position at the given index. The board's move history is cleared and
+  // the full move number is reset to 1.
+  void get(int index, Board &board) const;
+
+  int size;
+  int capacity;
+
+  // pieces[COLOR_INDEX(color)][pieceType][index], [NO_UNIT] has all the pieces of that side, as in Board::pieces.
+  bitboard_t *pieces[2][7];
+  uint8_t *sideToMove; // COLOR_INDEX of the player to move
+  uint8_t *castlingPiecesAtHome[2];
+  int8_t *enpassantSquare; // Square a pawn can capture to en passant, or -1
+  uint8_t *halfmoveClock;
+
+private:
+  void *allocation;
+
+  PositionBatch(const PositionBatch &);
+  PositionBatch &operator=(const PositionBatch &);
+};
+
+// Output arrays of evaluate_batch(), indexed like the positions of the batch.
+struct BatchResults
+{
+  BatchResults();
+  ~BatchResults();
+
+  // Returns false if the memory could not be allocated.
+  bool reserve(int capacity);
+
+  int capacity;
+  uint8_t *legalMoves; // Number of legal moves of the player to move
+  uint8_t *inCheck; // 1 if the player to move is in check
+  int16_t *scores; // Material and mobility in centipawns, from the point of view of the player to move
+
+private:
+  void *allocation;
+
+  BatchResults(const BatchResults &);
+  BatchResults &operator=(const BatchResults &);
+};
+
+// Mobility is the number of squares a side controls, as in Board::controlled_squares, that are not
+// occupied by its own pieces. Each square is worth this many centipawns.
+#define BATCH_MOBILITY_WEIGHT 4
+
+// Computes the results of positions [begin, end) of the batch. Attacks, check and the score are computed
+// for 4 positions at a time with AVX2 when compiled with USE_AVX2, and one at a time otherwise. The legal
+// move counts come from the regular move generator, one position at a time.
+void evaluate_batch(const PositionBatch &batch, int begin, int end, BatchResults &results);
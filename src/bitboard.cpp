@@ -0,0 +1,103 @@
+#include "bitboard.h"
+
+Magic rookMagics[64];
+Magic bishopMagics[64];
+
+// Number of distinct relevant occupancies summed over all squares: sum of 2^popcount(mask).
+static bitboard_t rookTable[102400];
+static bitboard_t bishopTable[5248];
+
+static const int rookDirections[4][2] = { { 0, 1 }, { 0, -1 }, { 1, 0 }, { -1, 0 } };
+static const int bishopDirections[4][2] = { { 1, 1 }, { 1, -1 }, { -1, 1 }, { -1, -1 } };
+
+// Walks each ray one square at a time, stopping at the first occupied square. Only used to build the tables.
+static bitboard_t sliding_attacks(const int directions[4][2], int sq, bitboard_t occupied)
+{
+  bitboard_t attacks = 0;
+  for(int d = 0; d < 4; ++d)
+    for(int x = SQUARE_X(sq) + directions[d][0], y = SQUARE_Y(sq) + directions[d][1]; x >= 0 && x < 8 && y >= 0 && y < 8; x += directions[d][0], y += directions[d][1])
+    {
+      attacks |= SQUARE_BIT(SQUARE(x, y));
+      if (occupied & SQUARE_BIT(SQUARE(x, y))) break;
+    }
+  return attacks;
+}
+
+#ifndef __BMI2__
+// xorshift64* generator, deterministic so that the magic search takes the same time on every run.
+static uint64_t rand64(uint64_t *state)
+{
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 2685821657736338717ULL;
+}
+#endif
+
+static void init_magics(const int directions[4][2], Magic magics[64], bitboard_t *table)
+{
+#ifndef __BMI2__
+  bitboard_t occupancy[4096], reference[4096];
+  int epoch[4096] = {}, attempt = 0;
+  // Seeds per rank that are known to find magics quickly.
+  static const uint64_t seeds[8] = { 728, 10316, 55013, 32803, 12281, 15100, 16645, 255 };
+#endif
+
+  for(int sq = 0; sq < 64; ++sq)
+  {
+    // The edges of the board don't affect the attacks unless the slider itself is on that edge.
+    bitboard_t edges = ((RANK_1 | RANK_8) & ~(RANK_1 << (8*SQUARE_Y(sq)))) | ((FILE_A | FILE_H) & ~(FILE_A << SQUARE_X(sq)));
+    Magic &m = magics[sq];
+    m.mask = sliding_attacks(directions, sq, 0) & ~edges;
+    m.shift = 64 - popcount(m.mask);
+    m.attacks = (sq == 0) ? table : magics[sq-1].attacks + (1 << (64 - magics[sq-1].shift));
+
+    // Enumerate all subsets of the mask with the Carry-Rippler trick.
+    int size = 0;
+    bitboard_t b = 0;
+    do
+    {
+#ifdef __BMI2__
+      m.attacks[m.index(b)] = sliding_attacks(directions, sq, b);
+#else
+      occupancy[size] = b;
+      reference[size] = sliding_attacks(directions, sq, b);
+#endif
+      ++size;
+      b = (b - m.mask) & m.mask;
+    } while(b);
+
+#ifndef __BMI2__
+    uint64_t state = seeds[SQUARE_Y(sq)];
+    for(int i = 0; i < size; )
+    {
+      do m.magic = rand64(&state) & rand64(&state) & rand64(&state);
+      while(popcount((m.mask * m.magic) >> 56) < 6);
+
+      // Verify that the magic maps every occupancy to an index without destructive collisions.
+      // epoch[] avoids clearing the attacks table between attempts.
+      ++attempt;
+      for(i = 0; i < size; ++i)
+      {
+        unsigned idx = m.index(occupancy[i]);
+        if (epoch[idx] < attempt)
+        {
+          epoch[idx] = attempt;
+          m.attacks[idx] = reference[i];
+        }
+        else if (m.attacks[idx] != reference[i])
+          break;
+      }
+    }
+#endif
+  }
+}
+
+void init_bitboards()
+{
+  init_magics(rookDirections, rookMagics, rookTable);
+  init_magics(bishopDirections, bishopMagics, bishopTable);
+}
+
+// Build the tables before main() so that Board never needs to check whether they are ready.
+static struct BitboardInitializer { BitboardInitializer() { init_bitboards(); } } bitboardInitializer;
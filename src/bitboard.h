@@ -0,0 +1,133 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+// A set of squares, bit (y*8 + x) is set if square (x,y) is in the set.
+typedef uint64_t bitboard_t;
+
+#define SQUARE(x, y) ((y)*8 + (x))
+#define SQUARE_X(sq) ((sq) & 7)
+#define SQUARE_Y(sq) ((sq) >> 3)
+#define SQUARE_BIT(sq) (1ULL << (sq))
+
+#define RANK_1 0xFFULL
+#define RANK_8 0xFF00000000000000ULL
+#define FILE_A 0x0101010101010101ULL
+#define FILE_H 0x8080808080808080ULL
+
+// A bitboard per square, built at compile time.
+struct SquareTable
+{
+  bitboard_t squares[64];
+  constexpr bitboard_t operator[](int sq) const { return squares[sq]; }
+};
+
+// N tables of the above, e.g. one per color or one per square.
+template<int N>
+struct SquareTables
+{
+  SquareTable tables[N];
+  constexpr const SquareTable &operator[](int i) const { return tables[i]; }
+};
+
+constexpr bool is_on_board(int x, int y) { return x >= 0 && x < 8 && y >= 0 && y < 8; }
+
+// Squares reached from each square by the given single steps, e.g. of a knight.
+template<int NumSteps>
+constexpr SquareTable make_step_table(const int (&steps)[NumSteps][2])
+{
+  SquareTable table = {};
+  for(int sq = 0; sq < 64; ++sq)
+    for(int i = 0; i < NumSteps; ++i)
+      if (is_on_board(SQUARE_X(sq) + steps[i][0], SQUARE_Y(sq) + steps[i][1]))
+        table.squares[sq] |= SQUARE_BIT(SQUARE(SQUARE_X(sq) + steps[i][0], SQUARE_Y(sq) + steps[i][1]));
+  return table;
+}
+
+// For each pair of squares on a common rank, file or diagonal, the squares strictly between them if
+// betweenOnly, otherwise the whole line through them from edge to edge. Other pairs get 0.
+constexpr SquareTables<64> make_line_tables(bool betweenOnly)
+{
+  SquareTables<64> lines = {};
+  for(int a = 0; a < 64; ++a)
+    for(int b = 0; b < 64; ++b)
+    {
+      int dx = SQUARE_X(b) - SQUARE_X(a), dy = SQUARE_Y(b) - SQUARE_Y(a);
+      if (a == b || (dx != 0 && dy != 0 && dx != dy && dx != -dy)) continue;
+      int stepX = (dx > 0) - (dx < 0), stepY = (dy > 0) - (dy < 0);
+      bitboard_t line = 0;
+      if (betweenOnly)
+        for(int x = SQUARE_X(a) + stepX, y = SQUARE_Y(a) + stepY; SQUARE(x, y) != b; x += stepX, y += stepY)
+          line |= SQUARE_BIT(SQUARE(x, y));
+      else
+      {
+        for(int x = SQUARE_X(a), y = SQUARE_Y(a); is_on_board(x, y); x += stepX, y += stepY) line |= SQUARE_BIT(SQUARE(x, y));
+        for(int x = SQUARE_X(a), y = SQUARE_Y(a); is_on_board(x, y); x -= stepX, y -= stepY) line |= SQUARE_BIT(SQUARE(x, y));
+      }
+      lines.tables[a].squares[b] = line;
+    }
+  return lines;
+}
+
+constexpr int knightSteps[8][2] = { {-2,-1}, {-2,1}, {2,-1}, {2,1}, {-1,-2}, {-1,2}, {1,-2}, {1,2} };
+constexpr int kingSteps[8][2] = { {-1,-1}, {-1,0}, {-1,1}, {0,-1}, {0,1}, {1,-1}, {1,0}, {1,1} };
+constexpr int whitePawnSteps[2][2] = { {-1,1}, {1,1} };
+constexpr int blackPawnSteps[2][2] = { {-1,-1}, {1,-1} };
+
+// Lookup tables for the leaper pieces, pawnAttacks is indexed by [COLOR_INDEX(color)][square].
+inline constexpr SquareTable knightAttacks = make_step_table(knightSteps);
+inline constexpr SquareTable kingAttacks = make_step_table(kingSteps);
+inline constexpr SquareTables<2> pawnAttacks = { { make_step_table(whitePawnSteps), make_step_table(blackPawnSteps) } };
+
+// Squares strictly between the two given squares if they share a rank, file or diagonal, otherwise 0.
+inline constexpr SquareTables<64> squaresBetween = make_line_tables(true);
+
+// The full board-wide line through the two given squares if they share a rank, file or diagonal, otherwise 0.
+inline constexpr SquareTables<64> lineThrough = make_line_tables(false);
+
+// Sliding piece attack lookup. With BMI2 available the table index is computed with PEXT,
+// otherwise with a multiply-and-shift by a magic number found at startup.
+struct Magic
+{
+  bitboard_t mask;
+  bitboard_t magic;
+  bitboard_t *attacks;
+  unsigned shift;
+
+  unsigned index(bitboard_t occupied) const
+  {
+#ifdef __BMI2__
+    return (unsigned)_pext_u64(occupied, mask);
+#else
+    return (unsigned)(((occupied & mask) * magic) >> shift);
+#endif
+  }
+};
+
+extern Magic rookMagics[64];
+extern Magic bishopMagics[64];
+
+// Fills in the sliding piece tables. Called automatically at program startup, calling it again is harmless.
+void init_bitboards();
+
+static inline bitboard_t rook_attacks(int sq, bitboard_t occupied) { return rookMagics[sq].attacks[rookMagics[sq].index(occupied)]; }
+static inline bitboard_t bishop_attacks(int sq, bitboard_t occupied) { return bishopMagics[sq].attacks[bishopMagics[sq].index(occupied)]; }
+static inline bitboard_t queen_attacks(int sq, bitboard_t occupied) { return rook_attacks(sq, occupied) | bishop_attacks(sq, occupied); }
+
+static inline int lsb(bitboard_t b) { return __builtin_ctzll(b); }
+static inline int popcount(bitboard_t b) { return __builtin_popcountll(b); }
+
+// Returns the index of the lowest set bit and clears it. b must not be zero.
+static inline int pop_lsb(bitboard_t *b)
+{
+  int sq = lsb(*b);
+  *b &= *b - 1;
+  return sq;
+}
+
+// Returns true if the bitboard has more than one bit set.
+static inline bool more_than_one(bitboard_t b) { return (b & (b - 1)) != 0; }
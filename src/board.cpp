@@ -1,16 +1,31 @@
 #include "board.h"
+#include "evaluate.h"
+#include "profile.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+// Random keys for the Zobrist hash.
+static uint64_t zobristPieces[2][7][64];
+static uint64_t zobristCastling[16]; // Indexed by the four castling rights, white kingside in bit 0 to black queenside in bit 3
+static uint64_t zobristEnpassant[8];
+static uint64_t zobristBlackToMove;
+
+static void init_zobrist()
+{
+  uint64_t state = 0x9E3779B97F4A7C15ULL;
+  #define NEXT_KEY() (state ^= state << 13, state ^= state >> 7, state ^= state << 17, state * 0x2545F4914F6CDD1DULL)
+  for(int side = 0; side < 2; ++side)
+    for(int pieceType = 0; pieceType < 7; ++pieceType)
+      for(int sq = 0; sq < 64; ++sq)
+        zobristPieces[side][pieceType][sq] = NEXT_KEY();
+  for(int i = 0; i < 16; ++i) zobristCastling[i] = NEXT_KEY();
+  for(int i = 0; i < 8; ++i) zobristEnpassant[i] = NEXT_KEY();
+  zobristBlackToMove = NEXT_KEY();
+  #undef NEXT_KEY
+}
 
-// Returns true if there is a white piece at the given coordinates
-#define IS_WHITE_AT(x,y) (IS_WHITE_PIECE(At((x),(y))))
-
-// Returns true if there is a black piece at the given coordinates
-#define IS_BLACK_AT(x,y) (IS_BLACK_PIECE(At((x),(y))))
-
-// Returns true if there is an empty square or a piece of opponent's color at the given coordinates
-#define IS_EMPTY_OR_OPPONENT_AT(playerColor, x, y) IS_EMPTY_OR_OPPONENT(playerColor, At((x), (y)))
-
-// Returns true if there is a piece of opponent's color at the given coordinates
-#define IS_OPPONENT_AT(playerColor, x, y) IS_OPPONENT(playerColor, At((x), (y)))
+static struct ZobristInitializer { ZobristInitializer() { init_zobrist(); } } zobristInitializer;
 
 #define MIN(x, y) ((x) <= (y) ? (x) : (y))
 #define MAX(x, y) ((x) >= (y) ? (x) : (y))
@@ -22,6 +37,9 @@ void Board::new_game()
   currentPlayer = WHITE;
   enpassantX = enpassantY = -1;
   castlingPiecesAtHome[0] = castlingPiecesAtHome[1] = KING_AT_HOME | KING_ROOK_AT_HOME | QUEEN_ROOK_AT_HOME;
+  historyLength = 0;
+  halfmoveClock = 0;
+  fullmoveNumber = 1;
 
   board[0][0] = WHITE_ROOK;
   board[0][1] = WHITE_KNIGHT;
@@ -48,31 +66,262 @@ void Board::new_game()
     for(int y = 2; y < 6; ++y)
       board[y][x] = 0;
   }
+  update_bitboards();
+}
+
+static const char pieceChars[] = " kqrbnp"; // Indexed by piece type
+
+void Board::copy_from(const Board &other)
+{
+  memcpy((void *)this, &other, offsetof(Board, history) + other.historyLength * sizeof(UndoRecord));
+}
+
+bool Board::load_fen(const char *fen, const char **end)
+{
+  out = OUT_OF_BOARD;
+  historyLength = 0;
+  halfmoveClock = 0;
+  fullmoveNumber = 1;
+  memset(board, 0, sizeof(board));
+
+  int x = 0, y = 7;
+  for(; *fen && *fen != ' '; ++fen)
+  {
+    if (*fen == '/')
+    {
+      if (x != 8 || --y < 0) return false;
+      x = 0;
+    }
+    else if (*fen >= '1' && *fen <= '8') x += *fen - '0';
+    else
+    {
+      const char *p = strchr(pieceChars + 1, *fen | 0x20); // | 0x20 maps ASCII letters to lowercase
+      if (!p || x >= 8) return false;
+      board[y][x++] = ((*fen & 0x20) ? BLACK : WHITE) | (piece_t)(p - pieceChars);
+    }
+    if (x > 8) return false;
+  }
+  if (x != 8 || y != 0) return false;
+
+  // The move generator needs one king of each color, and no pawns on the first or last rank to move off the board.
+  int numKings[2] = { 0, 0 };
+  for(y = 0; y < 8; ++y)
+    for(x = 0; x < 8; ++x)
+    {
+      if (PIECE_TYPE(board[y][x]) == KING) ++numKings[COLOR_INDEX(PLAYER_COLOR(board[y][x]))];
+      if (PIECE_TYPE(board[y][x]) == PAWN && (y == 0 || y == 7)) return false;
+    }
+  if (numKings[0] != 1 || numKings[1] != 1) return false;
+
+  while(*fen == ' ') ++fen;
+  if (*fen != 'w' && *fen != 'b') return false;
+  currentPlayer = (*fen++ == 'w') ? WHITE : BLACK;
+
+  while(*fen == ' ') ++fen;
+  castlingPiecesAtHome[0] = castlingPiecesAtHome[1] = 0;
+  for(; *fen && *fen != ' '; ++fen)
+    switch(*fen)
+    {
+    case 'K': castlingPiecesAtHome[0] |= KINGSIDE_CASTLING_MASK; break;
+    case 'Q': castlingPiecesAtHome[0] |= QUEENSIDE_CASTLING_MASK; break;
+    case 'k': castlingPiecesAtHome[1] |= KINGSIDE_CASTLING_MASK; break;
+    case 'q': castlingPiecesAtHome[1] |= QUEENSIDE_CASTLING_MASK; break;
+    case '-': break;
+    default: return false;
+    }
+  // Only trust castling rights for pieces that are actually on their home squares.
+  for(int side = 0; side < 2; ++side)
+  {
+    int rank = side ? 7 : 0, color = side ? BLACK : WHITE;
+    if (board[rank][4] != (color | KING)) castlingPiecesAtHome[side] = 0;
+    if (board[rank][7] != (color | ROOK)) castlingPiecesAtHome[side] &= ~KING_ROOK_AT_HOME;
+    if (board[rank][0] != (color | ROOK)) castlingPiecesAtHome[side] &= ~QUEEN_ROOK_AT_HOME;
+  }
+
+  while(*fen == ' ') ++fen;
+  enpassantX = enpassantY = -1;
+  if (*fen >= 'a' && *fen <= 'h' && (fen[1] == '3' || fen[1] == '6')) enpassantX = fen[0] - 'a', enpassantY = fen[1] - '1';
+  else if (*fen && *fen != '-') return false;
+  while(*fen && *fen != ' ') ++fen;
+
+  // The optional move counters, only if both are there. An EPD operation can't start with a digit.
+  const char *p = fen;
+  while(*p == ' ') ++p;
+  if (*p >= '0' && *p <= '9')
+  {
+    int halfmoves = 0, fullmoves = 0;
+    for(; *p >= '0' && *p <= '9'; ++p) halfmoves = MIN(halfmoves * 10 + *p - '0', 100000);
+    while(*p == ' ') ++p;
+    if (*p < '0' || *p > '9') return false;
+    for(; *p >= '0' && *p <= '9'; ++p) fullmoves = MIN(fullmoves * 10 + *p - '0', 100000);
+    halfmoveClock = (uint8_t)MIN(halfmoves, 255);
+    fullmoveNumber = (uint16_t)MAX(MIN(fullmoves, 65535), 1);
+    fen = p;
+  }
+  if (end) *end = fen;
+
+  update_bitboards();
+  return true;
 }
 
-#define MOVE(sx, sy, dx, dy) do { board[dy][dx] = board[sy][sx]; board[sy][sx] = 0; } while(0)
+void Board::to_fen(char *str) const
+{
+  for(int y = 7; y >= 0; --y)
+  {
+    for(int x = 0; x < 8; ++x)
+    {
+      if (!board[y][x])
+      {
+        int empty = 1;
+        while(x + empty < 8 && !board[y][x + empty]) ++empty;
+        *str++ = '0' + empty;
+        x += empty - 1;
+      }
+      else *str++ = pieceChars[PIECE_TYPE(board[y][x])] & (IS_WHITE_PIECE(board[y][x]) ? ~0x20 : ~0); // & ~0x20 maps ASCII letters to uppercase
+    }
+    if (y > 0) *str++ = '/';
+  }
+  *str++ = ' ';
+  *str++ = (currentPlayer == WHITE) ? 'w' : 'b';
+  *str++ = ' ';
+  const char *castlingStart = str;
+  if ((castlingPiecesAtHome[0] & KINGSIDE_CASTLING_MASK) == KINGSIDE_CASTLING_MASK) *str++ = 'K';
+  if ((castlingPiecesAtHome[0] & QUEENSIDE_CASTLING_MASK) == QUEENSIDE_CASTLING_MASK) *str++ = 'Q';
+  if ((castlingPiecesAtHome[1] & KINGSIDE_CASTLING_MASK) == KINGSIDE_CASTLING_MASK) *str++ = 'k';
+  if ((castlingPiecesAtHome[1] & QUEENSIDE_CASTLING_MASK) == QUEENSIDE_CASTLING_MASK) *str++ = 'q';
+  if (str == castlingStart) *str++ = '-';
+  *str++ = ' ';
+  if (enpassantX >= 0) *str++ = 'a' + enpassantX, *str++ = '1' + enpassantY;
+  else *str++ = '-';
+  sprintf(str, " %d %d", halfmoveClock, fullmoveNumber);
+}
 
-void Board::make_move(int srcX, int srcY, int dstX, int dstY)
+void Board::update_bitboards()
 {
+  for(int side = 0; side < 2; ++side)
+    for(int pieceType = 0; pieceType < 7; ++pieceType)
+      pieces[side][pieceType] = 0;
+  occupied = 0;
+  hash = 0;
+  pieceSquareTotal[PHASE_MIDDLEGAME] = pieceSquareTotal[PHASE_ENDGAME] = 0;
+  phase = 0;
+
+  for(int y = 0; y < 8; ++y)
+    for(int x = 0; x < 8; ++x)
+      if (board[y][x])
+        put_piece(x, y, board[y][x]);
+
+  if (currentPlayer == BLACK) hash ^= zobristBlackToMove;
+  hash ^= castling_and_enpassant_hash();
+}
+
+uint64_t Board::castling_and_enpassant_hash() const
+{
+  int rights = 0;
+  for(int side = 0; side < 2; ++side)
+  {
+    if ((castlingPiecesAtHome[side] & KINGSIDE_CASTLING_MASK) == KINGSIDE_CASTLING_MASK) rights |= 1 << (2*side);
+    if ((castlingPiecesAtHome[side] & QUEENSIDE_CASTLING_MASK) == QUEENSIDE_CASTLING_MASK) rights |= 2 << (2*side);
+  }
+  uint64_t key = zobristCastling[rights];
+  // Only hash the en passant file if a pawn of the player to move can make the capture, so that transpositions match.
+  if (enpassantX >= 0 && (pawnAttacks[COLOR_INDEX(OPPONENT_COLOR(currentPlayer))][SQUARE(enpassantX, enpassantY)] & pieces[COLOR_INDEX(currentPlayer)][PAWN]))
+    key ^= zobristEnpassant[enpassantX];
+  return key;
+}
+
+int Board::repetition_count() const
+{
+  // A capture or a pawn move can never be undone, so only look back as far as the last one of those.
+  int count = 0;
+  for(int i = historyLength - 2, end = MAX(historyLength - halfmoveClock, 0); i >= end; i -= 2)
+    if (history[i].hash == hash)
+      ++count;
+  return count;
+}
+
+void Board::put_piece(int x, int y, piece_t piece)
+{
+  bitboard_t bit = SQUARE_BIT(SQUARE(x, y));
+  board[y][x] = piece;
+  hash ^= zobristPieces[COLOR_INDEX(piece)][PIECE_TYPE(piece)][SQUARE(x, y)];
+  pieceSquareTotal[PHASE_MIDDLEGAME] += pieceSquareScores[PHASE_MIDDLEGAME][COLOR_INDEX(piece)][PIECE_TYPE(piece)][SQUARE(x, y)];
+  pieceSquareTotal[PHASE_ENDGAME] += pieceSquareScores[PHASE_ENDGAME][COLOR_INDEX(piece)][PIECE_TYPE(piece)][SQUARE(x, y)];
+  phase += phaseWeights[PIECE_TYPE(piece)];
+  pieces[COLOR_INDEX(piece)][PIECE_TYPE(piece)] |= bit;
+  pieces[COLOR_INDEX(piece)][NO_UNIT] |= bit;
+  occupied |= bit;
+}
+
+void Board::remove_piece(int x, int y)
+{
+  piece_t piece = board[y][x];
+  if (!piece) return;
+  bitboard_t bit = SQUARE_BIT(SQUARE(x, y));
+  board[y][x] = 0;
+  hash ^= zobristPieces[COLOR_INDEX(piece)][PIECE_TYPE(piece)][SQUARE(x, y)];
+  pieceSquareTotal[PHASE_MIDDLEGAME] -= pieceSquareScores[PHASE_MIDDLEGAME][COLOR_INDEX(piece)][PIECE_TYPE(piece)][SQUARE(x, y)];
+  pieceSquareTotal[PHASE_ENDGAME] -= pieceSquareScores[PHASE_ENDGAME][COLOR_INDEX(piece)][PIECE_TYPE(piece)][SQUARE(x, y)];
+  phase -= phaseWeights[PIECE_TYPE(piece)];
+  pieces[COLOR_INDEX(piece)][PIECE_TYPE(piece)] &= ~bit;
+  pieces[COLOR_INDEX(piece)][NO_UNIT] &= ~bit;
+  occupied &= ~bit;
+}
+
+#define MOVE(sx, sy, dx, dy) do { piece_t p = board[sy][sx]; remove_piece(sx, sy); remove_piece(dx, dy); put_piece(dx, dy, p); } while(0)
+
+UndoRecord &Board::push_undo_record(move_t move)
+{
+  if (historyLength == MAX_HISTORY) // Forget the oldest half of the history
+  {
+    memmove(history, history + MAX_HISTORY/2, sizeof(history)/2);
+    historyLength -= MAX_HISTORY/2;
+  }
+  UndoRecord &undo = history[historyLength++];
+  undo.hash = hash;
+  undo.move = move;
+  undo.castlingPiecesAtHome[0] = castlingPiecesAtHome[0];
+  undo.castlingPiecesAtHome[1] = castlingPiecesAtHome[1];
+  undo.enpassantX = enpassantX;
+  undo.enpassantY = enpassantY;
+  undo.halfmoveClock = halfmoveClock;
+  return undo;
+}
+
+void Board::make_move(move_t move)
+{
+  PROFILE_SCOPE(PROFILE_MAKE_MOVE);
+  int srcX = SQUARE_X(MOVE_SRC(move)), srcY = SQUARE_Y(MOVE_SRC(move));
+  int dstX = SQUARE_X(MOVE_DST(move)), dstY = SQUARE_Y(MOVE_DST(move));
   int pieceColor = PLAYER_COLOR(board[srcY][srcX]);
   int pieceType = PIECE_TYPE(board[srcY][srcX]);
   int castlingSide = (pieceColor == WHITE) ? 0 : 1;
   int castlingRank = (pieceColor == WHITE) ? 0 : 7;
+
+  UndoRecord &undo = push_undo_record(move);
+  undo.captured = (MOVE_TYPE(move) == MOVE_EN_PASSANT) ? board[srcY][dstX] : board[dstY][dstX];
+  undo.moved = board[srcY][srcX];
+
+  hash ^= castling_and_enpassant_hash(); // Removed here and added back below once castling and en passant state is updated
+  halfmoveClock = (pieceType == PAWN || undo.captured) ? 0 : MIN(halfmoveClock + 1, 255);
   MOVE(srcX, srcY, dstX, dstY);
 
-  // Did we make an en passant capture?
-  if (pieceType == PAWN && dstX == enpassantX && dstY == enpassantY) board[srcY][dstX] = 0; // If so, remove the pawn that moved two squares forward
+  // Capturing a rook on its home square takes away the opponent's right to castle with it.
+  if (dstY == 7 - castlingRank && dstX == 0) castlingPiecesAtHome[castlingSide^1] &= ~QUEEN_ROOK_AT_HOME;
+  else if (dstY == 7 - castlingRank && dstX == 7) castlingPiecesAtHome[castlingSide^1] &= ~KING_ROOK_AT_HOME;
+
+  // Did we make an en passant capture? If so, remove the pawn that moved two squares forward
+  if (MOVE_TYPE(move) == MOVE_EN_PASSANT) remove_piece(dstX, srcY);
   enpassantX = enpassantY = -1; // Clear en passant state, the opportunity do en passant captures is over.
 
   switch(pieceType)
   {
   case PAWN: // If we move a pawn forward two squares, record an en passant square that will perform a capture of this pawn (next move only)
     if (ABS(dstY-srcY) == 2) enpassantX = srcX, enpassantY = (srcY + dstY) / 2;
-    // Auto-promote pawns to queen. (TODO: Add UI dialog to ask what to promote to)
-    if (dstY == 0 || dstY == 7) board[dstY][dstX] = pieceColor | QUEEN;
+    if (MOVE_TYPE(move) == MOVE_PROMOTION) remove_piece(dstX, dstY), put_piece(dstX, dstY, pieceColor | MOVE_PROMOTION_PIECE(move));
     break;
   case KING:
-    if (ABS(dstX-srcX) > 1) MOVE((dstX < srcX) ? 0 : 7, dstY, (srcX+dstX)/2, dstY); // If king is castling, handle moving the rook here
+    if (MOVE_TYPE(move) == MOVE_CASTLING) MOVE((dstX < srcX) ? 0 : 7, dstY, (srcX+dstX)/2, dstY); // If king is castling, handle moving the rook here
     castlingPiecesAtHome[castlingSide] &= ~KING_AT_HOME;
     break;
   case ROOK:
@@ -81,205 +330,457 @@ void Board::make_move(int srcX, int srcY, int dstX, int dstY)
     else if (srcX == 7 && srcY == castlingRank) castlingPiecesAtHome[castlingSide] &= ~KING_ROOK_AT_HOME;
     break;
   }
+  if (pieceColor == BLACK) ++fullmoveNumber;
   currentPlayer = OPPONENT_COLOR(pieceColor);
+  hash ^= zobristBlackToMove ^ castling_and_enpassant_hash();
 }
 
-bool Board::is_king_in_check(int color)
+void Board::make_null_move()
 {
-  int opponentControlledSquares[8][8];
-  mark_controlled_squares(OPPONENT_COLOR(color), opponentControlledSquares);
-
-  int kingX, kingY;
-  find_king(color == WHITE ? WHITE_KING : BLACK_KING, &kingX, &kingY);
-  return opponentControlledSquares[kingY][kingX] != 0;
+  UndoRecord &undo = push_undo_record(NO_MOVE);
+  undo.captured = undo.moved = 0;
+  hash ^= castling_and_enpassant_hash();
+  enpassantX = enpassantY = -1;
+  halfmoveClock = 0; // Positions before a null move must not count as repetitions
+  if (currentPlayer == BLACK) ++fullmoveNumber;
+  currentPlayer = OPPONENT_COLOR(currentPlayer);
+  hash ^= zobristBlackToMove ^ castling_and_enpassant_hash();
 }
 
-#define APPEND_MOVE(x, y) do { *moves++ = x; *moves++ = y; } while(0)
-#define MARK_CONTROLLED(x, y) squares[y][x] = 1
-
-int *Board::generate_pawn_moves(int pieceColor, int x, int y, int *moves)
+void Board::unmake_move()
 {
-  int dir = (pieceColor == WHITE) ? 1 : -1;
-  if (!At(x, y+dir))
+  PROFILE_SCOPE(PROFILE_UNMAKE_MOVE);
+  if (historyLength == 0) return;
+  const UndoRecord &undo = history[--historyLength];
+  if (undo.move == NO_MOVE) // Null move
   {
-    const int homeRow = (pieceColor == WHITE) ? 1 : 6;
-    APPEND_MOVE(x, y+dir);
-    if (y == homeRow && !At(x, y+dir+dir)) APPEND_MOVE(x, y+dir+dir);
+    enpassantX = undo.enpassantX;
+    enpassantY = undo.enpassantY;
+    halfmoveClock = undo.halfmoveClock;
+    hash = undo.hash;
+    currentPlayer = OPPONENT_COLOR(currentPlayer);
+    if (currentPlayer == BLACK) --fullmoveNumber;
+    return;
   }
-  if (IS_OPPONENT_AT(pieceColor, x-1, y+dir) || (x-1 == enpassantX && y+dir == enpassantY)) APPEND_MOVE(x-1, y+dir);
-  if (IS_OPPONENT_AT(pieceColor, x+1, y+dir) || (x+1 == enpassantX && y+dir == enpassantY)) APPEND_MOVE(x+1, y+dir);
-  return moves;
+  int srcX = SQUARE_X(MOVE_SRC(undo.move)), srcY = SQUARE_Y(MOVE_SRC(undo.move));
+  int dstX = SQUARE_X(MOVE_DST(undo.move)), dstY = SQUARE_Y(MOVE_DST(undo.move));
+  int pieceColor = PLAYER_COLOR(board[dstY][dstX]);
+
+  if (MOVE_TYPE(undo.move) == MOVE_PROMOTION) remove_piece(dstX, dstY), put_piece(dstX, dstY, pieceColor | PAWN);
+  MOVE(dstX, dstY, srcX, srcY);
+  if (undo.captured) put_piece(dstX, (MOVE_TYPE(undo.move) == MOVE_EN_PASSANT) ? srcY : dstY, undo.captured);
+  if (MOVE_TYPE(undo.move) == MOVE_CASTLING) MOVE((srcX+dstX)/2, dstY, (dstX < srcX) ? 0 : 7, dstY);
+
+  castlingPiecesAtHome[0] = undo.castlingPiecesAtHome[0];
+  castlingPiecesAtHome[1] = undo.castlingPiecesAtHome[1];
+  enpassantX = undo.enpassantX;
+  enpassantY = undo.enpassantY;
+  halfmoveClock = undo.halfmoveClock;
+  hash = undo.hash;
+  currentPlayer = pieceColor;
+  if (pieceColor == BLACK) --fullmoveNumber;
 }
 
-void Board::mark_pawn_controlled_squares(int x, int y, int squares[8][8])
+void Board::make_move(int srcX, int srcY, int dstX, int dstY, int promotion)
 {
-  int dir = (PLAYER_COLOR(board[y][x]) == WHITE) ? 1 : -1;
-  if (!IS_OUT_OF_BOARD(x-1, y+dir)) MARK_CONTROLLED(x-1, y+dir);
-  if (!IS_OUT_OF_BOARD(x+1, y+dir)) MARK_CONTROLLED(x+1, y+dir);
+  int src = SQUARE(srcX, srcY), dst = SQUARE(dstX, dstY);
+  switch(PIECE_TYPE(board[srcY][srcX]))
+  {
+  case PAWN:
+    if (dstY == 0 || dstY == 7) return make_move(MAKE_PROMOTION(src, dst, promotion));
+    if (dstX == enpassantX && dstY == enpassantY) return make_move(MAKE_SPECIAL_MOVE(src, dst, MOVE_EN_PASSANT));
+    break;
+  case KING:
+    if (ABS(dstX-srcX) > 1) return make_move(MAKE_SPECIAL_MOVE(src, dst, MOVE_CASTLING));
+    break;
+  }
+  make_move(MAKE_MOVE(src, dst));
 }
 
-int *Board::generate_knight_moves(int pieceColor, int x, int y, int *moves)
+bool Board::is_king_in_check(int color)
 {
-  if (IS_EMPTY_OR_OPPONENT_AT(pieceColor, x-2, y-1)) APPEND_MOVE(x-2, y-1);
-  if (IS_EMPTY_OR_OPPONENT_AT(pieceColor, x-2, y+1)) APPEND_MOVE(x-2, y+1);
-  if (IS_EMPTY_OR_OPPONENT_AT(pieceColor, x+2, y-1)) APPEND_MOVE(x+2, y-1);
-  if (IS_EMPTY_OR_OPPONENT_AT(pieceColor, x+2, y+1)) APPEND_MOVE(x+2, y+1);
-  if (IS_EMPTY_OR_OPPONENT_AT(pieceColor, x-1, y-2)) APPEND_MOVE(x-1, y-2);
-  if (IS_EMPTY_OR_OPPONENT_AT(pieceColor, x-1, y+2)) APPEND_MOVE(x-1, y+2);
-  if (IS_EMPTY_OR_OPPONENT_AT(pieceColor, x+1, y-2)) APPEND_MOVE(x+1, y-2);
-  if (IS_EMPTY_OR_OPPONENT_AT(pieceColor, x+1, y+2)) APPEND_MOVE(x+1, y+2);
-  return moves;
+  PROFILE_SCOPE(PROFILE_IS_KING_IN_CHECK);
+  bitboard_t king = pieces[COLOR_INDEX(color)][KING];
+  return king && is_square_attacked(lsb(king), OPPONENT_COLOR(color), occupied);
 }
 
-void Board::mark_knight_controlled_squares(int x, int y, int squares[8][8])
+bool Board::is_square_attacked(int sq, int color, bitboard_t occupancy) const
 {
-  if (!IS_OUT_OF_BOARD(x-2, y-1)) MARK_CONTROLLED(x-2, y-1);
-  if (!IS_OUT_OF_BOARD(x-2, y+1)) MARK_CONTROLLED(x-2, y+1);
-  if (!IS_OUT_OF_BOARD(x+2, y-1)) MARK_CONTROLLED(x+2, y-1);
-  if (!IS_OUT_OF_BOARD(x+2, y+1)) MARK_CONTROLLED(x+2, y+1);
-  if (!IS_OUT_OF_BOARD(x-1, y-2)) MARK_CONTROLLED(x-1, y-2);
-  if (!IS_OUT_OF_BOARD(x-1, y+2)) MARK_CONTROLLED(x-1, y+2);
-  if (!IS_OUT_OF_BOARD(x+1, y-2)) MARK_CONTROLLED(x+1, y-2);
-  if (!IS_OUT_OF_BOARD(x+1, y+2)) MARK_CONTROLLED(x+1, y+2);
+  const bitboard_t *p = pieces[COLOR_INDEX(color)];
+  return (pawnAttacks[COLOR_INDEX(OPPONENT_COLOR(color))][sq] & p[PAWN])
+      || (knightAttacks[sq] & p[KNIGHT])
+      || (kingAttacks[sq] & p[KING])
+      || (bishop_attacks(sq, occupancy) & (p[BISHOP] | p[QUEEN]))
+      || (rook_attacks(sq, occupancy) & (p[ROOK] | p[QUEEN]));
 }
 
-int *Board::generate_rook_moves(int pieceColor, int x, int y, int *moves)
+#define APPEND_MOVE(x, y) do { *moves++ = x; *moves++ = y; } while(0)
+
+// Appends a move from src to each square in the given bitboard.
+#define APPEND_MOVES(src, targets) do { for(bitboard_t t_ = (targets); t_; ) list.moves[list.size++] = MAKE_MOVE((src), pop_lsb(&t_)); } while(0)
+
+template<int Us>
+void Board::generate_pawn_moves(bitboard_t from, const CheckInfo &info, MoveList &list)
 {
-  for(int Y = y - 1; Y >= 0; --Y) { if (IS_EMPTY_OR_OPPONENT(pieceColor, board[Y][x])) APPEND_MOVE(x, Y); if (board[Y][x]) break; }
-  for(int Y = y + 1; Y < 8; ++Y) { if (IS_EMPTY_OR_OPPONENT(pieceColor, board[Y][x])) APPEND_MOVE(x, Y); if (board[Y][x]) break; }
-  for(int X = x - 1; X >= 0; --X) { if (IS_EMPTY_OR_OPPONENT(pieceColor, board[y][X])) APPEND_MOVE(X, y); if (board[y][X]) break; }
-  for(int X = x + 1; X < 8; ++X) { if (IS_EMPTY_OR_OPPONENT(pieceColor, board[y][X])) APPEND_MOVE(X, y); if (board[y][X]) break; }
-  return moves;
+  PROFILE_SCOPE(PROFILE_GENERATE_PAWN_MOVES);
+  constexpr int forward = (Us == WHITE) ? 8 : -8;
+  constexpr bitboard_t homeRow = (Us == WHITE) ? (RANK_1 << 8) : (RANK_8 >> 8);
+  const bitboard_t opponent = pieces[COLOR_INDEX(OPPONENT_COLOR(Us))][NO_UNIT];
+  for(bitboard_t b = from & pieces[COLOR_INDEX(Us)][PAWN]; b; )
+  {
+    int src = pop_lsb(&b);
+    bitboard_t allowed = info.allowed(src);
+    bitboard_t targets = pawnAttacks[COLOR_INDEX(Us)][src] & opponent;
+    if (!(occupied & SQUARE_BIT(src+forward)))
+    {
+      targets |= SQUARE_BIT(src+forward);
+      if ((homeRow & SQUARE_BIT(src)) && !(occupied & SQUARE_BIT(src+forward+forward))) targets |= SQUARE_BIT(src+forward+forward);
+    }
+    targets &= allowed;
+    if (targets & (RANK_1 | RANK_8))
+      while(targets)
+      {
+        int dst = pop_lsb(&targets);
+        list.moves[list.size++] = MAKE_PROMOTION(src, dst, QUEEN);
+        list.moves[list.size++] = MAKE_PROMOTION(src, dst, ROOK);
+        list.moves[list.size++] = MAKE_PROMOTION(src, dst, BISHOP);
+        list.moves[list.size++] = MAKE_PROMOTION(src, dst, KNIGHT);
+      }
+    else APPEND_MOVES(src, targets);
+
+    if (enpassantX >= 0 && (pawnAttacks[COLOR_INDEX(Us)][src] & SQUARE_BIT(SQUARE(enpassantX, enpassantY))) && is_legal_en_passant(src, info.kingSq))
+      list.moves[list.size++] = MAKE_SPECIAL_MOVE(src, SQUARE(enpassantX, enpassantY), MOVE_EN_PASSANT);
+  }
 }
 
-void Board::mark_rook_controlled_squares(int x, int y, int squares[8][8])
+// En passant removes two pieces from the same rank at once, so instead of using the pin and check
+// information, test directly whether the king would be attacked after the capture. This is rare enough not to matter.
+bool Board::is_legal_en_passant(int src, int kingSq) const
 {
-  for(int Y = y - 1; Y >= 0; --Y) { MARK_CONTROLLED(x, Y); if (board[Y][x]) break; }
-  for(int Y = y + 1; Y < 8; ++Y) { MARK_CONTROLLED(x, Y); if (board[Y][x]) break; }
-  for(int X = x - 1; X >= 0; --X) { MARK_CONTROLLED(X, y); if (board[y][X]) break; }
-  for(int X = x + 1; X < 8; ++X) { MARK_CONTROLLED(X, y); if (board[y][X]) break; }
+  int opponent = (pieces[0][PAWN] & SQUARE_BIT(src)) ? 1 : 0;
+  bitboard_t captured = SQUARE_BIT(SQUARE(enpassantX, SQUARE_Y(src)));
+  bitboard_t occupancy = (occupied ^ SQUARE_BIT(src) ^ captured) | SQUARE_BIT(SQUARE(enpassantX, enpassantY));
+  const bitboard_t *p = pieces[opponent];
+  return !((pawnAttacks[opponent^1][kingSq] & p[PAWN] & ~captured)
+        || (knightAttacks[kingSq] & p[KNIGHT])
+        || (bishop_attacks(kingSq, occupancy) & (p[BISHOP] | p[QUEEN]))
+        || (rook_attacks(kingSq, occupancy) & (p[ROOK] | p[QUEEN])));
 }
 
-int *Board::generate_bishop_moves(int pieceColor, int x, int y, int *moves)
+template<int Us>
+void Board::generate_knight_moves(bitboard_t from, const CheckInfo &info, MoveList &list)
 {
-  for(int i = 1; i <= MIN(  x,   y); ++i) { if (IS_EMPTY_OR_OPPONENT(pieceColor, board[y-i][x-i])) APPEND_MOVE(x-i, y-i); if (board[y-i][x-i]) break; }
-  for(int i = 1; i <= MIN(  x, 7-y); ++i) { if (IS_EMPTY_OR_OPPONENT(pieceColor, board[y+i][x-i])) APPEND_MOVE(x-i, y+i); if (board[y+i][x-i]) break; }
-  for(int i = 1; i <= MIN(7-x,   y); ++i) { if (IS_EMPTY_OR_OPPONENT(pieceColor, board[y-i][x+i])) APPEND_MOVE(x+i, y-i); if (board[y-i][x+i]) break; }
-  for(int i = 1; i <= MIN(7-x, 7-y); ++i) { if (IS_EMPTY_OR_OPPONENT(pieceColor, board[y+i][x+i])) APPEND_MOVE(x+i, y+i); if (board[y+i][x+i]) break; }
-  return moves;
+  PROFILE_SCOPE(PROFILE_GENERATE_KNIGHT_MOVES);
+  const bitboard_t own = pieces[COLOR_INDEX(Us)][NO_UNIT];
+  for(bitboard_t b = from & pieces[COLOR_INDEX(Us)][KNIGHT] & ~info.pinned; b; ) // A pinned knight can never move
+  {
+    int src = pop_lsb(&b);
+    APPEND_MOVES(src, knightAttacks[src] & ~own & info.evasions);
+  }
 }
 
-void Board::mark_bishop_controlled_squares(int x, int y, int squares[8][8])
+template<int Us>
+void Board::generate_rook_moves(bitboard_t from, const CheckInfo &info, MoveList &list)
 {
-  for(int i = 1; i <= MIN(  x,   y); ++i) { MARK_CONTROLLED(x-i, y-i); if (board[y-i][x-i]) break; }
-  for(int i = 1; i <= MIN(  x, 7-y); ++i) { MARK_CONTROLLED(x-i, y+i); if (board[y+i][x-i]) break; }
-  for(int i = 1; i <= MIN(7-x,   y); ++i) { MARK_CONTROLLED(x+i, y-i); if (board[y-i][x+i]) break; }
-  for(int i = 1; i <= MIN(7-x, 7-y); ++i) { MARK_CONTROLLED(x+i, y+i); if (board[y+i][x+i]) break; }
+  PROFILE_SCOPE(PROFILE_GENERATE_ROOK_MOVES);
+  const bitboard_t own = pieces[COLOR_INDEX(Us)][NO_UNIT];
+  for(bitboard_t b = from & pieces[COLOR_INDEX(Us)][ROOK]; b; )
+  {
+    int src = pop_lsb(&b);
+    APPEND_MOVES(src, rook_attacks(src, occupied) & ~own & info.allowed(src));
+  }
 }
 
-int *Board::generate_queen_moves(int pieceColor, int x, int y, int *moves)
+template<int Us>
+void Board::generate_bishop_moves(bitboard_t from, const CheckInfo &info, MoveList &list)
 {
-  moves = generate_rook_moves(pieceColor, x, y, moves);
-  return generate_bishop_moves(pieceColor, x, y, moves);
+  PROFILE_SCOPE(PROFILE_GENERATE_BISHOP_MOVES);
+  const bitboard_t own = pieces[COLOR_INDEX(Us)][NO_UNIT];
+  for(bitboard_t b = from & pieces[COLOR_INDEX(Us)][BISHOP]; b; )
+  {
+    int src = pop_lsb(&b);
+    APPEND_MOVES(src, bishop_attacks(src, occupied) & ~own & info.allowed(src));
+  }
 }
 
-void Board::mark_queen_controlled_squares(int x, int y, int squares[8][8])
+template<int Us>
+void Board::generate_queen_moves(bitboard_t from, const CheckInfo &info, MoveList &list)
 {
-  mark_rook_controlled_squares(x, y, squares);
-  mark_bishop_controlled_squares(x, y, squares);
+  PROFILE_SCOPE(PROFILE_GENERATE_QUEEN_MOVES);
+  const bitboard_t own = pieces[COLOR_INDEX(Us)][NO_UNIT];
+  for(bitboard_t b = from & pieces[COLOR_INDEX(Us)][QUEEN]; b; )
+  {
+    int src = pop_lsb(&b);
+    APPEND_MOVES(src, queen_attacks(src, occupied) & ~own & info.allowed(src));
+  }
 }
 
-int *Board::generate_king_moves(int pieceColor, int x, int y, int *moves)
+template<int Us>
+void Board::generate_king_moves(bitboard_t from, const CheckInfo &info, MoveList &list)
 {
-  if (IS_EMPTY_OR_OPPONENT_AT(pieceColor, x-1, y-1)) APPEND_MOVE(x-1, y-1);
-  if (IS_EMPTY_OR_OPPONENT_AT(pieceColor, x-1,   y)) APPEND_MOVE(x-1,   y);
-  if (IS_EMPTY_OR_OPPONENT_AT(pieceColor, x-1, y+1)) APPEND_MOVE(x-1, y+1);
-  if (IS_EMPTY_OR_OPPONENT_AT(pieceColor,   x, y-1)) APPEND_MOVE(  x, y-1);
-  if (IS_EMPTY_OR_OPPONENT_AT(pieceColor,   x, y+1)) APPEND_MOVE(  x, y+1);
-  if (IS_EMPTY_OR_OPPONENT_AT(pieceColor, x+1, y-1)) APPEND_MOVE(x+1, y-1);
-  if (IS_EMPTY_OR_OPPONENT_AT(pieceColor, x+1,   y)) APPEND_MOVE(x+1,   y);
-  if (IS_EMPTY_OR_OPPONENT_AT(pieceColor, x+1, y+1)) APPEND_MOVE(x+1, y+1);
+  PROFILE_SCOPE(PROFILE_GENERATE_KING_MOVES);
+  bitboard_t king = from & pieces[COLOR_INDEX(Us)][KING];
+  if (!king) return;
+  int src = lsb(king);
+
+  // Sliders x-ray through the king, so that it can't step back along the line of a checking slider.
+  bitboard_t opponentControlledSquares = controlled_squares<OPPONENT_COLOR(Us)>(occupied ^ king);
+  APPEND_MOVES(src, kingAttacks[src] & ~pieces[COLOR_INDEX(Us)][NO_UNIT] & ~opponentControlledSquares);
 
   // Check castling moves.
-  int castlingSide = (pieceColor == WHITE) ? 0 : 1;
-  if ((castlingPiecesAtHome[castlingSide] & KINGSIDE_CASTLING_MASK) == KINGSIDE_CASTLING_MASK || (castlingPiecesAtHome[castlingSide] & QUEENSIDE_CASTLING_MASK) == QUEENSIDE_CASTLING_MASK)
+  constexpr int castlingSide = COLOR_INDEX(Us), y = (Us == WHITE) ? 0 : 7;
+  if (!info.checkers && ((castlingPiecesAtHome[castlingSide] & KINGSIDE_CASTLING_MASK) == KINGSIDE_CASTLING_MASK || (castlingPiecesAtHome[castlingSide] & QUEENSIDE_CASTLING_MASK) == QUEENSIDE_CASTLING_MASK))
   {
-    int opponentControlledSquares[8][8];
-    mark_controlled_squares(OPPONENT_COLOR(pieceColor), opponentControlledSquares);
-    if (!opponentControlledSquares[y][x])
-    {
-      if ((castlingPiecesAtHome[castlingSide] & KINGSIDE_CASTLING_MASK) == KINGSIDE_CASTLING_MASK && !board[y][5] && !board[y][6] && !opponentControlledSquares[y][5] && !opponentControlledSquares[y][6])
-        APPEND_MOVE(6, y);
-      if ((castlingPiecesAtHome[castlingSide] & QUEENSIDE_CASTLING_MASK) == QUEENSIDE_CASTLING_MASK && !board[y][1] && !board[y][2] && !board[y][3] && !opponentControlledSquares[y][2] && !opponentControlledSquares[y][3])
-        APPEND_MOVE(2, y);
-    }
+    #define FREE(x) (!(occupied & SQUARE_BIT(SQUARE((x), y))))
+    #define SAFE(x) (!(opponentControlledSquares & SQUARE_BIT(SQUARE((x), y))))
+    if ((castlingPiecesAtHome[castlingSide] & KINGSIDE_CASTLING_MASK) == KINGSIDE_CASTLING_MASK && FREE(5) && FREE(6) && SAFE(5) && SAFE(6))
+      list.moves[list.size++] = MAKE_SPECIAL_MOVE(src, SQUARE(6, y), MOVE_CASTLING);
+    if ((castlingPiecesAtHome[castlingSide] & QUEENSIDE_CASTLING_MASK) == QUEENSIDE_CASTLING_MASK && FREE(1) && FREE(2) && FREE(3) && SAFE(2) && SAFE(3))
+      list.moves[list.size++] = MAKE_SPECIAL_MOVE(src, SQUARE(2, y), MOVE_CASTLING);
+    #undef FREE
+    #undef SAFE
   }
-  return moves;
 }
 
-void Board::mark_king_controlled_squares(int x, int y, int squares[8][8])
+template<int Us>
+void Board::compute_check_info(CheckInfo *info) const
 {
-  if (!IS_OUT_OF_BOARD(x-1, y-1)) MARK_CONTROLLED(x-1, y-1);
-  if (!IS_OUT_OF_BOARD(x-1,   y)) MARK_CONTROLLED(x-1,   y);
-  if (!IS_OUT_OF_BOARD(x-1, y+1)) MARK_CONTROLLED(x-1, y+1);
-  if (!IS_OUT_OF_BOARD(  x, y-1)) MARK_CONTROLLED(  x, y-1);
-  if (!IS_OUT_OF_BOARD(  x, y+1)) MARK_CONTROLLED(  x, y+1);
-  if (!IS_OUT_OF_BOARD(x+1, y-1)) MARK_CONTROLLED(x+1, y-1);
-  if (!IS_OUT_OF_BOARD(x+1,   y)) MARK_CONTROLLED(x+1,   y);
-  if (!IS_OUT_OF_BOARD(x+1, y+1)) MARK_CONTROLLED(x+1, y+1);
+  PROFILE_SCOPE(PROFILE_COMPUTE_CHECK_INFO);
+  const bitboard_t *own = pieces[COLOR_INDEX(Us)];
+  const bitboard_t *opponent = pieces[COLOR_INDEX(OPPONENT_COLOR(Us))];
+  info->pinned = 0;
+  if (!own[KING]) // No king on board, so nothing to keep safe
+  {
+    info->kingSq = 0;
+    info->checkers = 0;
+    info->evasions = ~0ULL;
+    return;
+  }
+  int kingSq = info->kingSq = lsb(own[KING]);
+  info->checkers = attackers_to(kingSq, occupied) & opponent[NO_UNIT];
+
+  if (!info->checkers) info->evasions = ~0ULL;
+  else if (more_than_one(info->checkers)) info->evasions = 0; // Double check, only the king can move
+  else info->evasions = info->checkers | squaresBetween[kingSq][lsb(info->checkers)];
+
+  // A piece is pinned if it is the only piece between the king and an opponent slider on the same line.
+  bitboard_t snipers = (rook_attacks(kingSq, 0) & (opponent[ROOK] | opponent[QUEEN])) | (bishop_attacks(kingSq, 0) & (opponent[BISHOP] | opponent[QUEEN]));
+  while(snipers)
+  {
+    bitboard_t blockers = squaresBetween[kingSq][pop_lsb(&snipers)] & occupied;
+    if (blockers && !more_than_one(blockers)) info->pinned |= blockers & own[NO_UNIT];
+  }
+}
+
+bitboard_t Board::attackers_to(int sq, bitboard_t occupancy) const
+{
+  return (pawnAttacks[1][sq] & pieces[0][PAWN])
+       | (pawnAttacks[0][sq] & pieces[1][PAWN])
+       | (knightAttacks[sq] & (pieces[0][KNIGHT] | pieces[1][KNIGHT]))
+       | (kingAttacks[sq] & (pieces[0][KING] | pieces[1][KING]))
+       | (bishop_attacks(sq, occupancy) & (pieces[0][BISHOP] | pieces[1][BISHOP] | pieces[0][QUEEN] | pieces[1][QUEEN]))
+       | (rook_attacks(sq, occupancy) & (pieces[0][ROOK] | pieces[1][ROOK] | pieces[0][QUEEN] | pieces[1][QUEEN]));
+}
+
+template<int Color>
+bitboard_t Board::controlled_squares(bitboard_t occupancy) const
+{
+  PROFILE_SCOPE(PROFILE_CONTROLLED_SQUARES);
+  const bitboard_t *p = pieces[COLOR_INDEX(Color)];
+  bitboard_t pawns = p[PAWN];
+  bitboard_t squares = (Color == WHITE) ? (((pawns & ~FILE_A) << 7) | ((pawns & ~FILE_H) << 9))
+                                        : (((pawns & ~FILE_A) >> 9) | ((pawns & ~FILE_H) >> 7));
+  for(bitboard_t b = p[KNIGHT]; b; ) squares |= knightAttacks[pop_lsb(&b)];
+  for(bitboard_t b = p[BISHOP] | p[QUEEN]; b; ) squares |= bishop_attacks(pop_lsb(&b), occupancy);
+  for(bitboard_t b = p[ROOK] | p[QUEEN]; b; ) squares |= rook_attacks(pop_lsb(&b), occupancy);
+  for(bitboard_t b = p[KING]; b; ) squares |= kingAttacks[pop_lsb(&b)];
+  return squares;
+}
+
+bitboard_t Board::controlled_squares(int color, bitboard_t occupancy) const
+{
+  return (color == WHITE) ? controlled_squares<WHITE>(occupancy) : controlled_squares<BLACK>(occupancy);
 }
 
 void Board::mark_controlled_squares(int color, int squares[8][8])
 {
+  PROFILE_SCOPE(PROFILE_MARK_CONTROLLED_SQUARES);
+  bitboard_t controlled = controlled_squares(color);
   for(int y = 0; y < 8; ++y)
     for(int x = 0; x < 8; ++x)
-      squares[y][x] = 0;
+      squares[y][x] = (controlled >> SQUARE(x, y)) & 1;
+}
 
-  for(int y = 0; y < 8; ++y)
-    for(int x = 0; x < 8; ++x)
-      if (PLAYER_COLOR(board[y][x]) == color)
-        switch(PIECE_TYPE(board[y][x]))
-        {
-        case KING: mark_king_controlled_squares(x, y, squares); break;
-        case QUEEN: mark_queen_controlled_squares(x, y, squares); break;
-        case ROOK: mark_rook_controlled_squares(x, y, squares); break;
-        case BISHOP: mark_bishop_controlled_squares(x, y, squares); break;
-        case KNIGHT: mark_knight_controlled_squares(x, y, squares); break;
-        case PAWN: mark_pawn_controlled_squares(x, y, squares); break;
-        default: break;
-        }
-}
-
-int *Board::generate_moves_without_king_safety(int pieceColor, int x, int y, int *moves)
-{
-  switch(PIECE_TYPE(board[y][x]))
+template<int Us>
+void Board::generate_legal_moves(bitboard_t from, MoveList &list)
+{
+  PROFILE_SCOPE(PROFILE_GENERATE_LEGAL_MOVES);
+  CheckInfo info;
+  compute_check_info<Us>(&info);
+  generate_king_moves<Us>(from, info, list);
+  if (more_than_one(info.checkers)) return; // In double check only the king can move
+  generate_pawn_moves<Us>(from, info, list);
+  generate_knight_moves<Us>(from, info, list);
+  generate_bishop_moves<Us>(from, info, list);
+  generate_rook_moves<Us>(from, info, list);
+  generate_queen_moves<Us>(from, info, list);
+}
+
+void Board::generate_legal_moves(int pieceColor, bitboard_t from, MoveList &list)
+{
+  // The only branch on the side to move, the generators are compiled separately for each color.
+  if (pieceColor == WHITE) generate_legal_moves<WHITE>(from, list);
+  else generate_legal_moves<BLACK>(from, list);
+}
+
+void Board::generate_all_moves(MoveList &list)
+{
+  list.size = 0;
+  generate_legal_moves(currentPlayer, ~0ULL, list);
+}
+
+void move_to_uci(move_t move, char *str)
+{
+  *str++ = 'a' + SQUARE_X(MOVE_SRC(move));
+  *str++ = '1' + SQUARE_Y(MOVE_SRC(move));
+  *str++ = 'a' + SQUARE_X(MOVE_DST(move));
+  *str++ = '1' + SQUARE_Y(MOVE_DST(move));
+  if (MOVE_TYPE(move) == MOVE_PROMOTION) *str++ = " kqrbnp"[MOVE_PROMOTION_PIECE(move)];
+  *str = 0;
+}
+
+move_t Board::parse_uci_move(const char *str)
+{
+  MoveList list;
+  generate_all_moves(list);
+  for(int i = 0; i < list.size; ++i)
   {
-  case KING:   return generate_king_moves(pieceColor, x, y, moves);
-  case QUEEN:  return generate_queen_moves(pieceColor, x, y, moves);
-  case ROOK:   return generate_rook_moves(pieceColor, x, y, moves);
-  case BISHOP: return generate_bishop_moves(pieceColor, x, y, moves);
-  case KNIGHT: return generate_knight_moves(pieceColor, x, y, moves);
-  case PAWN:   return generate_pawn_moves(pieceColor, x, y, moves);
-  default:     return moves;
+    char uci[6];
+    move_to_uci(list.moves[i], uci);
+    if (!strcmp(uci, str)) return list.moves[i];
   }
+  return NO_MOVE;
 }
 
-int *Board::generate_moves(int x, int y, int *moves)
+static const char sanPieceChars[] = "  QRBN"; // Indexed by piece type, pawns have no letter and the king is handled separately
+
+move_t Board::parse_san_move(const char *str)
 {
-  int pieceColor = PLAYER_COLOR(board[y][x]);
-  int *end = generate_moves_without_king_safety(pieceColor, x, y, moves);
-  while(moves != end) // Test king safety for each move
+  char san[16];
+  int len = 0;
+  while(str[len] && str[len] != ' ' && len < 15) san[len] = str[len], ++len;
+  while(len > 0 && strchr("+#!?", san[len-1])) --len;
+  if (len > 4 && !memcmp(san + len - 4, "e.p.", 4)) len -= 4;
+  san[len] = 0;
+
+  MoveList list;
+  generate_all_moves(list);
+
+  if (!strcmp(san, "O-O") || !strcmp(san, "0-0") || !strcmp(san, "O-O-O") || !strcmp(san, "0-0-0"))
   {
-    Board copy = *this;
-    copy.make_move(x, y, moves[0], moves[1]);
-    if (copy.is_king_in_check(pieceColor))
+    int dstX = (len == 3) ? 6 : 2;
+    for(int i = 0; i < list.size; ++i)
+      if (MOVE_TYPE(list.moves[i]) == MOVE_CASTLING && SQUARE_X(MOVE_DST(list.moves[i])) == dstX) return list.moves[i];
+    return NO_MOVE;
+  }
+
+  const char *p = san;
+  int pieceType = PAWN;
+  if (*p == 'K') pieceType = KING, ++p, --len;
+  else if (*p && strchr(sanPieceChars + QUEEN, *p)) pieceType = (int)(strchr(sanPieceChars + QUEEN, *p) - sanPieceChars), ++p, --len;
+
+  int promotion = 0;
+  if (pieceType == PAWN && len >= 3 && strchr(sanPieceChars + QUEEN, p[len-1])) // "e8=Q", also seen written as "e8Q"
+  {
+    promotion = (int)(strchr(sanPieceChars + QUEEN, p[len-1]) - sanPieceChars);
+    len -= (p[len-2] == '=') ? 2 : 1;
+  }
+  if (len < 2 || p[len-2] < 'a' || p[len-2] > 'h' || p[len-1] < '1' || p[len-1] > '8') return NO_MOVE;
+  int dst = SQUARE(p[len-2] - 'a', p[len-1] - '1');
+
+  int fromX = -1, fromY = -1;
+  for(int i = 0; i < len - 2; ++i)
+  {
+    if (p[i] >= 'a' && p[i] <= 'h') fromX = p[i] - 'a';
+    else if (p[i] >= '1' && p[i] <= '8') fromY = p[i] - '1';
+    else if (p[i] != 'x' && p[i] != '-' && p[i] != ':') return NO_MOVE;
+  }
+
+  move_t found = NO_MOVE;
+  for(int i = 0; i < list.size; ++i)
+  {
+    move_t move = list.moves[i];
+    int src = MOVE_SRC(move);
+    if (MOVE_DST(move) != dst || PIECE_TYPE(board[SQUARE_Y(src)][SQUARE_X(src)]) != pieceType) continue;
+    if ((fromX >= 0 && SQUARE_X(src) != fromX) || (fromY >= 0 && SQUARE_Y(src) != fromY)) continue;
+    if (MOVE_TYPE(move) == MOVE_PROMOTION && MOVE_PROMOTION_PIECE(move) != (promotion ? promotion : QUEEN)) continue;
+    if (MOVE_TYPE(move) != MOVE_PROMOTION && promotion) continue;
+    if (found) return NO_MOVE; // Ambiguous
+    found = move;
+  }
+  return found;
+}
+
+void Board::move_to_san(move_t move, char *str)
+{
+  int src = MOVE_SRC(move), dst = MOVE_DST(move);
+  int pieceType = PIECE_TYPE(board[SQUARE_Y(src)][SQUARE_X(src)]);
+  bool capture = board[SQUARE_Y(dst)][SQUARE_X(dst)] || MOVE_TYPE(move) == MOVE_EN_PASSANT;
+
+  if (MOVE_TYPE(move) == MOVE_CASTLING) str += sprintf(str, (SQUARE_X(dst) == 6) ? "O-O" : "O-O-O");
+  else
+  {
+    if (pieceType == PAWN)
     {
-      moves[1] = *--end;
-      moves[0] = *--end;
+      if (capture) *str++ = 'a' + SQUARE_X(src);
     }
-    else moves += 2;
+    else
+    {
+      *str++ = (pieceType == KING) ? 'K' : sanPieceChars[pieceType];
+      // Name the source file, rank or both if another piece of the same type can move to the same square.
+      MoveList list;
+      generate_all_moves(list);
+      bool ambiguous = false, sameFile = false, sameRank = false;
+      for(int i = 0; i < list.size; ++i)
+      {
+        int otherSrc = MOVE_SRC(list.moves[i]);
+        if (MOVE_DST(list.moves[i]) != dst || otherSrc == src || PIECE_TYPE(board[SQUARE_Y(otherSrc)][SQUARE_X(otherSrc)]) != pieceType) continue;
+        ambiguous = true;
+        sameFile |= SQUARE_X(otherSrc) == SQUARE_X(src);
+        sameRank |= SQUARE_Y(otherSrc) == SQUARE_Y(src);
+      }
+      if (ambiguous && (!sameFile || sameRank)) *str++ = 'a' + SQUARE_X(src);
+      if (ambiguous && sameFile) *str++ = '1' + SQUARE_Y(src);
+    }
+    if (capture) *str++ = 'x';
+    *str++ = 'a' + SQUARE_X(dst);
+    *str++ = '1' + SQUARE_Y(dst);
+    if (MOVE_TYPE(move) == MOVE_PROMOTION) *str++ = '=', *str++ = sanPieceChars[MOVE_PROMOTION_PIECE(move)];
+  }
+
+  make_move(move);
+  if (is_king_in_check(currentPlayer))
+  {
+    MoveList replies;
+    generate_all_moves(replies);
+    *str++ = replies.size ? '+' : '#';
   }
-  return end;
+  unmake_move();
+  *str = 0;
+}
+
+int *Board::generate_moves(int x, int y, int *moves)
+{
+  PROFILE_SCOPE(PROFILE_GENERATE_MOVES);
+  int pieceColor = PLAYER_COLOR(board[y][x]);
+  if (pieceColor != WHITE && pieceColor != BLACK) return moves;
+
+  MoveList list;
+  generate_legal_moves(pieceColor, SQUARE_BIT(SQUARE(x, y)), list);
+  for(int i = 0; i < list.size; ++i)
+    if (MOVE_TYPE(list.moves[i]) != MOVE_PROMOTION || MOVE_PROMOTION_PIECE(list.moves[i]) == QUEEN)
+      APPEND_MOVE(SQUARE_X(MOVE_DST(list.moves[i])), SQUARE_Y(MOVE_DST(list.moves[i])));
+  return moves;
 }
 
 bool Board::is_valid_move(int srcX, int srcY, int dstX, int dstY)
@@ -301,11 +802,6 @@ bool Board::has_valid_moves(int x, int y)
 
 void Board::find_king(int kingPiece, int *X, int *Y)
 {
-  for(int y = 0; y < 8; ++y)
-    for(int x = 0; x < 8; ++x)
-      if (board[y][x] == kingPiece)
-      {
-        *X = x, *Y = y;
-        return;
-      }
+  bitboard_t king = pieces[COLOR_INDEX(PLAYER_COLOR(kingPiece))][KING];
+  if (king) *X = SQUARE_X(lsb(king)), *Y = SQUARE_Y(lsb(king));
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include "bitboard.h"
 
 #define NO_UNIT 0
 #define WHITE 0x10
@@ -56,6 +57,9 @@
 
 #define PIECE_TYPE(piece) ((piece) & ~WHITE_OR_BLACK_MASK)
 
+// Maps WHITE to 0 and BLACK to 1, for indexing per-side arrays.
+#define COLOR_INDEX(player_color) ((player_color) >> 5)
+
 // player_color == WHITE or BLACK don't call with other enums
 #define IS_EMPTY_OR_OPPONENT(player_color, piece) (((piece) & (player_color)) == 0)
 
@@ -71,6 +75,67 @@
 
 typedef uint8_t piece_t;
 
+// A move packed in 16 bits: bits 0-5 source square, bits 6-11 destination square, bits 12-13 the piece
+// to promote to (QUEEN, ROOK, BISHOP or KNIGHT minus QUEEN) and bits 14-15 the special move type.
+// Castling moves are encoded as the king moving two squares.
+typedef uint16_t move_t;
+
+#define NO_MOVE 0
+#define MOVE_NORMAL 0
+#define MOVE_PROMOTION (1 << 14)
+#define MOVE_EN_PASSANT (2 << 14)
+#define MOVE_CASTLING (3 << 14)
+
+#define MAKE_MOVE(src, dst) ((move_t)((src) | ((dst) << 6)))
+#define MAKE_SPECIAL_MOVE(src, dst, type) ((move_t)((src) | ((dst) << 6) | (type)))
+#define MAKE_PROMOTION(src, dst, pieceType) ((move_t)((src) | ((dst) << 6) | (((pieceType) - QUEEN) << 12) | MOVE_PROMOTION))
+
+#define MOVE_SRC(move) ((move) & 63)
+#define MOVE_DST(move) (((move) >> 6) & 63)
+#define MOVE_TYPE(move) ((move) & (3 << 14))
+#define MOVE_PROMOTION_PIECE(move) ((((move) >> 12) & 3) + QUEEN) // Only meaningful if MOVE_TYPE(move) == MOVE_PROMOTION
+
+// Writes the move in UCI long algebraic notation, e.g. "e2e4" or "e7e8q", into str that must have room for 6 chars.
+void move_to_uci(move_t move, char *str);
+
+// The most legal moves known in any reachable position is 218.
+#define MAX_MOVES 256
+
+// Fixed capacity list of moves, meant to be allocated on the stack.
+struct MoveList
+{
+  move_t moves[MAX_MOVES];
+  int size;
+
+  MoveList():size(0) {}
+  move_t *begin() { return moves; }
+  move_t *end() { return moves + size; }
+  const move_t *begin() const { return moves; }
+  const move_t *end() const { return moves + size; }
+};
+
+// Everything make_move() overwrites that can't be deduced from the move itself. The rook of a castling
+// move is found from the king's destination, so it needs no storage here.
+struct UndoRecord
+{
+  uint64_t hash; // Hash key of the position before the move, also used to find repetitions
+  move_t move;
+  piece_t captured;
+  piece_t moved; // The piece that moved, so that the piece changes of past moves can be replayed without their boards, see nnue.h
+  uint8_t castlingPiecesAtHome[2];
+  int8_t enpassantX, enpassantY;
+  uint8_t halfmoveClock;
+};
+
+// Longest move in standard algebraic notation written by Board::move_to_san, e.g. "Qa1xb2+", including the terminating zero.
+#define MAX_SAN_LENGTH 10
+
+// Longest possible FEN string written by Board::to_fen, including the terminating zero.
+#define MAX_FEN_LENGTH 96
+
+// Number of moves that can be taken back. If a game grows longer, the oldest half of the history is forgotten.
+#define MAX_HISTORY 1024
+
 struct Board
 {
 public:
@@ -80,20 +145,77 @@ public:
   uint8_t castlingPiecesAtHome[2];
   int8_t enpassantX, enpassantY;
 
+  // Bitboard view of the board array above, kept in sync by make_move.
+  // pieces[COLOR_INDEX(color)][pieceType] has the pieces of that type, and pieces[COLOR_INDEX(color)][NO_UNIT] all pieces of that side.
+  bitboard_t pieces[2][7];
+  bitboard_t occupied;
+
+  // Zobrist hash key of the position: pieces, side to move, castling rights and en passant file.
+  // The en passant file only counts if a pawn can actually make the capture. Updated incrementally by make_move.
+  uint64_t hash;
+
+  // Sums of the pieceSquareScores and phaseWeights of the pieces on board, see evaluate.h, so that evaluate() is
+  // a blend of two numbers. pieceSquareTotal[PHASE_MIDDLEGAME] and [PHASE_ENDGAME] are from white's point of view.
+  // Updated incrementally like the hash.
+  int32_t pieceSquareTotal[2];
+  int32_t phase;
+
+  // Number of plies since the last capture or pawn move, for the 50 move rule and to bound the repetition search.
+  uint8_t halfmoveClock;
+
+  // Number of the current full move, starts at 1 and is incremented after each move of black.
+  uint16_t fullmoveNumber;
+
+  // Undo stack of the moves made with make_move, the last made move is at history[historyLength-1]. Kept last,
+  // as copies of the board only copy the records in use.
+  int historyLength = 0;
+  UndoRecord history[MAX_HISTORY];
+
+  // Copying a board copies the position and the moves made so far, but not the unused rest of the undo stack,
+  // which is most of the size of a Board.
+  Board() = default;
+  Board(const Board &other) { copy_from(other); }
+  Board &operator=(const Board &other) { if (this != &other) copy_from(other); return *this; }
+
   piece_t &At(int x, int y) { return (x >= 0 && x < 8 && y >= 0 && y < 8) ? board[y][x] : out; }
   piece_t At(int x, int y) const { return (x >= 0 && x < 8 && y >= 0 && y < 8) ? board[y][x] : out; }
 
   // Sets up initial game starting position.
   void new_game();
 
+  // Sets up the position described by the given FEN string. The move counter fields are optional, so EPD
+  // records are accepted too; anything after the fields is ignored. Returns false if the string can't be
+  // parsed, or the position doesn't have exactly one king of each color or has pawns on the first or last
+  // rank, in which case the board is left in an unspecified state. If end is not null, it is set to point
+  // past the last field read.
+  bool load_fen(const char *fen, const char **end = 0);
+
+  // Writes the position as a FEN string into str, that must have room for MAX_FEN_LENGTH chars.
+  void to_fen(char *str) const;
+
+  // Rebuilds the bitboards and the hash key from the board array and game state. Call after editing board[][] directly.
+  void update_bitboards();
+
   // Finds coordinates of the specified king on board, kingPiece == WHITE_KING or BLACK_KING.
   void find_king(int kingPiece, int *x, int *y);
 
+  // Returns how many times the current position has occurred before, as far back as the move history reaches.
+  int repetition_count() const;
+
   // Returns true of the king of given color == WHITE or BLACK is currently in check.
   bool is_king_in_check(int color);
 
-  // Applies the given move without checking for its legality.
-  void make_move(int srcX, int srcY, int dstX, int dstY);
+  // Applies the given move without checking for its legality, and pushes it on the undo stack.
+  void make_move(move_t move);
+
+  // Takes back the last move made with make_move or make_null_move. Does nothing if there are no moves left to take back.
+  void unmake_move();
+
+  // Passes the turn to the opponent without moving, for null move pruning in search. Must not be called when in check.
+  void make_null_move();
+
+  // Applies the given move without checking for its legality. A pawn that reaches the last rank is promoted to the given piece type.
+  void make_move(int srcX, int srcY, int dstX, int dstY, int promotion = QUEEN);
 
   // Returns true if the given move is legal.
   bool is_valid_move(int srcX, int srcY, int dstX, int dstY);
@@ -101,26 +223,68 @@ public:
   // Returns true if the piece at the given coordinates has any legal moves.
   bool has_valid_moves(int x, int y);
 
-  // Generates all legal moves for the piece in the specified coordinates, as (x,y) pairs.
-  // The moves array must be at least 3*8*2 = 48 ints long. Returns iterator style pointer to end of written array.
+  // Generates all legal moves for the piece in the specified coordinates, as (x,y) pairs. Promotions are
+  // reported once, as the destination square. The moves array must be at least 3*8*2 = 48 ints long.
+  // Returns iterator style pointer to end of written array.
   int *generate_moves(int x, int y, int *moves);
 
+  // Replaces the contents of the list with all legal moves of the player to move, including each underpromotion.
+  void generate_all_moves(MoveList &list);
+
+  // Returns the legal move of the player to move given in UCI long algebraic notation, or NO_MOVE if there is no such move.
+  move_t parse_uci_move(const char *str);
+
+  // Returns the legal move of the player to move given in standard algebraic notation (e.g. "Nbd7", "exd8=Q+",
+  // "O-O"), or NO_MOVE if there is no such move or it is ambiguous. Check and annotation suffixes are ignored.
+  move_t parse_san_move(const char *str);
+
+  // Writes the given legal move in standard algebraic notation into str, that must have room for MAX_SAN_LENGTH chars.
+  void move_to_san(move_t move, char *str);
+
   // Marks all squares controlled by the given player.
   void mark_controlled_squares(int color, int squares[8][8]);
 
+  // Returns the set of all squares controlled by the given player. Sliding pieces are blocked by the given occupancy.
+  bitboard_t controlled_squares(int color) const { return controlled_squares(color, occupied); }
+  bitboard_t controlled_squares(int color, bitboard_t occupancy) const;
+
+  // Returns the pieces of both colors that attack the given square, with the given occupancy for sliding pieces.
+  bitboard_t attackers_to(int sq, bitboard_t occupancy) const;
+
+  // Returns true if any piece of the given color attacks the square, with the given occupancy for sliding pieces.
+  bool is_square_attacked(int sq, int color, bitboard_t occupancy) const;
+
 private:
-  int *generate_moves_without_king_safety(int pieceColor, int x, int y, int *moves);
-  int *generate_pawn_moves(int pieceColor, int x, int y, int *moves);
-  int *generate_knight_moves(int pieceColor, int x, int y, int *moves);
-  int *generate_rook_moves(int pieceColor, int x, int y, int *moves);
-  int *generate_bishop_moves(int pieceColor, int x, int y, int *moves);
-  int *generate_queen_moves(int pieceColor, int x, int y, int *moves);
-  int *generate_king_moves(int pieceColor, int x, int y, int *moves);
-
-  void mark_pawn_controlled_squares(int x, int y, int squares[8][8]);
-  void mark_knight_controlled_squares(int x, int y, int squares[8][8]);
-  void mark_rook_controlled_squares(int x, int y, int squares[8][8]);
-  void mark_bishop_controlled_squares(int x, int y, int squares[8][8]);
-  void mark_queen_controlled_squares(int x, int y, int squares[8][8]);
-  void mark_king_controlled_squares(int x, int y, int squares[8][8]);
+  // King safety state of one side, computed once per position so that move generation
+  // only emits legal moves without trying them out on a copy of the board.
+  struct CheckInfo
+  {
+    int kingSq;
+    bitboard_t checkers; // Opponent pieces giving check
+    bitboard_t pinned; // Own pieces that may only move along the line between the king and the pinning slider
+    bitboard_t evasions; // Destinations that resolve a check (capturing the checker or blocking it), all squares if not in check
+
+    // Returns the destinations that the non-king piece at the given square may move to without exposing the king.
+    bitboard_t allowed(int sq) const { return (pinned & SQUARE_BIT(sq)) ? evasions & lineThrough[kingSq][sq] : evasions; }
+  };
+  template<int Us> void compute_check_info(CheckInfo *info) const;
+  bool is_legal_en_passant(int src, int kingSq) const;
+
+  // Appends the legal moves of the given player's pieces that stand on the given set of squares. The
+  // generators take the player as a template parameter, so that each color gets its own branch free copy.
+  void generate_legal_moves(int pieceColor, bitboard_t from, MoveList &list);
+  template<int Us> void generate_legal_moves(bitboard_t from, MoveList &list);
+  template<int Us> void generate_pawn_moves(bitboard_t from, const CheckInfo &info, MoveList &list);
+  template<int Us> void generate_knight_moves(bitboard_t from, const CheckInfo &info, MoveList &list);
+  template<int Us> void generate_rook_moves(bitboard_t from, const CheckInfo &info, MoveList &list);
+  template<int Us> void generate_bishop_moves(bitboard_t from, const CheckInfo &info, MoveList &list);
+  template<int Us> void generate_queen_moves(bitboard_t from, const CheckInfo &info, MoveList &list);
+  template<int Us> void generate_king_moves(bitboard_t from, const CheckInfo &info, MoveList &list);
+  template<int Color> bitboard_t controlled_squares(bitboard_t occupancy) const;
+
+  void copy_from(const Board &other);
+  uint64_t castling_and_enpassant_hash() const;
+  UndoRecord &push_undo_record(move_t move);
+  void put_piece(int x, int y, piece_t piece);
+  void remove_piece(int x, int y);
 };
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include "board.h"
+#include "mapped_file.h"
+
+// Number of random keys the Polyglot position key is built from: 12*64 pieces, 4 castling rights,
+// 8 en passant files and the side to move.
+#define POLYGLOT_NUM_RANDOMS 781
+
+// Returns the Polyglot key of the position. Unlike Board::hash this is a fixed published format, so that
+// books can be shared between programs.
+uint64_t polyglot_key(const Board &board);
+
+// Converts between move_t and the 16 bit Polyglot move format, where castling is the king capturing its own
+// rook. polyglot_to_move needs the board to find the legal move, and returns NO_MOVE if there is none.
+uint16_t move_to_polyglot(move_t move);
+move_t polyglot_to_move(Board &board, uint16_t polyglotMove);
+
+// One 16 byte record of a Polyglot .bin file, in host byte order. The file stores them big endian, sorted by key.
+struct PolyglotEntry
+{
+  uint64_t key;
+  uint16_t move;
+  uint16_t weight;
+  uint32_t learn;
+};
+
+// Writes the entry in the file format into the 16 bytes at p.
+void write_polyglot_entry(const PolyglotEntry &entry, uint8_t *p);
+
+struct BookMove
+{
+  move_t move;
+  int weight;
+};
+
+#define MAX_BOOK_MOVES 64
+
+// Polyglot opening book. The file is memory mapped and binary searched in place, so opening a book of any size
+// is instant and only the pages touched by probes are ever read. Where mmap isn't available, as in the browser
+// build where the file would have to fit in the heap, each probe reads the few entries it needs from the file.
+struct OpeningBook
+{
+  OpeningBook();
+  ~OpeningBook();
+
+  // Opens the given book, closing any previous one. Returns false if the file can't be opened or is not a
+  // whole number of entries.
+  bool open(const char *filename);
+  void close();
+  bool is_open() const { return numEntries > 0; }
+
+  // Writes the legal book moves of the position into moves, at most maxMoves of them, and returns how many there are.
+  int probe(Board &board, BookMove *moves, int maxMoves);
+
+  // Returns a book move for the position, or NO_MOVE if it is not in the book. With best the move with the
+  // highest weight is returned, otherwise a move picked at random in proportion to its weight, using the given
+  // random number.
+  move_t pick(Board &board, bool best, uint64_t random);
+
+private:
+  MappedFile mapped;
+  FILE *file; // Only used if the book could not be memory mapped
+  uint64_t numEntries;
+
+  void read_entry(uint64_t index, PolyglotEntry *entry);
+
+  OpeningBook(const OpeningBook &);
+  OpeningBook &operator=(const OpeningBook &);
+};
@@ -0,0 +1,170 @@
+#include "engine_channel.h"
+#include <string.h>
+
+#define MIN(x, y) ((x) <= (y) ? (x) : (y))
+
+void save_position_record(const Board &board, PositionRecord *record)
+{
+  memcpy(record->board, board.board, sizeof(record->board));
+  record->currentPlayer = board.currentPlayer;
+  record->castlingPiecesAtHome[0] = board.castlingPiecesAtHome[0];
+  record->castlingPiecesAtHome[1] = board.castlingPiecesAtHome[1];
+  record->enpassantX = board.enpassantX;
+  record->enpassantY = board.enpassantY;
+  record->halfmoveClock = board.halfmoveClock;
+  record->fullmoveNumber = board.fullmoveNumber;
+  int numPrevious = MIN(MIN(board.historyLength, (int)board.halfmoveClock), MAX_RECORD_PREVIOUS);
+  record->numPrevious = (uint8_t)numPrevious;
+  for(int i = 0; i < numPrevious; ++i)
+    record->previous[i] = board.history[board.historyLength - numPrevious + i].hash;
+}
+
+void load_position_record(const PositionRecord &record, Board &board)
+{
+  board.out = OUT_OF_BOARD;
+  memcpy(board.board, record.board, sizeof(board.board));
+  board.currentPlayer = record.currentPlayer;
+  board.castlingPiecesAtHome[0] = record.castlingPiecesAtHome[0];
+  board.castlingPiecesAtHome[1] = record.castlingPiecesAtHome[1];
+  board.enpassantX = record.enpassantX;
+  board.enpassantY = record.enpassantY;
+  board.halfmoveClock = record.halfmoveClock;
+  board.fullmoveNumber = record.fullmoveNumber;
+  board.update_bitboards();
+  // Only the hash keys are needed to find repetitions, the moves can't be taken back anyway.
+  board.historyLength = record.numPrevious;
+  for(int i = 0; i < record.numPrevious; ++i)
+  {
+    memset(&board.history[i], 0, sizeof(UndoRecord));
+    board.history[i].hash = record.previous[i];
+  }
+}
+
+EngineChannel::EngineChannel():lastSearchId(0), cancelledId(0), quitting(false), numDroppedInfos(0), bestSoFar(0), currentSearchId(0)
+{
+}
+
+EngineChannel::~EngineChannel()
+{
+  quit();
+}
+
+bool EngineChannel::start(int hashMegabytes)
+{
+  quit();
+  if (!tt.resize(hashMegabytes)) return false;
+  searcher.tt = &tt;
+  searcher.report = report_iteration;
+  searcher.reportUserData = this;
+  quitting = false;
+#if ENGINE_THREADS
+  thread = std::thread(engine_main, this);
+#endif
+  return true;
+}
+
+void EngineChannel::quit()
+{
+  quitting = true;
+  cancel();
+#if ENGINE_THREADS
+  if (!thread.joinable()) return;
+  // Take the sleep lock so that the engine can't miss this wake up between checking for work and sleeping.
+  { std::lock_guard<std::mutex> lock(sleepMutex); }
+  wakeUp.notify_one();
+  thread.join();
+#endif
+}
+
+uint32_t EngineChannel::search(const Board &board, const SearchLimits &limits)
+{
+  EngineCommand command;
+  command.searchId = lastSearchId + 1;
+  save_position_record(board, &command.position);
+  command.limits = limits;
+  cancel();
+  if (!commands.push(command)) return 0;
+  ++lastSearchId;
+#if ENGINE_THREADS
+  { std::lock_guard<std::mutex> lock(sleepMutex); }
+  wakeUp.notify_one();
+#endif
+  return command.searchId;
+}
+
+void EngineChannel::cancel()
+{
+  // The engine clears the stop flag when it starts a search and only then checks cancelledId, so a cancel
+  // can't get lost however the two threads interleave.
+  cancelledId.store(lastSearchId);
+  searcher.stop = true;
+}
+
+bool EngineChannel::poll(EngineResult *result)
+{
+#if !ENGINE_THREADS
+  EngineCommand command;
+  if (results.empty() && commands.pop(&command)) run_command(command);
+#endif
+  return results.pop(result);
+}
+
+move_t EngineChannel::best_move(uint32_t searchId) const
+{
+  uint64_t best = bestSoFar.load();
+  return ((uint32_t)(best >> 16) == searchId) ? (move_t)best : NO_MOVE;
+}
+
+void EngineChannel::report_iteration(const SearchIteration &iteration, void *userData)
+{
+  EngineChannel &channel = *(EngineChannel *)userData;
+  channel.bestSoFar.store((uint64_t)channel.currentSearchId << 16 | iteration.pv[0]);
+  if (channel.currentSearchId <= channel.cancelledId.load(std::memory_order_relaxed)) return; // Nobody waits for it any more
+
+  // Keep the last slot free for the best move.
+  EngineResult result;
+  result.type = ENGINE_RESULT_INFO;
+  result.searchId = channel.currentSearchId;
+  result.bestMove = NO_MOVE;
+  result.iteration = iteration;
+  if (channel.results.size() >= channel.results.capacity() - 1 || !channel.results.push(result))
+    channel.numDroppedInfos.fetch_add(1, std::memory_order_relaxed);
+}
+
+void EngineChannel::run_command(const EngineCommand &command)
+{
+  currentSearchId = command.searchId;
+  load_position_record(command.position, position);
+  searcher.stop = false;
+  if (command.searchId <= cancelledId.load()) searcher.stop = true;
+  bestSoFar.store((uint64_t)command.searchId << 16 | NO_MOVE);
+
+  EngineResult result;
+  result.bestMove = searcher.think(position, command.limits);
+  bestSoFar.store((uint64_t)command.searchId << 16 | result.bestMove);
+  result.type = ENGINE_RESULT_BESTMOVE;
+  result.searchId = command.searchId;
+  result.iteration = searcher.result;
+  while(!results.push(result))
+  {
+    if (quitting.load()) return;
+    std::this_thread::yield(); // The owner hasn't polled in a while
+  }
+}
+
+#if ENGINE_THREADS
+void EngineChannel::engine_main(EngineChannel *channel)
+{
+  EngineCommand command;
+  while(!channel->quitting.load())
+  {
+    if (channel->commands.pop(&command))
+    {
+      channel->run_command(command);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(channel->sleepMutex);
+    if (!channel->quitting.load() && channel->commands.empty()) channel->wakeUp.wait(lock);
+  }
+}
+#endif
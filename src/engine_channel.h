@@ -0,0 +1,120 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "board.h"
+#include "search.h"
+#include "spsc_queue.h"
+#include "tt.h"
+
+// Engine threads are not available in browser builds made without pthreads. There the engine runs on the
+// calling thread, see EngineChannel::poll().
+#if !defined(__EMSCRIPTEN__) || defined(__EMSCRIPTEN_PTHREADS__)
+#define ENGINE_THREADS 1
+#else
+#define ENGINE_THREADS 0
+#endif
+
+// Positions before the current one that a repetition can come from: at most the last 100 plies, since the
+// last capture or pawn move.
+#define MAX_RECORD_PREVIOUS 100
+
+// A position in binary form, small enough to pass by value. Keeps the hash keys of the recent earlier positions
+// so that the engine still sees repetitions, but not the moves, so the engine side can't take back past it.
+struct PositionRecord
+{
+  piece_t board[8][8];
+  uint8_t currentPlayer;
+  uint8_t castlingPiecesAtHome[2];
+  int8_t enpassantX, enpassantY;
+  uint8_t halfmoveClock;
+  uint16_t fullmoveNumber;
+  uint8_t numPrevious;
+  uint64_t previous[MAX_RECORD_PREVIOUS]; // Oldest first
+};
+
+void save_position_record(const Board &board, PositionRecord *record);
+void load_position_record(const PositionRecord &record, Board &board);
+
+struct EngineCommand
+{
+  uint32_t searchId;
+  PositionRecord position;
+  SearchLimits limits;
+};
+
+#define ENGINE_RESULT_INFO 0 // An iteration of the search completed
+#define ENGINE_RESULT_BESTMOVE 1 // The search is over, always the last result of a search
+
+struct EngineResult
+{
+  int type;
+  uint32_t searchId; // Of the search the result belongs to
+  move_t bestMove; // ENGINE_RESULT_BESTMOVE only, NO_MOVE if there are no legal moves
+  SearchIteration iteration; // The completed iteration, or for the best move the last one
+};
+
+// Runs the built-in search on an engine thread of its own, and talks to it through two lock-free single
+// producer single consumer queues of binary records: commands from the owning thread, typically the UI thread,
+// and results back from the engine. All methods are called from the owning thread, and none of them blocks,
+// so they can be called every frame.
+struct EngineChannel
+{
+  EngineChannel();
+  ~EngineChannel();
+
+  // Sets up the transposition table and starts the engine thread. Returns false if the table can't be allocated.
+  bool start(int hashMegabytes);
+
+  // Cancels any search and joins the engine thread.
+  void quit();
+
+  // Queues a search of the position, cancelling the search in progress, and returns the id its results will
+  // carry. Results of the cancelled searches that are still in the queue can be told apart by their ids.
+  // Returns 0 if the command queue is full.
+  uint32_t search(const Board &board, const SearchLimits &limits);
+
+  // Stops the search in progress and the ones queued, as soon as possible. Each still reports its best move.
+  void cancel();
+
+  // Takes the next result if there is one. Without engine threads this first runs the next queued search to
+  // the end on the calling thread, so keep its limits small there.
+  bool poll(EngineResult *result);
+
+  // The best move the given search has found so far, without waiting for its results: the first move of its last
+  // completed iteration, or its best move once it is over. NO_MOVE if the engine hasn't completed an iteration of
+  // that search yet, or has moved on to a later one.
+  move_t best_move(uint32_t searchId) const;
+
+  // Info results dropped because the owner didn't poll fast enough. Best moves are never dropped.
+  uint64_t droppedInfos() const { return numDroppedInfos.load(std::memory_order_relaxed); }
+
+private:
+  SpscQueue<EngineCommand, 8> commands;
+  SpscQueue<EngineResult, 64> results;
+  Searcher searcher;
+  TranspositionTable tt;
+  uint32_t lastSearchId;
+  std::atomic<uint32_t> cancelledId; // Searches with ids up to this one are cancelled
+  std::atomic<bool> quitting;
+  std::atomic<uint64_t> numDroppedInfos;
+  std::atomic<uint64_t> bestSoFar; // Search id << 16 | move, see best_move()
+  Board position; // Engine side, of the search in progress
+  uint32_t currentSearchId;
+
+#if ENGINE_THREADS
+  std::thread thread;
+  std::mutex sleepMutex;
+  std::condition_variable wakeUp;
+  static void engine_main(EngineChannel *channel);
+#endif
+
+  void run_command(const EngineCommand &command);
+  static void report_iteration(const SearchIteration &iteration, void *userData);
+
+  EngineChannel(const EngineChannel &);
+  EngineChannel &operator=(const EngineChannel &);
+};
@@ -0,0 +1,203 @@
+#include "evaluate.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+const int pieceValues[7] = { 0, 0, 900, 500, 330, 320, 100 };
+
+// Piece-square bonuses from white's point of view, laid out as seen from white's side of the board:
+// the first row is rank 8. Indexed with SQUARE^56 for white pieces and SQUARE for black pieces.
+static const int8_t pawnTable[64] = {
+   0,  0,  0,  0,  0,  0,  0,  0,
+  50, 50, 50, 50, 50, 50, 50, 50,
+  10, 10, 20, 30, 30, 20, 10, 10,
+   5,  5, 10, 25, 25, 10,  5,  5,
+   0,  0,  0, 20, 20,  0,  0,  0,
+   5, -5,-10,  0,  0,-10, -5,  5,
+   5, 10, 10,-20,-20, 10, 10,  5,
+   0,  0,  0,  0,  0,  0,  0,  0 };
+
+static const int8_t knightTable[64] = {
+ -50,-40,-30,-30,-30,-30,-40,-50,
+ -40,-20,  0,  0,  0,  0,-20,-40,
+ -30,  0, 10, 15, 15, 10,  0,-30,
+ -30,  5, 15, 20, 20, 15,  5,-30,
+ -30,  0, 15, 20, 20, 15,  0,-30,
+ -30,  5, 10, 15, 15, 10,  5,-30,
+ -40,-20,  0,  5,  5,  0,-20,-40,
+ -50,-40,-30,-30,-30,-30,-40,-50 };
+
+static const int8_t bishopTable[64] = {
+ -20,-10,-10,-10,-10,-10,-10,-20,
+ -10,  0,  0,  0,  0,  0,  0,-10,
+ -10,  0,  5, 10, 10,  5,  0,-10,
+ -10,  5,  5, 10, 10,  5,  5,-10,
+ -10,  0, 10, 10, 10, 10,  0,-10,
+ -10, 10, 10, 10, 10, 10, 10,-10,
+ -10,  5,  0,  0,  0,  0,  5,-10,
+ -20,-10,-10,-10,-10,-10,-10,-20 };
+
+static const int8_t rookTable[64] = {
+   0,  0,  0,  0,  0,  0,  0,  0,
+   5, 10, 10, 10, 10, 10, 10,  5,
+  -5,  0,  0,  0,  0,  0,  0, -5,
+  -5,  0,  0,  0,  0,  0,  0, -5,
+  -5,  0,  0,  0,  0,  0,  0, -5,
+  -5,  0,  0,  0,  0,  0,  0, -5,
+  -5,  0,  0,  0,  0,  0,  0, -5,
+   0,  0,  0,  5,  5,  0,  0,  0 };
+
+static const int8_t queenTable[64] = {
+ -20,-10,-10, -5, -5,-10,-10,-20,
+ -10,  0,  0,  0,  0,  0,  0,-10,
+ -10,  0,  5,  5,  5,  5,  0,-10,
+  -5,  0,  5,  5,  5,  5,  0, -5,
+   0,  0,  5,  5,  5,  5,  0, -5,
+ -10,  5,  5,  5,  5,  5,  0,-10,
+ -10,  0,  5,  0,  0,  0,  0,-10,
+ -20,-10,-10, -5, -5,-10,-10,-20 };
+
+static const int8_t kingMiddlegameTable[64] = {
+ -30,-40,-40,-50,-50,-40,-40,-30,
+ -30,-40,-40,-50,-50,-40,-40,-30,
+ -30,-40,-40,-50,-50,-40,-40,-30,
+ -30,-40,-40,-50,-50,-40,-40,-30,
+ -20,-30,-30,-40,-40,-30,-30,-20,
+ -10,-20,-20,-20,-20,-20,-20,-10,
+  20, 20,  0,  0,  0,  0, 20, 20,
+  20, 30, 10,  0,  0, 10, 30, 20 };
+
+static const int8_t kingEndgameTable[64] = {
+ -50,-40,-30,-20,-20,-30,-40,-50,
+ -30,-20,-10,  0,  0,-10,-20,-30,
+ -30,-10, 20, 30, 30, 20,-10,-30,
+ -30,-10, 30, 40, 40, 30,-10,-30,
+ -30,-10, 30, 40, 40, 30,-10,-30,
+ -30,-10, 20, 30, 30, 20,-10,-30,
+ -30,-30,  0,  0,  0,  0,-30,-30,
+ -50,-30,-30,-30,-30,-30,-30,-50 };
+
+// Indexed by piece type and phase, only the king's tables differ between the phases.
+static const int8_t *defaultTables[7][2] = {
+  { 0, 0 }, { kingMiddlegameTable, kingEndgameTable }, { queenTable, queenTable }, { rookTable, rookTable },
+  { bishopTable, bishopTable }, { knightTable, knightTable }, { pawnTable, pawnTable }
+};
+
+const int phaseWeights[7] = { 0, 0, 4, 2, 1, 1, 0 };
+
+int16_t pieceSquareScores[2][2][7][64];
+
+// The tunable parameters pieceSquareScores is built from, in the layout of the file read by load_evaluation.
+struct EvaluationParameters
+{
+  int values[2][7]; // [phase][pieceType]
+  int tables[2][7][64]; // [phase][pieceType][square], rank 8 first as seen from white's side
+};
+
+static EvaluationParameters parameters;
+
+static void build_piece_square_scores()
+{
+  for(int phase = 0; phase < 2; ++phase)
+    for(int pieceType = KING; pieceType <= PAWN; ++pieceType)
+      for(int sq = 0; sq < 64; ++sq)
+      {
+        // Flipping the rank maps a square to its index in the table, as seen from the side of the piece's owner.
+        pieceSquareScores[phase][0][pieceType][sq] = (int16_t)(parameters.values[phase][pieceType] + parameters.tables[phase][pieceType][sq ^ 56]);
+        pieceSquareScores[phase][1][pieceType][sq] = (int16_t)-(parameters.values[phase][pieceType] + parameters.tables[phase][pieceType][sq]);
+      }
+}
+
+static struct EvaluationInitializer
+{
+  EvaluationInitializer()
+  {
+    for(int phase = 0; phase < 2; ++phase)
+      for(int pieceType = KING; pieceType <= PAWN; ++pieceType)
+      {
+        parameters.values[phase][pieceType] = pieceValues[pieceType];
+        for(int sq = 0; sq < 64; ++sq)
+          parameters.tables[phase][pieceType][sq] = defaultTables[pieceType][phase][sq];
+      }
+    build_piece_square_scores();
+  }
+} evaluationInitializer;
+
+int evaluate(const Board &board)
+{
+  int phase = (board.phase < MAX_PHASE) ? board.phase : MAX_PHASE; // Can be more after promotions
+  int score = (board.pieceSquareTotal[PHASE_MIDDLEGAME] * phase + board.pieceSquareTotal[PHASE_ENDGAME] * (MAX_PHASE - phase)) / MAX_PHASE;
+  return (board.currentPlayer == WHITE) ? score : -score;
+}
+
+static const char *pieceNames[7] = { 0, "king", "queen", "rook", "bishop", "knight", "pawn" };
+static const char *phaseNames[2] = { "middlegame", "endgame" };
+
+static int find_name(const char *name, const char **names, int first, int count)
+{
+  for(int i = first; i < count; ++i)
+    if (!strcmp(name, names[i])) return i;
+  return -1;
+}
+
+// Reads the next whitespace separated token into token, skipping comments. Returns false at the end of the file.
+static bool read_token(FILE *handle, char *token, int size)
+{
+  int c = fgetc(handle);
+  for(;;)
+  {
+    while(c != EOF && isspace(c)) c = fgetc(handle);
+    if (c != '#') break;
+    while(c != EOF && c != '\n') c = fgetc(handle);
+  }
+  int len = 0;
+  for(; c != EOF && !isspace(c) && c != '#'; c = fgetc(handle))
+    if (len < size - 1) token[len++] = (char)c;
+  if (c != EOF) ungetc(c, handle);
+  token[len] = 0;
+  return len > 0;
+}
+
+static bool read_int(FILE *handle, int *value)
+{
+  char token[32], *end;
+  if (!read_token(handle, token, sizeof(token))) return false;
+  long v = strtol(token, &end, 10);
+  if (*end || v < -10000 || v > 10000) return false;
+  *value = (int)v;
+  return true;
+}
+
+bool load_evaluation(const char *filename)
+{
+  FILE *handle = fopen(filename, "r");
+  if (!handle) return false;
+  EvaluationParameters loaded = parameters;
+  char token[32], phaseToken[32];
+  bool ok = true;
+  while(ok && read_token(handle, token, sizeof(token)))
+  {
+    int pieceType = find_name(token, pieceNames, KING, 7);
+    int phase = read_token(handle, phaseToken, sizeof(phaseToken)) ? find_name(phaseToken, phaseNames, 0, 2) : -1;
+    ok = pieceType >= 0 && phase >= 0 && read_int(handle, &loaded.values[phase][pieceType]);
+    for(int sq = 0; sq < 64 && ok; ++sq)
+      ok = read_int(handle, &loaded.tables[phase][pieceType][sq]);
+  }
+  fclose(handle);
+  if (!ok) return false;
+  parameters = loaded;
+  build_piece_square_scores();
+  return true;
+}
+
+void write_evaluation(FILE *handle)
+{
+  fprintf(handle, "# Piece values and piece-square tables in centipawns, see load_evaluation() in evaluate.h.\n");
+  for(int pieceType = KING; pieceType <= PAWN; ++pieceType)
+    for(int phase = 0; phase < 2; ++phase)
+    {
+      fprintf(handle, "\n%s %s %d\n", pieceNames[pieceType], phaseNames[phase], parameters.values[phase][pieceType]);
+      for(int sq = 0; sq < 64; ++sq)
+        fprintf(handle, "%4d%s", parameters.tables[phase][pieceType][sq], (sq & 7) == 7 ? "\n" : "");
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdio.h>
+#include "board.h"
+
+// Piece values in centipawns, indexed by piece type. Used for move ordering, the evaluation has its own below.
+extern const int pieceValues[7];
+
+#define PHASE_MIDDLEGAME 0
+#define PHASE_ENDGAME 1
+
+// Game phase weight of each piece type, MAX_PHASE with all pieces but the pawns and kings on board. The
+// evaluation blends from the middlegame score at MAX_PHASE to the endgame score at 0.
+extern const int phaseWeights[7];
+#define MAX_PHASE 24
+
+// Material plus piece-square score of each piece on each square, from white's point of view so black's are
+// negative: [PHASE_MIDDLEGAME or PHASE_ENDGAME][COLOR_INDEX(color)][pieceType][square]. Board sums these and
+// phaseWeights up as pieces are put on and taken off the board, so evaluate() never scans the board.
+extern int16_t pieceSquareScores[2][2][7][64];
+
+// Returns the static evaluation of the position in centipawns, from the point of view of the player to move.
+int evaluate(const Board &board);
+
+// Replaces the piece values and piece-square tables with the ones in the given text file, so that they can be
+// tuned without recompiling. The file holds blocks of "<piece> <phase> <value>" followed by the 64 bonuses of
+// the piece-square table, rank 8 first as seen from white's side, e.g. "pawn endgame 120 0 0 ...". Pieces are
+// king, queen, rook, bishop, knight and pawn, phases middlegame and endgame; blocks left out keep their current
+// values and # starts a comment. Returns false, changing nothing, if the file can't be read or parsed.
+// Boards set up before keep their old sums until Board::update_bitboards() is called.
+bool load_evaluation(const char *filename);
+
+// Writes the current values and tables in the format load_evaluation reads, as a starting point for tuning.
+void write_evaluation(FILE *handle);
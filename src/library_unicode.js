@@ -1,7 +1,7 @@
 mergeInto(LibraryManager.library, {
-  upload_unicode_char_to_texture__proxy: 'sync',
-  upload_unicode_char_to_texture__sig: 'iii',
-  upload_unicode_char_to_texture: function(unicodeChar, charSize, applyShadow) {
+  upload_unicode_char_to_atlas__proxy: 'sync',
+  upload_unicode_char_to_atlas__sig: 'viiiii',
+  upload_unicode_char_to_atlas: function(unicodeChar, charSize, applyShadow, x, y) {
     var canvas = document.createElement('canvas');
     canvas.width = canvas.height = charSize;
 //  document.body.appendChild(canvas); // Debugging
@@ -23,7 +23,8 @@ mergeInto(LibraryManager.library, {
     }
     ctx.fillText(String.fromCharCode(unicodeChar), 0, canvas.height-7);
     GLctx.pixelStorei(GLctx.UNPACK_FLIP_Y_WEBGL, true);
-    GLctx.texImage2D(GLctx.TEXTURE_2D, 0, GLctx.RGBA, GLctx.RGBA, GLctx.UNSIGNED_BYTE, canvas);
+    // Into the cell at x, y of the bound atlas texture.
+    GLctx.texSubImage2D(GLctx.TEXTURE_2D, 0, x, y, GLctx.RGBA, GLctx.UNSIGNED_BYTE, canvas);
     GLctx.pixelStorei(GLctx.UNPACK_FLIP_Y_WEBGL, false);
   }
 });
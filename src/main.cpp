@@ -9,6 +9,7 @@ int main()
 #endif
   init_gl();
   load_assets();
+  init_engine();
   new_game();
 
 #ifdef __EMSCRIPTEN__
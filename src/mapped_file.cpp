@@ -0,0 +1,53 @@
+#include "mapped_file.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile():data(0), size(0), mapping(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+  close();
+}
+
+bool MappedFile::open(const char *filename, bool sequential)
+{
+  close();
+  int fd = ::open(filename, O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+  {
+    ::close(fd);
+    return false;
+  }
+  if (st.st_size == 0) // mmap of zero bytes fails, but an empty file is fine
+  {
+    ::close(fd);
+    data = (const uint8_t *)"";
+    return true;
+  }
+  void *p = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd); // The mapping keeps the file open
+  if (p == MAP_FAILED) return false;
+#ifdef MADV_SEQUENTIAL
+  if (sequential) madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+#else
+  (void)sequential;
+#endif
+  mapping = p;
+  data = (const uint8_t *)p;
+  size = (size_t)st.st_size;
+  return true;
+}
+
+void MappedFile::close()
+{
+  if (mapping) munmap(mapping, size);
+  mapping = 0;
+  data = 0;
+  size = 0;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Read-only memory mapping of a whole file. Pages are only read from disk when first touched, so opening
+// even a very large file is instant and costs no memory up front.
+struct MappedFile
+{
+  MappedFile();
+  ~MappedFile();
+
+  // Maps the given file, unmapping any previous one. Returns false if the file can't be opened or mapped.
+  // sequential hints the OS to read ahead, for files that are scanned once from start to end.
+  bool open(const char *filename, bool sequential = false);
+  void close();
+
+  const uint8_t *data;
+  size_t size;
+
+private:
+  void *mapping;
+
+  MappedFile(const MappedFile &);
+  MappedFile &operator=(const MappedFile &);
+};
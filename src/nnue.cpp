@@ -0,0 +1,304 @@
+#include "nnue.h"
+#include "aligned_alloc.h"
+#include "mapped_file.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
+#define NNUE_VERSION 0x7AF32F16
+#define NNUE_INPUT_DIMENSIONS (2 * NNUE_HALF_DIMENSIONS)
+#define WEIGHT_SCALE_BITS 6 // Hidden layer outputs are shifted down by this before clipping
+#define OUTPUT_SCALE 16 // The output divided by this is in Stockfish's internal units,
+#define PAWN_VALUE 208 // where an endgame pawn is worth this much
+
+// Start of each piece type's 64 slots among a king square's 641, for pieces of the side whose view it is and
+// of the opponent. Indexed by [pieceType][own], kings are not features.
+static const int pieceSlots[7][2] = { { 0, 0 }, { 0, 0 }, { 577, 513 }, { 449, 385 }, { 321, 257 }, { 193, 129 }, { 65, 1 } };
+
+struct Network
+{
+  void *allocation;
+  int16_t *transformerBiases; // [NNUE_HALF_DIMENSIONS]
+  int16_t *transformerWeights; // [NNUE_FEATURES][NNUE_HALF_DIMENSIONS]
+  int32_t *hidden1Biases; // [NNUE_HIDDEN]
+  int8_t *hidden1Weights; // [NNUE_HIDDEN][NNUE_INPUT_DIMENSIONS]
+  int32_t *hidden2Biases; // [NNUE_HIDDEN]
+  int8_t *hidden2Weights; // [NNUE_HIDDEN][NNUE_HIDDEN]
+  int32_t outputBias;
+  int8_t *outputWeights; // [NNUE_HIDDEN]
+};
+
+static Network network;
+
+// Copies count little endian values of the given size from *p, and advances *p past them. The supported
+// targets are all little endian, so this is a plain copy.
+static void read_values(const uint8_t **p, void *values, size_t size, size_t count)
+{
+  memcpy(values, *p, size * count);
+  *p += size * count;
+}
+
+static uint32_t read_uint32(const uint8_t **p)
+{
+  uint32_t value;
+  read_values(p, &value, 4, 1);
+  return value;
+}
+
+bool nnue_load(const char *filename)
+{
+  MappedFile file;
+  if (!file.open(filename, true) || file.size < 12) return false;
+  const uint8_t *p = file.data;
+  if (read_uint32(&p) != NNUE_VERSION) return false;
+  read_uint32(&p); // Hash of the architecture, checked by the size below instead
+  uint32_t descriptionLength = read_uint32(&p);
+  size_t expectedSize = 12 + (size_t)descriptionLength
+    + 4 + NNUE_HALF_DIMENSIONS * 2 + (size_t)NNUE_FEATURES * NNUE_HALF_DIMENSIONS * 2
+    + 4 + NNUE_HIDDEN * 4 + NNUE_HIDDEN * NNUE_INPUT_DIMENSIONS
+    + NNUE_HIDDEN * 4 + NNUE_HIDDEN * NNUE_HIDDEN
+    + 4 + NNUE_HIDDEN;
+  if (descriptionLength > file.size || file.size != expectedSize) return false;
+  p += descriptionLength;
+
+  Network loaded;
+  size_t transformerBytes = (NNUE_HALF_DIMENSIONS + (size_t)NNUE_FEATURES * NNUE_HALF_DIMENSIONS) * 2;
+  size_t hiddenBytes = 2 * NNUE_HIDDEN * 4 + NNUE_HIDDEN * NNUE_INPUT_DIMENSIONS + NNUE_HIDDEN * NNUE_HIDDEN + NNUE_HIDDEN;
+  char *memory = aligned_alloc_32(transformerBytes + hiddenBytes, &loaded.allocation);
+  if (!memory) return false;
+  // The biases come first, so that the weight arrays after them stay 32 byte aligned.
+  loaded.transformerBiases = (int16_t *)memory;
+  loaded.transformerWeights = loaded.transformerBiases + NNUE_HALF_DIMENSIONS;
+  loaded.hidden1Biases = (int32_t *)(memory + transformerBytes);
+  loaded.hidden2Biases = loaded.hidden1Biases + NNUE_HIDDEN;
+  loaded.hidden1Weights = (int8_t *)(loaded.hidden2Biases + NNUE_HIDDEN);
+  loaded.hidden2Weights = loaded.hidden1Weights + NNUE_HIDDEN * NNUE_INPUT_DIMENSIONS;
+  loaded.outputWeights = loaded.hidden2Weights + NNUE_HIDDEN * NNUE_HIDDEN;
+
+  read_uint32(&p); // Hash of the feature transformer
+  read_values(&p, loaded.transformerBiases, 2, NNUE_HALF_DIMENSIONS);
+  read_values(&p, loaded.transformerWeights, 2, (size_t)NNUE_FEATURES * NNUE_HALF_DIMENSIONS);
+  read_uint32(&p); // Hash of the layers
+  read_values(&p, loaded.hidden1Biases, 4, NNUE_HIDDEN);
+  read_values(&p, loaded.hidden1Weights, 1, NNUE_HIDDEN * NNUE_INPUT_DIMENSIONS);
+  read_values(&p, loaded.hidden2Biases, 4, NNUE_HIDDEN);
+  read_values(&p, loaded.hidden2Weights, 1, NNUE_HIDDEN * NNUE_HIDDEN);
+  read_values(&p, &loaded.outputBias, 4, 1);
+  read_values(&p, loaded.outputWeights, 1, NNUE_HIDDEN);
+
+  free(network.allocation);
+  network = loaded;
+  return true;
+}
+
+bool nnue_is_loaded()
+{
+  return network.allocation != 0;
+}
+
+void NnueStack::clear()
+{
+  for(int i = 0; i < NNUE_STACK_SIZE; ++i)
+    entries[i].computed[0] = entries[i].computed[1] = false;
+}
+
+// Index of the feature of the piece on the square, seen from the given side with its king on kingSq. Black
+// sees the board rotated, so that both sides' features look the same from their own side.
+static inline int feature_index(int side, int kingSq, piece_t piece, int sq)
+{
+  int rotation = side ? 63 : 0;
+  return (sq ^ rotation) + pieceSlots[PIECE_TYPE(piece)][COLOR_INDEX(PLAYER_COLOR(piece)) == side] + 641 * (kingSq ^ rotation);
+}
+
+// Adds the first layer weights of the given feature to the accumulator, or subtracts them. Wraps around on
+// overflow like the vector instructions, which a trained network never relies on.
+static inline void add_feature(int16_t *accumulator, int feature)
+{
+  const int16_t *weights = network.transformerWeights + (size_t)feature * NNUE_HALF_DIMENSIONS;
+#if defined(__AVX2__)
+  for(int i = 0; i < NNUE_HALF_DIMENSIONS; i += 16)
+    _mm256_store_si256((__m256i *)(accumulator + i), _mm256_add_epi16(_mm256_load_si256((const __m256i *)(accumulator + i)), _mm256_load_si256((const __m256i *)(weights + i))));
+#elif defined(__SSE4_1__)
+  for(int i = 0; i < NNUE_HALF_DIMENSIONS; i += 8)
+    _mm_store_si128((__m128i *)(accumulator + i), _mm_add_epi16(_mm_load_si128((const __m128i *)(accumulator + i)), _mm_load_si128((const __m128i *)(weights + i))));
+#else
+  for(int i = 0; i < NNUE_HALF_DIMENSIONS; ++i)
+    accumulator[i] = (int16_t)(uint16_t)((uint16_t)accumulator[i] + (uint16_t)weights[i]);
+#endif
+}
+
+static inline void remove_feature(int16_t *accumulator, int feature)
+{
+  const int16_t *weights = network.transformerWeights + (size_t)feature * NNUE_HALF_DIMENSIONS;
+#if defined(__AVX2__)
+  for(int i = 0; i < NNUE_HALF_DIMENSIONS; i += 16)
+    _mm256_store_si256((__m256i *)(accumulator + i), _mm256_sub_epi16(_mm256_load_si256((const __m256i *)(accumulator + i)), _mm256_load_si256((const __m256i *)(weights + i))));
+#elif defined(__SSE4_1__)
+  for(int i = 0; i < NNUE_HALF_DIMENSIONS; i += 8)
+    _mm_store_si128((__m128i *)(accumulator + i), _mm_sub_epi16(_mm_load_si128((const __m128i *)(accumulator + i)), _mm_load_si128((const __m128i *)(weights + i))));
+#else
+  for(int i = 0; i < NNUE_HALF_DIMENSIONS; ++i)
+    accumulator[i] = (int16_t)(uint16_t)((uint16_t)accumulator[i] - (uint16_t)weights[i]);
+#endif
+}
+
+// Computes the side's accumulator from the pieces on board.
+static void refresh_accumulator(const Board &board, int side, int16_t *accumulator)
+{
+  memcpy(accumulator, network.transformerBiases, NNUE_HALF_DIMENSIONS * sizeof(int16_t));
+  bitboard_t kings = board.pieces[0][KING] | board.pieces[1][KING];
+  int kingSq = board.pieces[side][KING] ? lsb(board.pieces[side][KING]) : 0;
+  for(bitboard_t b = board.occupied & ~kings; b; )
+  {
+    int sq = pop_lsb(&b);
+    add_feature(accumulator, feature_index(side, kingSq, board.board[SQUARE_Y(sq)][SQUARE_X(sq)], sq));
+  }
+}
+
+// Applies the piece changes of the given move, as seen from the given side, whose king did not move.
+static void apply_move(const UndoRecord &undo, int side, int kingSq, int16_t *accumulator)
+{
+  move_t move = undo.move;
+  if (move == NO_MOVE) return; // Null move
+  int src = MOVE_SRC(move), dst = MOVE_DST(move), color = PLAYER_COLOR(undo.moved);
+  if (PIECE_TYPE(undo.moved) != KING)
+  {
+    remove_feature(accumulator, feature_index(side, kingSq, undo.moved, src));
+    add_feature(accumulator, feature_index(side, kingSq, (MOVE_TYPE(move) == MOVE_PROMOTION) ? (piece_t)(color | MOVE_PROMOTION_PIECE(move)) : undo.moved, dst));
+  }
+  if (undo.captured)
+    remove_feature(accumulator, feature_index(side, kingSq, undo.captured, (MOVE_TYPE(move) == MOVE_EN_PASSANT) ? SQUARE(SQUARE_X(dst), SQUARE_Y(src)) : dst));
+  if (MOVE_TYPE(move) == MOVE_CASTLING)
+  {
+    int y = SQUARE_Y(src), rookSrc = SQUARE((dst < src) ? 0 : 7, y), rookDst = SQUARE((SQUARE_X(src) + SQUARE_X(dst)) / 2, y);
+    remove_feature(accumulator, feature_index(side, kingSq, (piece_t)(color | ROOK), rookSrc));
+    add_feature(accumulator, feature_index(side, kingSq, (piece_t)(color | ROOK), rookDst));
+  }
+}
+
+// Brings the side's half of the current position's accumulator up to date: from the nearest earlier position of
+// the line whose accumulator is computed, if the side's king hasn't moved since, otherwise from scratch.
+static void update_accumulator(const Board &board, NnueStack &stack, NnueAccumulator &accumulator, int side)
+{
+  int16_t *values = accumulator.values[side];
+  int kingSq = board.pieces[side][KING] ? lsb(board.pieces[side][KING]) : 0;
+  piece_t king = (piece_t)((side ? BLACK : WHITE) | KING);
+  int n = board.historyLength, k = n;
+  const NnueAccumulator *ancestor = 0;
+  while(k > 0 && n - k < NNUE_MAX_UPDATE_PLIES && board.history[k-1].moved != king)
+  {
+    --k;
+    const NnueAccumulator &entry = stack.entries[k % NNUE_STACK_SIZE];
+    if (entry.computed[side] && entry.key == board.history[k].hash)
+    {
+      ancestor = &entry;
+      break;
+    }
+  }
+
+  if (ancestor)
+  {
+    memcpy(values, ancestor->values[side], sizeof(accumulator.values[side]));
+    for(int i = k; i < n; ++i)
+      apply_move(board.history[i], side, kingSq, values);
+  }
+  else refresh_accumulator(board, side, values);
+  accumulator.computed[side] = true;
+}
+
+// Clamps the two accumulators to [0, 127] into the uint8 input of the hidden layers, the side to move first.
+static void transform(const NnueAccumulator &accumulator, int sideToMove, uint8_t *output)
+{
+  for(int half = 0; half < 2; ++half)
+  {
+    const int16_t *in = accumulator.values[half ? sideToMove ^ 1 : sideToMove];
+    uint8_t *out = output + half * NNUE_HALF_DIMENSIONS;
+#if defined(__AVX2__)
+    for(int i = 0; i < NNUE_HALF_DIMENSIONS; i += 32)
+    {
+      __m256i packed = _mm256_packs_epi16(_mm256_load_si256((const __m256i *)(in + i)), _mm256_load_si256((const __m256i *)(in + i + 16)));
+      // packs works within 128 bit lanes, the permute puts the four 64 bit quarters back in order.
+      _mm256_store_si256((__m256i *)(out + i), _mm256_permute4x64_epi64(_mm256_max_epi8(packed, _mm256_setzero_si256()), 0xD8));
+    }
+#elif defined(__SSE4_1__)
+    for(int i = 0; i < NNUE_HALF_DIMENSIONS; i += 16)
+    {
+      __m128i packed = _mm_packs_epi16(_mm_load_si128((const __m128i *)(in + i)), _mm_load_si128((const __m128i *)(in + i + 8)));
+      _mm_store_si128((__m128i *)(out + i), _mm_max_epi8(packed, _mm_setzero_si128()));
+    }
+#else
+    for(int i = 0; i < NNUE_HALF_DIMENSIONS; ++i)
+      out[i] = (uint8_t)(in[i] < 0 ? 0 : in[i] > 127 ? 127 : in[i]);
+#endif
+  }
+}
+
+// Returns the dot product of count uint8 inputs and int8 weights, count a multiple of 32.
+static inline int32_t dot_product(const uint8_t *input, const int8_t *weights, int count)
+{
+#if defined(__AVX2__)
+  __m256i sum = _mm256_setzero_si256(), ones = _mm256_set1_epi16(1);
+  for(int i = 0; i < count; i += 32)
+  {
+    // Pairs of uint8 * int8 products are added into int16, which can't overflow with inputs at most 127.
+    __m256i products = _mm256_maddubs_epi16(_mm256_load_si256((const __m256i *)(input + i)), _mm256_load_si256((const __m256i *)(weights + i)));
+    sum = _mm256_add_epi32(sum, _mm256_madd_epi16(products, ones));
+  }
+  __m128i sum128 = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+  sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, 0x4E));
+  sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, 0xB1));
+  return _mm_cvtsi128_si32(sum128);
+#elif defined(__SSE4_1__)
+  __m128i sum = _mm_setzero_si128(), ones = _mm_set1_epi16(1);
+  for(int i = 0; i < count; i += 16)
+  {
+    __m128i products = _mm_maddubs_epi16(_mm_load_si128((const __m128i *)(input + i)), _mm_load_si128((const __m128i *)(weights + i)));
+    sum = _mm_add_epi32(sum, _mm_madd_epi16(products, ones));
+  }
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+  return _mm_cvtsi128_si32(sum);
+#else
+  int32_t sum = 0;
+  for(int i = 0; i < count; ++i)
+    sum += input[i] * weights[i];
+  return sum;
+#endif
+}
+
+// A fully connected layer of NNUE_HIDDEN outputs followed by the clipped ReLU, from uint8 to uint8.
+static void hidden_layer(const uint8_t *input, int inputCount, const int32_t *biases, const int8_t *weights, uint8_t *output)
+{
+  for(int i = 0; i < NNUE_HIDDEN; ++i)
+  {
+    int32_t sum = (biases[i] + dot_product(input, weights + i * inputCount, inputCount)) >> WEIGHT_SCALE_BITS;
+    output[i] = (uint8_t)(sum < 0 ? 0 : sum > 127 ? 127 : sum);
+  }
+}
+
+int nnue_evaluate(const Board &board, NnueStack &stack)
+{
+  NnueAccumulator &accumulator = stack.entries[board.historyLength % NNUE_STACK_SIZE];
+  if (accumulator.key != board.hash)
+  {
+    accumulator.key = board.hash;
+    accumulator.computed[0] = accumulator.computed[1] = false;
+  }
+  for(int side = 0; side < 2; ++side)
+    if (!accumulator.computed[side])
+      update_accumulator(board, stack, accumulator, side);
+
+  alignas(32) uint8_t input[NNUE_INPUT_DIMENSIONS];
+  alignas(32) uint8_t hidden1[NNUE_HIDDEN];
+  alignas(32) uint8_t hidden2[NNUE_HIDDEN];
+  transform(accumulator, COLOR_INDEX(board.currentPlayer), input);
+  hidden_layer(input, NNUE_INPUT_DIMENSIONS, network.hidden1Biases, network.hidden1Weights, hidden1);
+  hidden_layer(hidden1, NNUE_HIDDEN, network.hidden2Biases, network.hidden2Weights, hidden2);
+  int32_t output = network.outputBias + dot_product(hidden2, network.outputWeights, NNUE_HIDDEN);
+  return output / OUTPUT_SCALE * 100 / PAWN_VALUE;
+}
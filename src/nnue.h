@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include "board.h"
+
+// Efficiently updatable neural network evaluation, in the HalfKP 256x2-32-32 architecture of the first NNUE
+// networks of Stockfish 12, whose .nnue files it loads. The input features are, for each side, the square of its
+// king combined with the square and type of each other piece but the kings: 41024 features, of which about 30
+// are active. They feed a 256 wide first layer, the accumulator, that only changes by a few weight columns when
+// a piece moves, so each position keeps one and updates it from its parent's with the moves in between. The
+// accumulators of both sides, the side to move first, then go through two 32 wide layers and the output.
+//
+// The accumulators are int16 and the later layers int8 weights on uint8 activations, computed with AVX2 or
+// SSE4.1 if the build enables them, see USE_AVX2 and USE_SSE41 in CMakeLists.txt, otherwise with portable code.
+// All give the same results.
+
+#define NNUE_HALF_DIMENSIONS 256
+#define NNUE_FEATURES (64 * 641) // King square times 641 piece-square slots, slot 0 unused
+#define NNUE_HIDDEN 32
+
+// Most moves an accumulator is updated over from an ancestor's before it is cheaper to recompute it from scratch.
+#define NNUE_MAX_UPDATE_PLIES 12
+
+// Positions of the current line whose accumulators are kept, more than the deepest search needs.
+#define NNUE_STACK_SIZE 128
+
+// Loads a HalfKP 256x2-32-32 network, replacing any loaded before. Returns false if the file can't be read or
+// is not of that architecture, in which case the previous network, if any, stays loaded. Not thread safe with
+// nnue_evaluate() running; load the network before searching.
+bool nnue_load(const char *filename);
+
+bool nnue_is_loaded();
+
+// The first layer output of one position, for both sides: values[COLOR_INDEX(color)] is from that side's view.
+struct NnueAccumulator
+{
+  alignas(32) int16_t values[2][NNUE_HALF_DIMENSIONS];
+  uint64_t key; // Board::hash of the position
+  bool computed[2];
+};
+
+// Accumulators of the positions of a line of play, indexed by Board::historyLength. A position's accumulator is
+// found from its hash, so a stack can be kept from search to search, but each searching thread needs its own.
+struct NnueStack
+{
+  NnueStack() { clear(); }
+  void clear();
+
+  NnueAccumulator entries[NNUE_STACK_SIZE];
+};
+
+// Returns the network's evaluation of the position in centipawns, from the point of view of the player to move.
+// A network must be loaded. The accumulators are brought up to date from the move history of the board.
+int nnue_evaluate(const Board &board, NnueStack &stack);
@@ -0,0 +1,305 @@
+#include "packed.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CODE_CASTLING_ROOK 12 // + side
+#define CODE_ENPASSANT_PAWN 14
+#define CODE_BLACK_KING_TO_MOVE 15
+
+#define PIECE_CODE(side, pieceType) ((side) * 6 + (pieceType) - KING)
+
+// The state that goes in a packed position, gathered from a Board or a PositionBatch alike.
+struct PositionFields
+{
+  bitboard_t pieces[2][7]; // As in Board::pieces, [NO_UNIT] has all the pieces of that side
+  int sideToMove; // COLOR_INDEX of the player to move
+  uint8_t castlingPiecesAtHome[2];
+  int enpassantSquare; // Square a pawn can capture to en passant, or -1
+  int halfmoveClock;
+  int fullmoveNumber;
+};
+
+static bool pack_fields(const PositionFields &f, PackedPosition *packed)
+{
+  bitboard_t occupied = f.pieces[0][NO_UNIT] | f.pieces[1][NO_UNIT];
+  if (popcount(occupied) > 32) return false;
+
+  uint8_t codes[64];
+  for(int side = 0; side < 2; ++side)
+    for(int pieceType = KING; pieceType <= PAWN; ++pieceType)
+      for(bitboard_t b = f.pieces[side][pieceType]; b; )
+        codes[pop_lsb(&b)] = (uint8_t)PIECE_CODE(side, pieceType);
+
+  for(int side = 0; side < 2; ++side)
+  {
+    int rank = side ? 7 : 0;
+    if (!(f.pieces[side][KING] & SQUARE_BIT(SQUARE(4, rank)))) continue;
+    if ((f.castlingPiecesAtHome[side] & KINGSIDE_CASTLING_MASK) == KINGSIDE_CASTLING_MASK && (f.pieces[side][ROOK] & SQUARE_BIT(SQUARE(7, rank))))
+      codes[SQUARE(7, rank)] = (uint8_t)(CODE_CASTLING_ROOK + side);
+    if ((f.castlingPiecesAtHome[side] & QUEENSIDE_CASTLING_MASK) == QUEENSIDE_CASTLING_MASK && (f.pieces[side][ROOK] & SQUARE_BIT(SQUARE(0, rank))))
+      codes[SQUARE(0, rank)] = (uint8_t)(CODE_CASTLING_ROOK + side);
+  }
+
+  // The pawn that made the double step is one square past the en passant square, seen from the side that moved it.
+  // As in Board::castling_and_enpassant_hash, it only counts if a pawn of the player to move can capture it, so
+  // that transpositions pack the same.
+  if (f.enpassantSquare >= 0)
+  {
+    int side = (SQUARE_Y(f.enpassantSquare) == 2) ? 0 : 1;
+    int pawnSq = f.enpassantSquare + (side ? -8 : 8);
+    if ((SQUARE_Y(f.enpassantSquare) == 2 || SQUARE_Y(f.enpassantSquare) == 5) && side != f.sideToMove && (f.pieces[side][PAWN] & SQUARE_BIT(pawnSq))
+      && (pawnAttacks[side][f.enpassantSquare] & f.pieces[f.sideToMove][PAWN]))
+      codes[pawnSq] = CODE_ENPASSANT_PAWN;
+  }
+
+  if (f.sideToMove)
+  {
+    if (!f.pieces[1][KING]) return false;
+    codes[lsb(f.pieces[1][KING])] = CODE_BLACK_KING_TO_MOVE;
+  }
+
+  memset(packed, 0, sizeof(*packed));
+  for(int i = 0; i < 8; ++i)
+    packed->occupied[i] = (uint8_t)(occupied >> (56 - 8*i));
+  int n = 0;
+  for(bitboard_t b = occupied; b; ++n)
+    packed->pieces[n >> 1] |= codes[pop_lsb(&b)] << ((n & 1) ? 0 : 4);
+  packed->halfmoveClock = (uint8_t)f.halfmoveClock;
+  packed->fullmoveNumber[0] = (uint8_t)(f.fullmoveNumber >> 8);
+  packed->fullmoveNumber[1] = (uint8_t)f.fullmoveNumber;
+  return true;
+}
+
+static bool unpack_fields(const PackedPosition &packed, PositionFields *f)
+{
+  bitboard_t occupied = 0;
+  for(int i = 0; i < 8; ++i)
+    occupied = (occupied << 8) | packed.occupied[i];
+  if (popcount(occupied) > 32 || packed.zero) return false;
+
+  memset(f->pieces, 0, sizeof(f->pieces));
+  f->sideToMove = 0;
+  f->castlingPiecesAtHome[0] = f->castlingPiecesAtHome[1] = 0;
+  f->enpassantSquare = -1;
+  int n = 0;
+  for(bitboard_t b = occupied; b; ++n)
+  {
+    int sq = pop_lsb(&b), x = SQUARE_X(sq), y = SQUARE_Y(sq);
+    int code = (packed.pieces[n >> 1] >> ((n & 1) ? 0 : 4)) & 15;
+    int side, pieceType;
+    if (code < CODE_CASTLING_ROOK)
+    {
+      side = code / 6;
+      pieceType = code % 6 + KING;
+    }
+    else if (code < CODE_ENPASSANT_PAWN)
+    {
+      side = code - CODE_CASTLING_ROOK;
+      pieceType = ROOK;
+      if (y != (side ? 7 : 0) || (x != 0 && x != 7)) return false;
+      f->castlingPiecesAtHome[side] |= KING_AT_HOME | (x ? KING_ROOK_AT_HOME : QUEEN_ROOK_AT_HOME);
+    }
+    else if (code == CODE_ENPASSANT_PAWN)
+    {
+      if ((y != 3 && y != 4) || f->enpassantSquare >= 0) return false;
+      side = (y == 3) ? 0 : 1;
+      pieceType = PAWN;
+      f->enpassantSquare = sq + (side ? 8 : -8);
+    }
+    else
+    {
+      if (f->sideToMove) return false;
+      side = 1;
+      pieceType = KING;
+      f->sideToMove = 1;
+    }
+    f->pieces[side][pieceType] |= SQUARE_BIT(sq);
+    f->pieces[side][NO_UNIT] |= SQUARE_BIT(sq);
+  }
+
+  // Castling rooks need their king at home, and the en passant pawn must have been moved by the side not to move
+  // and be capturable.
+  for(int side = 0; side < 2; ++side)
+    if (f->castlingPiecesAtHome[side] && !(f->pieces[side][KING] & SQUARE_BIT(SQUARE(4, side ? 7 : 0)))) return false;
+  if (f->enpassantSquare >= 0 && ((SQUARE_Y(f->enpassantSquare) == 2) != (f->sideToMove == 1)
+    || !(pawnAttacks[1 - f->sideToMove][f->enpassantSquare] & f->pieces[f->sideToMove][PAWN]))) return false;
+
+  f->halfmoveClock = packed.halfmoveClock;
+  f->fullmoveNumber = (packed.fullmoveNumber[0] << 8) | packed.fullmoveNumber[1];
+  if (f->fullmoveNumber == 0) f->fullmoveNumber = 1;
+  return true;
+}
+
+bool pack_position(const Board &board, PackedPosition *packed)
+{
+  PositionFields f;
+  memcpy(f.pieces, board.pieces, sizeof(f.pieces));
+  f.sideToMove = COLOR_INDEX(board.currentPlayer);
+  f.castlingPiecesAtHome[0] = board.castlingPiecesAtHome[0];
+  f.castlingPiecesAtHome[1] = board.castlingPiecesAtHome[1];
+  f.enpassantSquare = (board.enpassantX >= 0) ? SQUARE(board.enpassantX, board.enpassantY) : -1;
+  f.halfmoveClock = board.halfmoveClock;
+  f.fullmoveNumber = board.fullmoveNumber;
+  return pack_fields(f, packed);
+}
+
+bool unpack_position(const PackedPosition &packed, Board &board)
+{
+  PositionFields f;
+  if (!unpack_fields(packed, &f)) return false;
+  board.out = OUT_OF_BOARD;
+  memset(board.board, 0, sizeof(board.board));
+  for(int side = 0; side < 2; ++side)
+    for(int pieceType = KING; pieceType <= PAWN; ++pieceType)
+      for(bitboard_t b = f.pieces[side][pieceType]; b; )
+      {
+        int sq = pop_lsb(&b);
+        board.board[SQUARE_Y(sq)][SQUARE_X(sq)] = (side ? BLACK : WHITE) | pieceType;
+      }
+  board.currentPlayer = f.sideToMove ? BLACK : WHITE;
+  board.castlingPiecesAtHome[0] = f.castlingPiecesAtHome[0];
+  board.castlingPiecesAtHome[1] = f.castlingPiecesAtHome[1];
+  board.enpassantX = (f.enpassantSquare >= 0) ? SQUARE_X(f.enpassantSquare) : -1;
+  board.enpassantY = (f.enpassantSquare >= 0) ? SQUARE_Y(f.enpassantSquare) : -1;
+  board.halfmoveClock = (uint8_t)f.halfmoveClock;
+  board.fullmoveNumber = (uint16_t)f.fullmoveNumber;
+  board.historyLength = 0;
+  board.update_bitboards();
+  return true;
+}
+
+bool pack_positions(const PositionBatch &batch, PackedPosition *packed)
+{
+  PositionFields f;
+  for(int i = 0; i < batch.size; ++i)
+  {
+    for(int side = 0; side < 2; ++side)
+      for(int pieceType = 0; pieceType < 7; ++pieceType)
+        f.pieces[side][pieceType] = batch.pieces[side][pieceType][i];
+    f.sideToMove = batch.sideToMove[i];
+    f.castlingPiecesAtHome[0] = batch.castlingPiecesAtHome[0][i];
+    f.castlingPiecesAtHome[1] = batch.castlingPiecesAtHome[1][i];
+    f.enpassantSquare = batch.enpassantSquare[i];
+    f.halfmoveClock = batch.halfmoveClock[i];
+    f.fullmoveNumber = 1;
+    if (!pack_fields(f, &packed[i])) return false;
+  }
+  return true;
+}
+
+bool unpack_positions(const PackedPosition *packed, size_t count, PositionBatch &batch)
+{
+  if (count > (size_t)(0x7FFFFFFF - batch.size) || !batch.reserve(batch.size + (int)count)) return false;
+  PositionFields f;
+  for(size_t j = 0; j < count; ++j)
+  {
+    if (!unpack_fields(packed[j], &f)) return false;
+    int i = batch.size++;
+    for(int side = 0; side < 2; ++side)
+      for(int pieceType = 0; pieceType < 7; ++pieceType)
+        batch.pieces[side][pieceType][i] = f.pieces[side][pieceType];
+    batch.sideToMove[i] = (uint8_t)f.sideToMove;
+    batch.castlingPiecesAtHome[0][i] = f.castlingPiecesAtHome[0];
+    batch.castlingPiecesAtHome[1][i] = f.castlingPiecesAtHome[1];
+    batch.enpassantSquare[i] = (int8_t)f.enpassantSquare;
+    batch.halfmoveClock[i] = (uint8_t)f.halfmoveClock;
+  }
+  return true;
+}
+
+static int compare_positions(const void *a, const void *b)
+{
+  return memcmp(a, b, sizeof(PackedPosition));
+}
+
+size_t sort_packed_positions(PackedPosition *positions, size_t count)
+{
+  if (count == 0) return 0;
+  qsort(positions, count, sizeof(PackedPosition), compare_positions);
+  size_t n = 1;
+  for(size_t i = 1; i < count; ++i)
+    if (memcmp(&positions[i], &positions[n-1], PACKED_POSITION_KEY_SIZE))
+      positions[n++] = positions[i];
+  return n;
+}
+
+bool write_packed_positions(const char *filename, const PackedPosition *positions, size_t count)
+{
+  FILE *handle = fopen(filename, "wb");
+  if (!handle) return false;
+  bool ok = fwrite(positions, sizeof(PackedPosition), count, handle) == count;
+  return (fclose(handle) == 0) && ok;
+}
+
+bool merge_position_files(const char *output, const char *const *inputs, int numInputs)
+{
+  MappedFile *files = new MappedFile[(unsigned)numInputs];
+  size_t *next = new size_t[(unsigned)numInputs](); // Index of the next position to merge in each file
+  bool ok = true;
+  for(int i = 0; i < numInputs && ok; ++i)
+    ok = files[i].open(inputs[i], true) && files[i].size % sizeof(PackedPosition) == 0;
+
+  FILE *handle = ok ? fopen(output, "wb") : 0;
+  if (handle)
+  {
+    // Few files are merged at a time, so a linear scan for the smallest head is as fast as a heap.
+    PackedPosition last;
+    bool haveLast = false;
+    for(;;)
+    {
+      const PackedPosition *smallest = 0;
+      int smallestFile = -1;
+      for(int i = 0; i < numInputs; ++i)
+      {
+        if (next[i] >= files[i].size / sizeof(PackedPosition)) continue;
+        const PackedPosition *p = (const PackedPosition *)files[i].data + next[i];
+        if (!smallest || memcmp(p, smallest, sizeof(PackedPosition)) < 0) smallest = p, smallestFile = i;
+      }
+      if (!smallest) break;
+      ++next[smallestFile];
+      if (haveLast && !memcmp(smallest, &last, PACKED_POSITION_KEY_SIZE)) continue;
+      last = *smallest;
+      haveLast = true;
+      if (fwrite(smallest, sizeof(PackedPosition), 1, handle) != 1)
+      {
+        ok = false;
+        break;
+      }
+    }
+    ok = (fclose(handle) == 0) && ok;
+  }
+  else ok = false;
+
+  delete[] next;
+  delete[] files;
+  return ok;
+}
+
+bool PositionFile::open(const char *filename)
+{
+  if (!mapped.open(filename)) return false;
+  if (mapped.size % sizeof(PackedPosition) == 0) return true;
+  mapped.close();
+  return false;
+}
+
+int64_t PositionFile::find(const PackedPosition &position) const
+{
+  size_t lo = 0, hi = size();
+  while(lo < hi)
+  {
+    size_t mid = lo + (hi - lo) / 2;
+    int c = memcmp(&(*this)[mid], &position, PACKED_POSITION_KEY_SIZE);
+    if (c == 0) return (int64_t)mid;
+    if (c < 0) lo = mid + 1;
+    else hi = mid;
+  }
+  return -1;
+}
+
+int64_t PositionFile::find(const Board &board) const
+{
+  PackedPosition packed;
+  return pack_position(board, &packed) ? find(packed) : -1;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "batch.h"
+#include "board.h"
+#include "mapped_file.h"
+
+// A position packed in 28 bytes, for datasets and caches of many positions. The first PACKED_POSITION_KEY_SIZE
+// bytes are the position itself: the occupied squares, then a 4 bit code for each occupied square in square
+// order, a1 first. Codes 0-11 are the white king, queen, rook, bishop, knight and pawn, then the same for black.
+// The rest of the state is folded into four more codes:
+//   12, 13  White or black rook that can still castle, so the king is on its home square too
+//   14      Pawn that just moved two squares and that a pawn of the player to move can capture en passant, white on
+//           rank 4 or black on rank 5
+//   15      Black king, with black to move
+// The move counters follow. Multibyte fields are big endian, so that memcmp() orders positions by occupancy
+// first, and copies of the same position by their move counters.
+#define PACKED_POSITION_KEY_SIZE 24
+
+struct PackedPosition
+{
+  uint8_t occupied[8];
+  uint8_t pieces[16]; // The code of the nth occupied square is in the high nibble of pieces[n/2] for even n
+  uint8_t halfmoveClock;
+  uint8_t fullmoveNumber[2];
+  uint8_t zero; // Always 0, keeps arrays of positions 4 byte aligned
+};
+
+// Packs the position of the board. Castling rights whose king or rook is not on its home square can't be used
+// and are dropped, as is an en passant square that no pawn of the player to move attacks, so that each position
+// has a single packed form and unpacking gives back the same hash and legal moves. The move history is not
+// stored. Returns false if the position has more than 32 pieces, or black is to move without a black king,
+// which a 28 byte position can't hold.
+bool pack_position(const Board &board, PackedPosition *packed);
+
+// Sets up the board to the packed position, with an empty move history. Returns false if the packed data is
+// not a position written by pack_position, in which case the board is left in an unspecified state.
+bool unpack_position(const PackedPosition &packed, Board &board);
+
+// Bulk versions of the above for whole batches. pack_positions writes batch.size positions to packed, with full
+// move number 1 as the batch doesn't store it, and returns false if any position can't be packed.
+// unpack_positions appends the given positions to the batch; it returns false if one is invalid or the batch
+// can't grow, leaving the positions before it appended.
+bool pack_positions(const PositionBatch &batch, PackedPosition *packed);
+bool unpack_positions(const PackedPosition *packed, size_t count, PositionBatch &batch);
+
+// Sorts the positions and removes the copies of the same position, keeping the one with the lowest move
+// counters. Returns the number of positions left, which are at the start of the array.
+size_t sort_packed_positions(PackedPosition *positions, size_t count);
+
+// Writes the positions as a position file, a headerless array of sorted and deduplicated positions. They must
+// already be sorted and deduplicated with sort_packed_positions. Returns false if the file can't be written.
+bool write_packed_positions(const char *filename, const PackedPosition *positions, size_t count);
+
+// Merges the given position files into one, dropping the positions found in more than one of them. The files
+// are read sequentially, so any number of positions that don't fit in memory can be sorted by writing them
+// out in sorted chunks and merging those. Returns false if a file can't be read or written.
+bool merge_position_files(const char *output, const char *const *inputs, int numInputs);
+
+// Read-only position file. The file is memory mapped and binary searched in place, as OpeningBook does with
+// Polyglot books, so opening is instant and only the pages touched by lookups are read.
+struct PositionFile
+{
+  // Opens the given file, closing any previous one. Returns false if it can't be mapped or is not a whole
+  // number of positions.
+  bool open(const char *filename);
+  void close() { mapped.close(); }
+
+  size_t size() const { return mapped.size / sizeof(PackedPosition); }
+  const PackedPosition &operator[](size_t i) const { return ((const PackedPosition *)mapped.data)[i]; }
+
+  // Returns the index of the given position, compared by PACKED_POSITION_KEY_SIZE only, or -1 if it is not in the file.
+  int64_t find(const PackedPosition &position) const;
+  int64_t find(const Board &board) const;
+
+private:
+  MappedFile mapped;
+};
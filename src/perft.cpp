@@ -0,0 +1,20 @@
+#include "perft.h"
+
+uint64_t perft(Board &board, int depth, TranspositionTable *tt)
+{
+  uint64_t nodes = 0;
+  if (tt && depth >= 2 && tt->probe_perft(board.hash, depth, &nodes)) return nodes;
+
+  MoveList list;
+  board.generate_all_moves(list);
+  if (depth <= 1) return (depth == 1) ? list.size : 1;
+
+  for(int i = 0; i < list.size; ++i)
+  {
+    board.make_move(list.moves[i]);
+    nodes += perft(board, depth - 1, tt);
+    board.unmake_move();
+  }
+  if (tt) tt->store_perft(board.hash, depth, nodes);
+  return nodes;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+#include "board.h"
+#include "tt.h"
+
+// Counts the leaf nodes of the legal move tree of the given depth. Subtree counts are cached in the
+// given transposition table if not null. The board is returned to the position it was in.
+uint64_t perft(Board &board, int depth, TranspositionTable *tt = 0);
@@ -0,0 +1,239 @@
+#include "pgn.h"
+#include <string.h>
+
+#define IS_SPACE(c) ((c) == ' ' || (c) == '\t' || (c) == '\n' || (c) == '\r')
+
+// Characters that end a move token.
+#define IS_TOKEN_END(c) (IS_SPACE(c) || (c) == '{' || (c) == '}' || (c) == '(' || (c) == ')' || (c) == ';' || (c) == '[' || (c) == '$')
+
+const char *PgnGame::tag(const char *name) const
+{
+  for(int i = 0; i < numTags; ++i)
+    if (!strcmp(tags[i].name, name)) return tags[i].value;
+  return 0;
+}
+
+// The game being parsed. Tags and moves are collected here and only copied to the arena once the whole game is read.
+struct PgnParser
+{
+  Arena *arena;
+  PgnGame *first, *last;
+  int *numErrors;
+
+  bool inGame, failed;
+  PgnTag tags[MAX_PGN_TAGS];
+  int numTags;
+  const char *moves[MAX_PGN_PLIES];
+  int numMoves;
+
+  void begin_game()
+  {
+    inGame = true;
+    failed = false;
+    numTags = numMoves = 0;
+  }
+
+  void end_game(const char *result)
+  {
+    if (!inGame) return;
+    inGame = false;
+    if (failed)
+    {
+      ++*numErrors;
+      return;
+    }
+    PgnGame *game = arena->alloc_array<PgnGame>(1);
+    if (game)
+    {
+      game->tags = arena->alloc_array<PgnTag>(numTags);
+      game->moves = arena->alloc_array<const char *>(numMoves);
+    }
+    if (!game || (numTags && !game->tags) || (numMoves && !game->moves))
+    {
+      ++*numErrors;
+      return;
+    }
+    memcpy(game->tags, tags, numTags * sizeof(PgnTag));
+    memcpy(game->moves, moves, numMoves * sizeof(const char *));
+    game->numTags = numTags;
+    game->numMoves = numMoves;
+    game->result = result;
+    game->next = 0;
+    if (last) last->next = game;
+    else first = game;
+    last = game;
+  }
+};
+
+// Returns the result token if the len chars at p are one, otherwise null.
+static const char *match_result(const char *p, size_t len)
+{
+  static const char *results[] = { "1-0", "0-1", "1/2-1/2", "*" };
+  for(int i = 0; i < 4; ++i)
+    if (strlen(results[i]) == len && !memcmp(p, results[i], len)) return results[i];
+  return 0;
+}
+
+// Parses a tag pair [Name "Value"] starting at p, and returns a pointer past it.
+static const char *parse_tag(PgnParser &parser, const char *p, const char *end)
+{
+  ++p; // [
+  while(p < end && IS_SPACE(*p)) ++p;
+  const char *name = p;
+  while(p < end && !IS_SPACE(*p) && *p != '"' && *p != ']') ++p;
+  size_t nameLength = p - name;
+  while(p < end && IS_SPACE(*p)) ++p;
+  if (p >= end || *p != '"')
+  {
+    parser.failed = true;
+    while(p < end && *p != ']' && *p != '\n') ++p;
+    return (p < end && *p == ']') ? p + 1 : p;
+  }
+
+  // The value may contain \" and \\ escapes, so copy it char by char into a scratch buffer.
+  char value[256];
+  size_t valueLength = 0;
+  for(++p; p < end && *p != '"' && *p != '\n'; ++p)
+  {
+    if (*p == '\\' && p + 1 < end) ++p;
+    if (valueLength < sizeof(value) - 1) value[valueLength++] = *p;
+  }
+  if (p < end && *p == '"') ++p;
+  while(p < end && *p != ']' && *p != '\n') ++p;
+  if (p < end && *p == ']') ++p;
+
+  if (parser.numTags < MAX_PGN_TAGS)
+  {
+    PgnTag &tag = parser.tags[parser.numTags];
+    tag.name = parser.arena->copy_string(name, nameLength);
+    tag.value = parser.arena->copy_string(value, valueLength);
+    if (tag.name && tag.value) ++parser.numTags;
+    else parser.failed = true;
+  }
+  return p;
+}
+
+PgnGame *parse_pgn(const char *text, size_t length, Arena &arena, int *numErrors)
+{
+  PgnParser parser;
+  parser.arena = &arena;
+  parser.first = parser.last = 0;
+  parser.numErrors = numErrors;
+  parser.inGame = false;
+
+  const char *p = text, *end = text + length;
+  bool inMovetext = false; // Tags after moves start the next game
+  while(p < end)
+  {
+    char c = *p;
+    if (IS_SPACE(c)) ++p;
+    else if (c == '[')
+    {
+      if (inMovetext) parser.end_game("*"); // Game without a result token
+      if (!parser.inGame) parser.begin_game();
+      inMovetext = false;
+      p = parse_tag(parser, p, end);
+    }
+    else if (c == '{') // Comment
+    {
+      const char *close = (const char *)memchr(p, '}', end - p);
+      p = close ? close + 1 : end;
+    }
+    else if (c == ';' || (c == '%' && (p == text || p[-1] == '\n'))) // Rest of line comment, escape line
+    {
+      const char *eol = (const char *)memchr(p, '\n', end - p);
+      p = eol ? eol + 1 : end;
+    }
+    else if (c == '(') // Variation, possibly with nested variations and comments
+    {
+      int depth = 0;
+      for(; p < end; ++p)
+      {
+        if (*p == '{')
+        {
+          const char *close = (const char *)memchr(p, '}', end - p);
+          if (!close) { p = end; break; }
+          p = close;
+        }
+        else if (*p == '(') ++depth;
+        else if (*p == ')' && --depth == 0) { ++p; break; }
+      }
+    }
+    else if (c == '$') // Numeric annotation glyph
+      for(++p; p < end && *p >= '0' && *p <= '9'; ++p) {}
+    else if (c == ')' || c == '}' || c == ']') ++p; // Stray closing bracket
+    else
+    {
+      const char *token = p;
+      while(p < end && !IS_TOKEN_END(*p)) ++p;
+      size_t len = p - token;
+
+      const char *result = match_result(token, len);
+      if (result)
+      {
+        parser.end_game(result);
+        inMovetext = false;
+        continue;
+      }
+
+      // Skip a move number "12." or "12..." that may be glued to the move, "12.e4".
+      const char *move = token;
+      if (*move >= '1' && *move <= '9')
+      {
+        const char *q = move;
+        while(q < p && *q >= '0' && *q <= '9') ++q;
+        if (q < p && *q == '.')
+        {
+          while(q < p && *q == '.') ++q;
+          move = q;
+        }
+      }
+      if (move == p) continue; // Only a move number
+
+      if (!parser.inGame) parser.begin_game();
+      inMovetext = true;
+      if (parser.numMoves == MAX_PGN_PLIES) parser.failed = true;
+      else if (!parser.failed && !(parser.moves[parser.numMoves++] = arena.copy_string(move, p - move))) parser.failed = true;
+    }
+  }
+  if (parser.inGame && (inMovetext || parser.numTags)) parser.end_game("*"); // Game cut off at the end of the text
+  return parser.first;
+}
+
+const char *find_pgn_game_start(const char *p, const char *end)
+{
+  bool previousLineIsTag = true; // Unknown for the line p is in, so don't start there
+  while(p < end)
+  {
+    const char *eol = (const char *)memchr(p, '\n', end - p);
+    const char *next = eol ? eol + 1 : end;
+    const char *q = p;
+    while(q < next && (*q == ' ' || *q == '\t' || *q == '\r')) ++q;
+    if (q < next && *q != '\n') // Blank lines don't tell anything
+    {
+      if (*q == '[' && !previousLineIsTag) return p;
+      previousLineIsTag = (*q == '[');
+    }
+    p = next;
+  }
+  return end;
+}
+
+bool replay_pgn_game(const PgnGame &game, Board &board, PgnMoveFunc func, void *userData)
+{
+  const char *fen = game.tag("FEN");
+  if (fen)
+  {
+    if (!board.load_fen(fen)) return false;
+  }
+  else board.new_game();
+
+  for(int i = 0; i < game.numMoves; ++i)
+  {
+    move_t move = board.parse_san_move(game.moves[i]);
+    if (!move) return false;
+    board.make_move(move);
+    if (func) func(board, move, userData);
+  }
+  return true;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h>
+#include "arena.h"
+#include "board.h"
+
+// Games with more plies than this are skipped as errors by parse_pgn.
+#define MAX_PGN_PLIES 1024
+
+// Tags beyond this many in one game are ignored.
+#define MAX_PGN_TAGS 32
+
+struct PgnTag
+{
+  const char *name;
+  const char *value;
+};
+
+// One game of a PGN file, with all strings and arrays allocated from the Arena given to parse_pgn.
+struct PgnGame
+{
+  PgnTag *tags;
+  int numTags;
+  const char **moves; // Main line moves in standard algebraic notation, as written in the file
+  int numMoves;
+  const char *result; // "1-0", "0-1", "1/2-1/2" or "*"
+  PgnGame *next;
+
+  // Returns the value of the given tag, or null if the game has no such tag.
+  const char *tag(const char *name) const;
+};
+
+// Parses the games of the given text, that doesn't need to be zero terminated, into records allocated from
+// the arena. Returns the games as a list in file order. Comments, variations and annotations are skipped.
+// Games that can't be parsed or are too long are skipped and counted in *numErrors.
+PgnGame *parse_pgn(const char *text, size_t length, Arena &arena, int *numErrors);
+
+// Returns the start of the first game at or after p: the first tag line that follows a line that isn't a tag,
+// or end if there is none. Used to split a file into chunks that can be parsed independently.
+const char *find_pgn_game_start(const char *p, const char *end);
+
+// Called by replay_pgn_game after each move, with the board in the position after the move.
+typedef void (*PgnMoveFunc)(const Board &board, move_t move, void *userData);
+
+// Sets up the board at the start of the game, the position of its FEN tag if it has one, and makes its moves.
+// Returns false if the FEN tag is invalid or a move is not legal, leaving the board at the position before it.
+bool replay_pgn_game(const PgnGame &game, Board &board, PgnMoveFunc func, void *userData);
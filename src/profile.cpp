@@ -0,0 +1,112 @@
+#include "profile.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *profilePointNames[NUM_PROFILE_POINTS] = {
+  "generate_legal_moves", "generate_pawn_moves", "generate_knight_moves", "generate_bishop_moves", "generate_rook_moves",
+  "generate_queen_moves", "generate_king_moves", "compute_check_info", "controlled_squares", "mark_controlled_squares",
+  "is_king_in_check", "generate_moves", "make_move", "unmake_move"
+};
+
+#if ENABLE_PROFILE
+
+#include <mutex>
+
+static std::mutex &threads_mutex()
+{
+  static std::mutex mutex; // Constructed on first use, threads may start before this file's statics
+  return mutex;
+}
+static ProfileCounters *threads; // Counters of the running threads
+static uint64_t exitedCalls[NUM_PROFILE_POINTS], exitedTicks[NUM_PROFILE_POINTS]; // Totals of the threads that exited
+static int numThreads;
+
+thread_local ProfileCounters profileCounters;
+
+ProfileCounters::ProfileCounters()
+{
+  for(int i = 0; i < NUM_PROFILE_POINTS; ++i) calls[i] = ticks[i] = 0;
+  std::lock_guard<std::mutex> lock(threads_mutex());
+  next = threads;
+  threads = this;
+  ++numThreads;
+}
+
+ProfileCounters::~ProfileCounters()
+{
+  std::lock_guard<std::mutex> lock(threads_mutex());
+  for(ProfileCounters **c = &threads; *c; c = &(*c)->next)
+    if (*c == this)
+    {
+      *c = next;
+      break;
+    }
+  for(int i = 0; i < NUM_PROFILE_POINTS; ++i)
+  {
+    exitedCalls[i] += calls[i].load(std::memory_order_relaxed);
+    exitedTicks[i] += ticks[i].load(std::memory_order_relaxed);
+  }
+}
+
+void profile_dump_json(FILE *handle)
+{
+  std::lock_guard<std::mutex> lock(threads_mutex());
+  fprintf(handle, "{\n  \"enabled\": true,\n  \"unit\": \"%s\",\n  \"threads\": %d,\n  \"points\": {\n", PROFILE_TICKS_UNIT, numThreads);
+  for(int i = 0; i < NUM_PROFILE_POINTS; ++i)
+  {
+    uint64_t calls = exitedCalls[i], ticks = exitedTicks[i];
+    for(ProfileCounters *c = threads; c; c = c->next)
+    {
+      calls += c->calls[i].load(std::memory_order_relaxed);
+      ticks += c->ticks[i].load(std::memory_order_relaxed);
+    }
+    fprintf(handle, "    \"%s\": { \"calls\": %llu, \"ticks\": %llu, \"ticks_per_call\": %.1f }%s\n", profilePointNames[i],
+      (unsigned long long)calls, (unsigned long long)ticks, calls ? (double)ticks / calls : 0.0, i + 1 < NUM_PROFILE_POINTS ? "," : "");
+  }
+  fprintf(handle, "  }\n}\n");
+  fflush(handle);
+}
+
+void profile_reset()
+{
+  std::lock_guard<std::mutex> lock(threads_mutex());
+  memset(exitedCalls, 0, sizeof(exitedCalls));
+  memset(exitedTicks, 0, sizeof(exitedTicks));
+  for(ProfileCounters *c = threads; c; c = c->next)
+    for(int i = 0; i < NUM_PROFILE_POINTS; ++i)
+    {
+      c->calls[i].store(0, std::memory_order_relaxed);
+      c->ticks[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+// If the environment variable TINY_CHESS_PROFILE names a file, or "-" for stdout, the totals are written there at exit.
+static void dump_at_exit()
+{
+  const char *filename = getenv("TINY_CHESS_PROFILE");
+  if (!filename || !*filename) return;
+  if (!strcmp(filename, "-")) profile_dump_json(stdout);
+  else if (FILE *handle = fopen(filename, "w"))
+  {
+    profile_dump_json(handle);
+    fclose(handle);
+  }
+  else fprintf(stderr, "Unable to write the profile to %s\n", filename);
+}
+
+// The mutex is made first, so that it is destroyed only after dump_at_exit() has run.
+static struct ProfileInitializer { ProfileInitializer() { threads_mutex(); atexit(dump_at_exit); } } profileInitializer;
+
+#else
+
+void profile_dump_json(FILE *handle)
+{
+  (void)profilePointNames;
+  fprintf(handle, "{\n  \"enabled\": false\n}\n");
+}
+
+void profile_reset()
+{
+}
+
+#endif
@@ -0,0 +1,225 @@
+#include "renderer.h"
+#include <stddef.h>
+#include <string.h>
+
+const float boardScale = 1.f / 8.f; // TODO: Make this scale dynamically to resize to full screen size
+
+static GLuint compile_shader(GLenum shaderType, const char *src)
+{
+   GLuint shader = glCreateShader(shaderType);
+   glShaderSource(shader, 1, &src, NULL);
+   glCompileShader(shader);
+   return shader;
+}
+
+Renderer::Renderer():program(0), vertexBuffer(0), indexBuffer(0), atlas(0), numQuads(0), numOpaqueQuads(0)
+{
+}
+
+bool Renderer::init()
+{
+  // Vertices come in clip space, and the texture coordinates in atlas space, so there are no per quad uniforms.
+  static const char vertex_shader[] =
+    "attribute vec2 pos;"
+    "attribute vec2 texCoord;"
+    "attribute vec4 vertexColor;"
+    "varying vec2 uv;"
+    "varying vec4 color;"
+    "void main(){"
+      "uv=texCoord;"
+      "color=vertexColor;"
+      "gl_Position=vec4(pos,0.0,1.0);"
+    "}";
+  static const char fragment_shader[] =
+    "precision lowp float;"
+    "uniform sampler2D tex;"
+    "varying vec2 uv;"
+    "varying vec4 color;"
+    "void main(){"
+      "gl_FragColor=color*texture2D(tex,uv);"
+    "}";
+  program = glCreateProgram();
+  glAttachShader(program, compile_shader(GL_VERTEX_SHADER, vertex_shader));
+  glAttachShader(program, compile_shader(GL_FRAGMENT_SHADER, fragment_shader));
+  glBindAttribLocation(program, 0, "pos");
+  glBindAttribLocation(program, 1, "texCoord");
+  glBindAttribLocation(program, 2, "vertexColor");
+  glLinkProgram(program);
+  GLint linked = 0;
+  glGetProgramiv(program, GL_LINK_STATUS, &linked);
+  if (!linked) return false;
+  glUseProgram(program);
+
+  // Every quad is two triangles of its four vertices, so the indices never change.
+  uint16_t indices[MAX_QUADS * 6];
+  for(int i = 0; i < MAX_QUADS; ++i)
+  {
+    const uint16_t quadIndices[6] = { 0, 1, 2, 2, 1, 3 };
+    for(int j = 0; j < 6; ++j) indices[i*6 + j] = (uint16_t)(i*4 + quadIndices[j]);
+  }
+  glGenBuffers(1, &indexBuffer);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+  glGenBuffers(1, &vertexBuffer);
+  glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), 0, GL_DYNAMIC_DRAW);
+
+  glGenTextures(1, &atlas);
+  glBindTexture(GL_TEXTURE_2D, atlas);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, ATLAS_SIZE, ATLAS_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+
+  // The solid color cell is white all over, quads using it sample its middle.
+  static uint32_t white[ATLAS_CELL_SIZE * ATLAS_CELL_SIZE];
+  memset(white, 0xFF, sizeof(white));
+  int x, y;
+  atlas_cell_origin(SOLID_COLOR_TEXTURE, &x, &y);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, ATLAS_CELL_SIZE, ATLAS_CELL_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, white);
+
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  return true;
+}
+
+void Renderer::atlas_cell_origin(int cell, int *x, int *y)
+{
+  *x = (cell % ATLAS_CELLS_PER_ROW) * ATLAS_CELL_SIZE;
+  *y = (cell / ATLAS_CELLS_PER_ROW) * ATLAS_CELL_SIZE;
+}
+
+void Renderer::upload_placeholder_glyphs()
+{
+  // A disc per piece, smaller the lesser the piece, with a dark rim on the white pieces like the shadow of
+  // the real glyphs. Only the cost of drawing matters where these are used, not the looks.
+  static uint8_t pixels[GLYPH_SIZE * GLYPH_SIZE * 4];
+  glBindTexture(GL_TEXTURE_2D, atlas);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for(int cell = WHITE_KING_TEXTURE; cell < NUM_TEXTURES; ++cell)
+  {
+    int type = IS_TEXTURE_FOR_WHITE_PIECE(cell) ? cell : cell - WHITE_PAWN_TEXTURE;
+    float radius = GLYPH_SIZE * (0.46f - 0.03f * type);
+    float rim = IS_TEXTURE_FOR_WHITE_PIECE(cell) ? 3.f : 0.f;
+    for(int y = 0; y < GLYPH_SIZE; ++y)
+      for(int x = 0; x < GLYPH_SIZE; ++x)
+      {
+        float dx = x + 0.5f - GLYPH_SIZE * 0.5f, dy = y + 0.5f - GLYPH_SIZE * 0.5f;
+        float d2 = dx*dx + dy*dy;
+        uint8_t *p = pixels + (y * GLYPH_SIZE + x) * 4;
+        uint8_t shade = d2 < (radius - rim) * (radius - rim) ? 255 : 96;
+        p[0] = p[1] = p[2] = shade;
+        p[3] = d2 < radius * radius ? 255 : 0;
+      }
+    int x, y;
+    atlas_cell_origin(cell, &x, &y);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, GLYPH_SIZE, GLYPH_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+  }
+}
+
+static uint8_t to_unorm8(float f)
+{
+  return (uint8_t)(f <= 0.f ? 0 : f >= 1.f ? 255 : f * 255.f + 0.5f);
+}
+
+void Renderer::add_quad(float x, float y, float w, float h, float r, float g, float b, float a, int cell)
+{
+  if (numQuads >= MAX_QUADS) return;
+  int cellX, cellY;
+  atlas_cell_origin(cell, &cellX, &cellY);
+  float u0, v0, u1, v1;
+  if (cell == SOLID_COLOR_TEXTURE)
+  {
+    u0 = u1 = (cellX + ATLAS_CELL_SIZE * 0.5f) / ATLAS_SIZE;
+    v0 = v1 = (cellY + ATLAS_CELL_SIZE * 0.5f) / ATLAS_SIZE;
+  }
+  else
+  {
+    u0 = (float)cellX / ATLAS_SIZE, u1 = (float)(cellX + GLYPH_SIZE) / ATLAS_SIZE;
+    v0 = (float)cellY / ATLAS_SIZE, v1 = (float)(cellY + GLYPH_SIZE) / ATLAS_SIZE;
+  }
+  const float x0 = x*2.f - 1.f, y0 = y*2.f - 1.f, x1 = x0 + w*2.f, y1 = y0 + h*2.f;
+  const float corners[4][4] = { { x0, y0, u0, v0 }, { x1, y0, u1, v0 }, { x0, y1, u0, v1 }, { x1, y1, u1, v1 } };
+  const uint8_t color[4] = { to_unorm8(r), to_unorm8(g), to_unorm8(b), to_unorm8(a) };
+  Vertex *v = vertices + numQuads * 4;
+  for(int i = 0; i < 4; ++i)
+  {
+    v[i].x = corners[i][0];
+    v[i].y = corners[i][1];
+    v[i].u = corners[i][2];
+    v[i].v = corners[i][3];
+    memcpy(v[i].color, color, sizeof(color));
+  }
+  ++numQuads;
+}
+
+void Renderer::add_square(int x, int y, float r, float g, float b, float a)
+{
+  add_quad(x * boardScale, y * boardScale, boardScale, boardScale, r, g, b, a, SOLID_COLOR_TEXTURE);
+}
+
+void Renderer::add_piece(int x, int y, piece_t piece)
+{
+  int cell = (IS_WHITE_PIECE(piece) ? SOLID_COLOR_TEXTURE : WHITE_PAWN_TEXTURE) + PIECE_TYPE(piece);
+  const float verticalOffset = -1.f / 480.f;
+  float c = IS_WHITE_PIECE(piece) ? 1.f : 0.f;
+  add_quad(x * boardScale, y * boardScale + verticalOffset, boardScale, boardScale, c, c, c, 1.f, cell);
+}
+
+void Renderer::add_background(bitboard_t squares)
+{
+  bool opaqueSoFar = numOpaqueQuads == numQuads;
+  for(; squares; squares &= squares - 1)
+  {
+    int x = SQUARE_X(lsb(squares)), y = SQUARE_Y(lsb(squares));
+    if ((x + y) % 2 == 0) add_square(x, y, 0.463f, 0.589f, 0.337f, 1.f); // Black background
+    else add_square(x, y, 0.933f, 0.933f, 0.834f, 1.f); // White background
+  }
+  if (opaqueSoFar) numOpaqueQuads = numQuads;
+}
+
+void Renderer::add_pieces(const Board &board, bitboard_t squares)
+{
+  for(squares &= board.occupied; squares; squares &= squares - 1)
+  {
+    int x = SQUARE_X(lsb(squares)), y = SQUARE_Y(lsb(squares));
+    add_piece(x, y, board.board[y][x]);
+  }
+}
+
+int Renderer::flush()
+{
+  if (!numQuads) return 0;
+  // All state is set again every frame: besides being cheap, this works around the -s OFFSCREEN_FRAMEBUFFER=1
+  // bug that loses the buffer bindings between frames.
+  glUseProgram(program);
+  glBindTexture(GL_TEXTURE_2D, atlas);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+  glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, numQuads * 4 * sizeof(Vertex), vertices);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void *)offsetof(Vertex, x));
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void *)offsetof(Vertex, u));
+  glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (const void *)offsetof(Vertex, color));
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
+  glEnableVertexAttribArray(2);
+  // Blending is the costliest part of filling with a software rasterizer, so the opaque quads that start the
+  // frame get a draw call of their own without it.
+  int numCalls = 0;
+  if (numOpaqueQuads)
+  {
+    glDisable(GL_BLEND);
+    glDrawElements(GL_TRIANGLES, numOpaqueQuads * 6, GL_UNSIGNED_SHORT, 0);
+    ++numCalls;
+  }
+  if (numQuads > numOpaqueQuads)
+  {
+    glEnable(GL_BLEND);
+    glDrawElements(GL_TRIANGLES, (numQuads - numOpaqueQuads) * 6, GL_UNSIGNED_SHORT, (const void *)(numOpaqueQuads * 6 * sizeof(uint16_t)));
+    ++numCalls;
+  }
+  numQuads = numOpaqueQuads = 0;
+  return numCalls;
+}
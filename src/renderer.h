@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include <GLES2/gl2.h>
+#include "board.h"
+
+// All textures live in one atlas of square cells, one per texture index of board.h: the solid color cell
+// SOLID_COLOR_TEXTURE and the twelve piece glyphs. Glyphs are GLYPH_SIZE pixels, the rest of each cell is
+// padding so that filtering never samples the neighbouring cell.
+#define ATLAS_CELL_SIZE 64
+#define ATLAS_CELLS_PER_ROW 4
+#define ATLAS_SIZE (ATLAS_CELL_SIZE * ATLAS_CELLS_PER_ROW)
+#define GLYPH_SIZE 60
+
+// Most quads of one frame: 64 squares, 32 pieces, the highlights and plenty to spare.
+#define MAX_QUADS 256
+
+// Draws the board as batches of textured, colored quads. Quads are collected into a vertex array on the CPU,
+// with their positions already in clip space, and go to the GPU in one buffer upload and at most two draw calls.
+struct Renderer
+{
+  Renderer();
+
+  // Creates the shader, the buffers and the atlas texture, with the solid color cell filled in. The context
+  // must be current. Leaves the atlas bound, so that the glyphs can be uploaded into it next.
+  bool init();
+
+  // Pixel position of the lower left corner of the given atlas cell.
+  static void atlas_cell_origin(int cell, int *x, int *y);
+
+  // Fills the glyph cells with simple generated shapes, for where no font rendering is available.
+  void upload_placeholder_glyphs();
+
+  // Starts a new frame.
+  void begin() { numQuads = numOpaqueQuads = 0; }
+
+  // Adds a quad covering the given part of the viewport, [0,1] on both axes, textured with an atlas cell.
+  void add_quad(float x, float y, float w, float h, float r, float g, float b, float a, int cell);
+
+  // Board squares and pieces, in board coordinates. The background and the pieces can be limited to a set of
+  // squares. The background is opaque, and if it is the first thing drawn it is drawn without blending.
+  void add_square(int x, int y, float r, float g, float b, float a);
+  void add_piece(int x, int y, piece_t piece);
+  void add_background(bitboard_t squares = ~0ULL);
+  void add_pieces(const Board &board, bitboard_t squares = ~0ULL);
+
+  // Draws the quads added since begin(), in two calls at most: the opaque quads at the start of the frame, and
+  // the rest. Returns the number of draw calls made.
+  int flush();
+
+  int num_quads() const { return numQuads; }
+
+private:
+  struct Vertex
+  {
+    float x, y, u, v;
+    uint8_t color[4];
+  };
+
+  GLuint program, vertexBuffer, indexBuffer, atlas;
+  Vertex vertices[MAX_QUADS * 4];
+  int numQuads;
+  int numOpaqueQuads; // The first ones of the frame, see flush()
+};
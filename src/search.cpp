@@ -0,0 +1,401 @@
+#include "search.h"
+#include "evaluate.h"
+#include "nnue.h"
+#include "tablebase.h"
+#include <math.h>
+#include <string.h>
+
+#define MIN(x, y) ((x) <= (y) ? (x) : (y))
+#define MAX(x, y) ((x) >= (y) ? (x) : (y))
+
+// Late move reductions, indexed by [depth][number of moves searched].
+static int reductions[MAX_PLY][MAX_MOVES];
+
+static struct ReductionsInitializer
+{
+  ReductionsInitializer()
+  {
+    for(int depth = 1; depth < MAX_PLY; ++depth)
+      for(int moveNumber = 1; moveNumber < MAX_MOVES; ++moveNumber)
+        reductions[depth][moveNumber] = (int)(0.75 + log((double)depth) * log((double)moveNumber) / 2.25);
+  }
+} reductionsInitializer;
+
+// Move ordering classes, from first to last searched.
+#define TT_MOVE_SCORE (1 << 30)
+#define CAPTURE_SCORE (1 << 28) // Plus MVV-LVA
+#define KILLER_SCORE (1 << 27)
+#define HISTORY_MAX (1 << 26)
+
+// Mate scores are stored relative to the node in the transposition table, and relative to the root in search.
+static int score_to_tt(int score, int ply) { return score >= SCORE_MATE_IN_MAX_PLY ? score + ply : score <= -SCORE_MATE_IN_MAX_PLY ? score - ply : score; }
+static int score_from_tt(int score, int ply) { return score >= SCORE_MATE_IN_MAX_PLY ? score - ply : score <= -SCORE_MATE_IN_MAX_PLY ? score + ply : score; }
+
+Searcher::Searcher():tt(0), report(0), reportUserData(0), stop(false), threadIndex(0), nnue(0)
+{
+  memset(&result, 0, sizeof(result));
+  memset(history, 0, sizeof(history));
+}
+
+Searcher::~Searcher()
+{
+  delete nnue;
+}
+
+int Searcher::evaluate_position()
+{
+  return nnue ? nnue_evaluate(board, *nnue) : evaluate(board);
+}
+
+int Searcher::elapsed_milliseconds() const
+{
+  return (int)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void budget_search_time(const SearchLimits &limits, int player, int *optimum, int *maximum)
+{
+  *optimum = *maximum = limits.movetime;
+  int timeLeft = limits.time[COLOR_INDEX(player)];
+  if (limits.movetime || timeLeft <= 0) return;
+
+  // Aim at an even share of the time left over the moves to go, guessing 30 more in sudden death, plus the
+  // increment that comes back after the move. An iteration takes a few times longer than the one before, so
+  // stop starting them halfway there, and abort one that runs far over, but never use more than half the clock
+  // unless this is the last move before the time control.
+  int usable = MAX(timeLeft - MOVE_OVERHEAD, 1);
+  int movesToGo = (limits.movestogo > 0) ? MIN(limits.movestogo, 30) : 30;
+  int target = MIN(usable / movesToGo + limits.increment[COLOR_INDEX(player)], usable);
+  *maximum = MAX(MIN(target * 3, (movesToGo == 1) ? usable : usable / 2), 1);
+  *optimum = MAX(MIN(target / 2, *maximum), 1);
+}
+
+// Called every 256 nodes, well under a millisecond of searching, as reading the clock costs tens of nanoseconds.
+// The search polls the stop flag at every other node too, which is a plain load.
+void Searcher::check_limits()
+{
+  if (stop.load(std::memory_order_relaxed)
+    || (limits.nodes && nodes >= limits.nodes)
+    || (maximumTime && elapsed_milliseconds() >= maximumTime))
+    aborted = true;
+}
+
+bool Searcher::is_draw() const
+{
+  if (board.halfmoveClock >= 100 || board.repetition_count() > 0) return true;
+
+  // Insufficient material: bare kings, or a single minor piece against a bare king.
+  const bitboard_t (*p)[7] = board.pieces;
+  if (p[0][PAWN] | p[1][PAWN] | p[0][ROOK] | p[1][ROOK] | p[0][QUEEN] | p[1][QUEEN]) return false;
+  return !more_than_one(p[0][KNIGHT] | p[1][KNIGHT] | p[0][BISHOP] | p[1][BISHOP]);
+}
+
+// Score of a tablebase result at the given ply. Mates too far away for the mate scores are scored just below them,
+// still preferring the shorter ones.
+static int tablebase_score(int wdl, int plies, int ply)
+{
+  if (wdl == TB_DRAW) return 0;
+  int score = (ply + plies < MAX_PLY) ? SCORE_MATE - ply - plies : SCORE_MATE_IN_MAX_PLY - 1 - plies;
+  return (wdl == TB_WIN) ? score : -score;
+}
+
+void Searcher::order_moves(const MoveList &list, int *scores, move_t ttMove, int ply)
+{
+  int side = COLOR_INDEX(board.currentPlayer);
+  for(int i = 0; i < list.size; ++i)
+  {
+    move_t move = list.moves[i];
+    piece_t victim = board.board[SQUARE_Y(MOVE_DST(move))][SQUARE_X(MOVE_DST(move))];
+    if (move == ttMove) scores[i] = TT_MOVE_SCORE;
+    else if (victim || MOVE_TYPE(move) == MOVE_EN_PASSANT || (MOVE_TYPE(move) == MOVE_PROMOTION && MOVE_PROMOTION_PIECE(move) == QUEEN))
+    {
+      // Most valuable victim first, least valuable attacker first among equal victims.
+      piece_t attacker = board.board[SQUARE_Y(MOVE_SRC(move))][SQUARE_X(MOVE_SRC(move))];
+      scores[i] = CAPTURE_SCORE + pieceValues[victim ? PIECE_TYPE(victim) : PAWN] * 8 + PIECE_TYPE(attacker);
+      if (MOVE_TYPE(move) == MOVE_PROMOTION) scores[i] += pieceValues[QUEEN] * 8;
+    }
+    else if (move == killers[ply][0]) scores[i] = KILLER_SCORE + 1;
+    else if (move == killers[ply][1]) scores[i] = KILLER_SCORE;
+    else scores[i] = history[side][MOVE_SRC(move)][MOVE_DST(move)];
+  }
+}
+
+// Moves the highest scoring remaining move to index i and returns it.
+static move_t pick_move(MoveList &list, int *scores, int i)
+{
+  int best = i;
+  for(int j = i + 1; j < list.size; ++j)
+    if (scores[j] > scores[best])
+      best = j;
+  move_t move = list.moves[best];
+  list.moves[best] = list.moves[i], list.moves[i] = move;
+  int score = scores[best];
+  scores[best] = scores[i], scores[i] = score;
+  return move;
+}
+
+int Searcher::quiesce(int alpha, int beta, int ply)
+{
+  pvLength[ply] = ply;
+  if ((++nodes & 255) == 0) check_limits();
+  else if (stop.load(std::memory_order_relaxed)) aborted = true;
+  if (aborted) return 0;
+  if (is_draw()) return 0;
+  if (ply >= MAX_PLY - 1) return evaluate_position();
+
+  bool inCheck = board.is_king_in_check(board.currentPlayer);
+  int bestScore = -SCORE_INFINITE;
+  if (!inCheck) // Standing pat is not an option when in check, all evasions need to be searched
+  {
+    bestScore = evaluate_position();
+    if (bestScore >= beta) return bestScore;
+    if (bestScore > alpha) alpha = bestScore;
+  }
+
+  MoveList list;
+  board.generate_all_moves(list);
+  if (inCheck && list.size == 0) return -SCORE_MATE + ply;
+
+  // Only captures and queen promotions, unless in check.
+  int numMoves = 0;
+  for(int i = 0; i < list.size; ++i)
+  {
+    move_t move = list.moves[i];
+    if (inCheck || board.board[SQUARE_Y(MOVE_DST(move))][SQUARE_X(MOVE_DST(move))] || MOVE_TYPE(move) == MOVE_EN_PASSANT
+      || (MOVE_TYPE(move) == MOVE_PROMOTION && MOVE_PROMOTION_PIECE(move) == QUEEN))
+      list.moves[numMoves++] = move;
+  }
+  list.size = numMoves;
+
+  int scores[MAX_MOVES];
+  order_moves(list, scores, NO_MOVE, ply);
+  for(int i = 0; i < list.size; ++i)
+  {
+    move_t move = pick_move(list, scores, i);
+    board.make_move(move);
+    int score = -quiesce(-beta, -alpha, ply + 1);
+    board.unmake_move();
+    if (aborted) return 0;
+
+    if (score > bestScore)
+    {
+      bestScore = score;
+      if (score > alpha)
+      {
+        alpha = score;
+        if (score >= beta) break;
+      }
+    }
+  }
+  return bestScore;
+}
+
+int Searcher::search(int alpha, int beta, int depth, int ply, bool allowNullMove)
+{
+  pvLength[ply] = ply;
+  bool pvNode = beta - alpha > 1;
+  if (ply > 0)
+  {
+    if (is_draw()) return 0;
+    // Mate distance pruning: no score here can beat a shorter mate found already.
+    alpha = MAX(alpha, -SCORE_MATE + ply);
+    beta = MIN(beta, SCORE_MATE - ply - 1);
+    if (alpha >= beta) return alpha;
+
+    // Positions in the loaded endgame tables have an exact score, no need to search them.
+    int wdl, plies;
+    if (tb_probe(board, &wdl, &plies)) return tablebase_score(wdl, plies, ply);
+  }
+
+  bool inCheck = board.is_king_in_check(board.currentPlayer);
+  if (inCheck && ply < MAX_PLY / 2) ++depth; // Check extension
+  if (depth <= 0 || ply >= MAX_PLY - 1) return quiesce(alpha, beta, ply);
+
+  if ((++nodes & 255) == 0) check_limits();
+  else if (stop.load(std::memory_order_relaxed)) aborted = true;
+  if (aborted) return 0;
+
+  move_t ttMove = NO_MOVE;
+  TTData ttData;
+  if (tt && tt->probe(board.hash, &ttData))
+  {
+    ttMove = ttData.move;
+    int ttScore = score_from_tt(ttData.score, ply);
+    if (!pvNode && ttData.depth >= depth
+      && ((ttData.bound == BOUND_EXACT)
+       || (ttData.bound == BOUND_LOWER && ttScore >= beta)
+       || (ttData.bound == BOUND_UPPER && ttScore <= alpha)))
+      return ttScore;
+  }
+
+  // Null move pruning: if passing the turn still fails high, a real move almost certainly does too.
+  // Not done in pawn endgames, where zugzwang is common.
+  int side = COLOR_INDEX(board.currentPlayer);
+  const bitboard_t *own = board.pieces[side];
+  if (!pvNode && !inCheck && allowNullMove && depth >= 3 && (own[KNIGHT] | own[BISHOP] | own[ROOK] | own[QUEEN]) && evaluate_position() >= beta)
+  {
+    int R = 2 + depth / 4;
+    board.make_null_move();
+    int score = -search(-beta, -beta + 1, depth - 1 - R, ply + 1, false);
+    board.unmake_move();
+    if (aborted) return 0;
+    if (score >= beta) return (score >= SCORE_MATE_IN_MAX_PLY) ? beta : score;
+  }
+
+  MoveList list;
+  board.generate_all_moves(list);
+  if (list.size == 0) return inCheck ? -SCORE_MATE + ply : 0;
+
+  int scores[MAX_MOVES];
+  order_moves(list, scores, ttMove, ply);
+
+  int originalAlpha = alpha, bestScore = -SCORE_INFINITE;
+  move_t bestMove = NO_MOVE;
+  for(int i = 0; i < list.size; ++i)
+  {
+    move_t move = pick_move(list, scores, i);
+    bool quiet = !board.board[SQUARE_Y(MOVE_DST(move))][SQUARE_X(MOVE_DST(move))] && MOVE_TYPE(move) != MOVE_EN_PASSANT && MOVE_TYPE(move) != MOVE_PROMOTION;
+    board.make_move(move);
+
+    int score;
+    if (i == 0) score = -search(-beta, -alpha, depth - 1, ply + 1, true);
+    else
+    {
+      // Late move reductions: quiet moves ordered late are searched shallower with a null window,
+      // and only searched again at full depth if they unexpectedly beat alpha.
+      int reduction = 0;
+      if (depth >= 3 && quiet && !inCheck && !board.is_king_in_check(board.currentPlayer))
+      {
+        reduction = reductions[MIN(depth, MAX_PLY - 1)][MIN(i, MAX_MOVES - 1)] - pvNode;
+        reduction = MAX(0, MIN(reduction, depth - 2));
+      }
+      score = -search(-alpha - 1, -alpha, depth - 1 - reduction, ply + 1, true);
+      if (score > alpha && reduction) score = -search(-alpha - 1, -alpha, depth - 1, ply + 1, true);
+      if (score > alpha && score < beta) score = -search(-beta, -alpha, depth - 1, ply + 1, true);
+    }
+    board.unmake_move();
+    if (aborted) return 0;
+
+    if (score > bestScore)
+    {
+      bestScore = score;
+      bestMove = move;
+      if (score > alpha)
+      {
+        alpha = score;
+        pv[ply][ply] = move;
+        for(int j = ply + 1; j < pvLength[ply + 1]; ++j) pv[ply][j] = pv[ply + 1][j];
+        pvLength[ply] = MAX(pvLength[ply + 1], ply + 1);
+
+        if (score >= beta)
+        {
+          if (quiet)
+          {
+            if (killers[ply][0] != move) killers[ply][1] = killers[ply][0], killers[ply][0] = move;
+            int *h = &history[side][MOVE_SRC(move)][MOVE_DST(move)];
+            *h = MIN(*h + depth * depth, HISTORY_MAX);
+          }
+          break;
+        }
+      }
+    }
+  }
+
+  if (tt)
+  {
+    int bound = (bestScore >= beta) ? BOUND_LOWER : (alpha > originalAlpha) ? BOUND_EXACT : BOUND_UPPER;
+    tt->store(board.hash, depth, score_to_tt(bestScore, ply), bound, bestMove);
+  }
+  return bestScore;
+}
+
+move_t Searcher::think(const Board &position, const SearchLimits &searchLimits, bool newTableSearch)
+{
+  board = position;
+  limits = searchLimits;
+  startTime = std::chrono::steady_clock::now();
+  budget_search_time(limits, board.currentPlayer, &optimumTime, &maximumTime);
+  nodes = 0;
+  aborted = false;
+  memset(killers, 0, sizeof(killers));
+  memset(&result, 0, sizeof(result));
+  // Keep what was learnt in earlier searches, but let it fade so that it adapts to the new position.
+  for(int side = 0; side < 2; ++side)
+    for(int src = 0; src < 64; ++src)
+      for(int dst = 0; dst < 64; ++dst)
+        history[side][src][dst] /= 8;
+  if (tt && newTableSearch) tt->new_search();
+  if (nnue_is_loaded() && !nnue) nnue = new NnueStack;
+
+  MoveList list;
+  board.generate_all_moves(list);
+  if (list.size == 0) return NO_MOVE;
+  result.pv[0] = list.moves[0]; // Have a legal move to return even if the first iteration is aborted
+  result.pvLength = 1;
+
+  int maxDepth = (limits.depth > 0) ? MIN(limits.depth, MAX_PLY - 1) : MAX_PLY - 1;
+  for(int depth = 1; depth <= maxDepth; ++depth)
+  {
+    if (threadIndex > 0 && depth > 1 && depth < maxDepth && (depth + threadIndex) % 2 == 0) continue;
+    int score = search(-SCORE_INFINITE, SCORE_INFINITE, depth, 0, false);
+    if (aborted && depth > 1) break; // Results of an unfinished iteration can't be trusted
+
+    result.depth = depth;
+    result.score = score;
+    result.nodes = nodes;
+    result.milliseconds = elapsed_milliseconds();
+    result.nps = nodes * 1000 / MAX(result.milliseconds, 1);
+    if (pvLength[0] > 0)
+    {
+      result.pvLength = pvLength[0];
+      memcpy(result.pv, pv[0], pvLength[0] * sizeof(move_t));
+    }
+    if (report) report(result, reportUserData);
+
+    if (aborted) break;
+    if (optimumTime && result.milliseconds >= optimumTime) break; // The next iteration would likely not finish in time
+    if (score >= SCORE_MATE_IN_MAX_PLY && SCORE_MATE - score <= depth) break; // Found the shortest mate
+    if (list.size == 1) break; // Only move
+  }
+  return result.pv[0];
+}
+
+struct HelperSearch
+{
+  Searcher *searcher;
+  const Board *position;
+  const SearchLimits *limits;
+};
+
+static void run_helper_search(void *arg)
+{
+  HelperSearch *helper = (HelperSearch *)arg;
+  helper->searcher->think(*helper->position, *helper->limits, false);
+}
+
+move_t think_parallel(ThreadPool &pool, Searcher **searchers, int numSearchers, const Board &position, const SearchLimits &limits)
+{
+  HelperSearch helpers[256];
+  numSearchers = MIN(numSearchers, 256);
+  TaskGroup group;
+  // Before any helper starts storing entries, so that they all store them under the new age.
+  if (searchers[0]->tt) searchers[0]->tt->new_search();
+  for(int i = 1; i < numSearchers; ++i)
+  {
+    searchers[i]->tt = searchers[0]->tt;
+    searchers[i]->threadIndex = i;
+    searchers[i]->report = 0;
+    searchers[i]->stop = false;
+    helpers[i].searcher = searchers[i];
+    helpers[i].position = &position;
+    helpers[i].limits = &limits;
+    pool.submit(group, run_helper_search, &helpers[i]);
+  }
+
+  searchers[0]->threadIndex = 0;
+  move_t best = searchers[0]->think(position, limits, false);
+
+  for(int i = 1; i < numSearchers; ++i)
+    searchers[i]->stop = true;
+  pool.wait(group);
+  return best;
+}
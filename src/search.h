@@ -0,0 +1,113 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include "board.h"
+#include "tt.h"
+#include "threadpool.h"
+
+struct NnueStack;
+
+#define MAX_PLY 64
+
+#define SCORE_INFINITE 32001
+#define SCORE_MATE 32000 // Minus the number of plies to mate
+#define SCORE_MATE_IN_MAX_PLY (SCORE_MATE - MAX_PLY)
+
+struct SearchLimits
+{
+  int depth; // Maximum depth of iterative deepening, 0 for no limit
+  uint64_t nodes; // Maximum number of nodes to search, 0 for no limit
+  int movetime; // Milliseconds to search for, 0 for no limit
+
+  // Game clock, indexed by COLOR_INDEX(color): milliseconds left and added after each move. The time manager
+  // budgets the move of the player to move from these, see budget_search_time(). 0 time left for no clock.
+  int time[2];
+  int increment[2];
+  int movestogo; // Moves until the next time control, 0 if the rest of the game must be played in the time left
+
+  SearchLimits():depth(0), nodes(0), movetime(0), movestogo(0) { time[0] = time[1] = increment[0] = increment[1] = 0; }
+};
+
+// Milliseconds kept in hand on the clock for the delays between the search returning and the clock stopping.
+#define MOVE_OVERHEAD 30
+
+// Splits the time of a move for the player to move: iterative deepening starts no new iteration after *optimum
+// milliseconds, since it would likely not finish, and aborts the one in progress at *maximum. With movetime both
+// are movetime; without a clock or movetime both are 0, for no limit.
+void budget_search_time(const SearchLimits &limits, int player, int *optimum, int *maximum);
+
+// Result of one completed iteration of iterative deepening.
+struct SearchIteration
+{
+  int depth;
+  int score; // Centipawns from the point of view of the player to move, or SCORE_MATE - plies to mate
+  uint64_t nodes;
+  int milliseconds;
+  uint64_t nps;
+  move_t pv[MAX_PLY];
+  int pvLength;
+};
+
+typedef void (*SearchReportFunc)(const SearchIteration &iteration, void *userData);
+
+// Iterative deepening principal variation alpha-beta search with quiescence search, null move
+// pruning, late move reductions, and killer/history move ordering. Positions are evaluated with the NNUE
+// network if one is loaded, otherwise with evaluate(). One Searcher searches on one
+// thread; it keeps its own copy of the board, so the caller's Board is not touched.
+struct Searcher
+{
+  Searcher();
+  ~Searcher();
+
+  // Optional table shared with other searchers, for cutoffs and move ordering.
+  TranspositionTable *tt;
+
+  // Optional callback invoked after each completed iteration.
+  SearchReportFunc report;
+  void *reportUserData;
+
+  // Set from any thread to make think() return as soon as possible with the best move found so far. Polled at
+  // every node, so the search returns within about one node of it being set.
+  std::atomic<bool> stop;
+
+  // 0 for a searcher on its own or the main searcher of a parallel search, 1.. for its helpers.
+  // Helpers skip some iterations, so that threads search different depths.
+  int threadIndex;
+
+  // Searches the position and returns the best move, or NO_MOVE if there are no legal moves. Starts a new search
+  // in the transposition table, see TranspositionTable::new_search(), unless newTableSearch is false because the
+  // caller did so for all the searches sharing the table at once.
+  move_t think(const Board &position, const SearchLimits &limits, bool newTableSearch = true);
+
+  // Results of the last completed iteration of think().
+  SearchIteration result;
+
+private:
+  Board board;
+  SearchLimits limits;
+  std::chrono::steady_clock::time_point startTime;
+  int optimumTime, maximumTime; // Milliseconds, see budget_search_time()
+  uint64_t nodes;
+  bool aborted;
+
+  move_t killers[MAX_PLY][2];
+  int history[2][64][64]; // Indexed by [COLOR_INDEX(color)][src][dst] of quiet moves that caused a beta cutoff
+  move_t pv[MAX_PLY][MAX_PLY];
+  int pvLength[MAX_PLY];
+  NnueStack *nnue; // Accumulators of the positions searched, allocated once a network is loaded, see nnue.h
+
+  int search(int alpha, int beta, int depth, int ply, bool allowNullMove);
+  int quiesce(int alpha, int beta, int ply);
+  int evaluate_position();
+  void order_moves(const MoveList &list, int *scores, move_t ttMove, int ply);
+  bool is_draw() const;
+  void check_limits();
+  int elapsed_milliseconds() const;
+};
+
+// Lazy SMP: searches the position with all the given searchers at once, sharing searchers[0]->tt, which gets one
+// new search for all of them. searchers[0] runs on the calling thread and its result is returned; the others run
+// as helper tasks on the pool, and mostly contribute by filling the transposition table for the main searcher.
+move_t think_parallel(ThreadPool &pool, Searcher **searchers, int numSearchers, const Board &position, const SearchLimits &limits);
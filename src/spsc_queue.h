@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+
+// Fixed capacity ring buffer for exactly one producer thread and one consumer thread. Neither side ever
+// takes a lock or waits: push() fails if the queue is full and pop() if it is empty. Items are copied in and
+// out, so keep them plain data. Capacity must be a power of two.
+template<typename T, unsigned Capacity>
+struct SpscQueue
+{
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+  SpscQueue():head(0), tail(0) {}
+
+  // Producer only.
+  bool push(const T &item)
+  {
+    unsigned t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) == Capacity) return false;
+    items[t & (Capacity - 1)] = item;
+    tail.store(t + 1, std::memory_order_release); // Publishes the item
+    return true;
+  }
+
+  // Consumer only.
+  bool pop(T *item)
+  {
+    unsigned h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) return false;
+    *item = items[h & (Capacity - 1)];
+    head.store(h + 1, std::memory_order_release); // Frees the slot for the producer
+    return true;
+  }
+
+  // Either side, only a snapshot while the other side runs. The producer can rely on size() not growing
+  // behind its back, and the consumer on it not shrinking.
+  bool empty() const { return size() == 0; }
+  unsigned size() const { return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire); }
+  static unsigned capacity() { return Capacity; }
+
+private:
+  T items[Capacity];
+  // On separate cache lines, so that the two threads don't keep stealing each other's line.
+  alignas(64) std::atomic<unsigned> head; // Next item to pop, written by the consumer
+  alignas(64) std::atomic<unsigned> tail; // Next free slot, written by the producer
+
+  SpscQueue(const SpscQueue &);
+  SpscQueue &operator=(const SpscQueue &);
+};
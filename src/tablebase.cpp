@@ -0,0 +1,748 @@
+#include "tablebase.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mapped_file.h"
+
+// One byte per position: 2 + plies to mate, so that odd values are wins and even values losses for the player
+// to move, or one of these.
+#define TB_VALUE_DRAW 0
+#define TB_VALUE_UNKNOWN 1 // Not resolved yet, only while generating
+#define TB_VALUE_ILLEGAL 255 // Not a legal position, or not the canonical index of one
+#define TB_MAX_PLIES 252
+
+#define TB_MAGIC "TCHESSTB"
+#define TB_HEADER_SIZE 32 // Magic, material name padded with zeros, and the number of positions per side to move, little endian
+#define TB_MAX_TABLES 512
+#define TB_MAX_PATH 1024
+
+static const char tbPieceChars[] = " KQRBN"; // Indexed by piece type, pawns are 'P'
+#define TB_PIECE_CHAR(pieceType) ((pieceType) == PAWN ? 'P' : tbPieceChars[pieceType])
+
+struct TbTable
+{
+  char material[16];
+  int counts[2][7]; // Number of pieces by [side][pieceType]
+  bool hasPawns;
+  uint64_t size; // Positions per side to move
+  const uint8_t *values; // size values with white to move, followed by size values with black to move
+  uint8_t *ownedValues; // values while generating, before the table is written and mapped
+  MappedFile file;
+};
+
+static TbTable *tables[TB_MAX_TABLES];
+static int numTables = 0;
+static int maxPieces = 0;
+
+// The king pairs of each symmetry class, indexed by [hasPawns]. kkIndex is -1 for pairs that are not the
+// canonical member of their class, and for kings next to each other.
+static int kkIndex[2][64][64];
+static uint8_t kkSquares[2][64*64][2];
+static int kkCount[2];
+
+static void init_king_pairs()
+{
+  for(int hasPawns = 0; hasPawns < 2; ++hasPawns)
+  {
+    kkCount[hasPawns] = 0;
+    for(int wk = 0; wk < 64; ++wk)
+      for(int bk = 0; bk < 64; ++bk)
+      {
+        int wx = SQUARE_X(wk), wy = SQUARE_Y(wk), bx = SQUARE_X(bk), by = SQUARE_Y(bk);
+        bool adjacent = abs(wx - bx) <= 1 && abs(wy - by) <= 1;
+        // With pawns only the left-right mirror is a symmetry, without them the white king goes to the
+        // a1-d1-d4 triangle and, if it is on the diagonal, the black king to the lower half.
+        bool canonical = hasPawns ? (wx < 4) : (wx < 4 && wy <= wx && (wx != wy || by <= bx));
+        if (adjacent || !canonical)
+        {
+          kkIndex[hasPawns][wk][bk] = -1;
+          continue;
+        }
+        kkSquares[hasPawns][kkCount[hasPawns]][0] = (uint8_t)wk;
+        kkSquares[hasPawns][kkCount[hasPawns]][1] = (uint8_t)bk;
+        kkIndex[hasPawns][wk][bk] = kkCount[hasPawns]++;
+      }
+  }
+}
+
+static struct TablebaseInitializer { TablebaseInitializer() { init_king_pairs(); } } tablebaseInitializer;
+
+// Symmetry t of the board: bit 2 mirrors along the a1-h8 diagonal, then bit 0 left-right and bit 1 top-bottom.
+static inline int transform_square(int sq, int t)
+{
+  if (t & 4) sq = ((sq & 7) << 3) | (sq >> 3);
+  if (t & 1) sq ^= 7;
+  if (t & 2) sq ^= 56;
+  return sq;
+}
+
+static bool parse_material(const char *material, int counts[2][7])
+{
+  memset(counts, 0, 2 * 7 * sizeof(int));
+  int side = 0, total = 0;
+  for(const char *p = material; *p; ++p)
+  {
+    if (*p == 'v' && side == 0)
+    {
+      side = 1;
+      continue;
+    }
+    const char *c = (*p == 'P') ? 0 : strchr(tbPieceChars + 1, *p);
+    int pieceType = (*p == 'P') ? PAWN : c ? (int)(c - tbPieceChars) : 0;
+    if (!pieceType || ++total > TB_MAX_PIECES) return false;
+    ++counts[side][pieceType];
+  }
+  return side == 1 && counts[0][KING] == 1 && counts[1][KING] == 1;
+}
+
+static void material_name(const int counts[2][7], char *name)
+{
+  for(int side = 0; side < 2; ++side)
+  {
+    if (side) *name++ = 'v';
+    for(int pieceType = KING; pieceType <= PAWN; ++pieceType)
+      for(int i = 0; i < counts[side][pieceType]; ++i) *name++ = TB_PIECE_CHAR(pieceType);
+  }
+  *name = 0;
+}
+
+static void swap_colors(int counts[2][7])
+{
+  for(int pieceType = 0; pieceType < 7; ++pieceType)
+  {
+    int c = counts[0][pieceType];
+    counts[0][pieceType] = counts[1][pieceType];
+    counts[1][pieceType] = c;
+  }
+}
+
+static bool only_kings(const int counts[2][7])
+{
+  for(int pieceType = QUEEN; pieceType <= PAWN; ++pieceType)
+    if (counts[0][pieceType] || counts[1][pieceType]) return false;
+  return true;
+}
+
+static TbTable *find_table(const char *material)
+{
+  for(int i = 0; i < numTables; ++i)
+    if (!strcmp(tables[i]->material, material)) return tables[i];
+  return 0;
+}
+
+static uint64_t table_size(const int counts[2][7], bool hasPawns)
+{
+  uint64_t size = kkCount[hasPawns];
+  for(int side = 0; side < 2; ++side)
+    for(int pieceType = QUEEN; pieceType <= PAWN; ++pieceType)
+      for(int i = 0; i < counts[side][pieceType]; ++i) size *= (pieceType == PAWN) ? 48 : 64;
+  return size;
+}
+
+static TbTable *new_table(const int counts[2][7])
+{
+  TbTable *table = new TbTable;
+  memcpy(table->counts, counts, sizeof(table->counts));
+  material_name(counts, table->material);
+  table->hasPawns = counts[0][PAWN] || counts[1][PAWN];
+  table->size = table_size(counts, table->hasPawns);
+  table->values = 0;
+  table->ownedValues = 0;
+  return table;
+}
+
+// Index of the pieces other than the kings, after transforming their squares with t, and with mirrorDiagonal
+// mirroring them along the a1-h8 diagonal after that. Pieces of the same kind are taken in square order.
+static uint64_t pieces_index(const TbTable &table, const bitboard_t pieces[2][7], int t, bool mirrorDiagonal, uint64_t idx)
+{
+  for(int side = 0; side < 2; ++side)
+    for(int pieceType = QUEEN; pieceType <= PAWN; ++pieceType)
+    {
+      if (!table.counts[side][pieceType]) continue;
+      bitboard_t b = 0;
+      for(bitboard_t p = pieces[side][pieceType]; p; )
+      {
+        int sq = transform_square(pop_lsb(&p), t);
+        b |= SQUARE_BIT(mirrorDiagonal ? transform_square(sq, 4) : sq);
+      }
+      while(b)
+      {
+        int sq = pop_lsb(&b);
+        idx = (pieceType == PAWN) ? idx * 48 + (sq - 8) : idx * 64 + sq;
+      }
+    }
+  return idx;
+}
+
+// Index of the position in the table, after mirroring it to the canonical king squares. If both kings end up on
+// the a1-h8 diagonal, mirroring along it keeps them there, and the smaller index of the two is the canonical one.
+// Returns false if the kings are next to each other.
+static bool table_index(const TbTable &table, const bitboard_t pieces[2][7], uint64_t *index)
+{
+  int hasPawns = table.hasPawns;
+  int wk = lsb(pieces[0][KING]), bk = lsb(pieces[1][KING]);
+  int t = 0, kk = -1;
+  for(; t < (hasPawns ? 2 : 8); ++t)
+    if ((kk = kkIndex[hasPawns][transform_square(wk, t)][transform_square(bk, t)]) >= 0) break;
+  if (kk < 0) return false;
+
+  *index = pieces_index(table, pieces, t, false, (uint64_t)kk);
+  int wkt = transform_square(wk, t), bkt = transform_square(bk, t);
+  if (!hasPawns && SQUARE_X(wkt) == SQUARE_Y(wkt) && SQUARE_X(bkt) == SQUARE_Y(bkt))
+  {
+    uint64_t mirrored = pieces_index(table, pieces, t, true, (uint64_t)kk);
+    if (mirrored < *index) *index = mirrored;
+  }
+  return true;
+}
+
+// Inverse of table_index. Returns false if the index has two pieces on the same square or pieces of the
+// same kind out of square order. It does not check that the index is the canonical one of the position.
+static bool decode_index(const TbTable &table, uint64_t index, bitboard_t pieces[2][7])
+{
+  memset(pieces, 0, 2 * 7 * sizeof(bitboard_t));
+  bitboard_t occupied = 0;
+  for(int side = 1; side >= 0; --side)
+    for(int pieceType = PAWN; pieceType >= QUEEN; --pieceType)
+    {
+      int previous = 64;
+      for(int i = 0; i < table.counts[side][pieceType]; ++i)
+      {
+        int base = (pieceType == PAWN) ? 48 : 64;
+        int sq = (int)(index % base) + ((pieceType == PAWN) ? 8 : 0);
+        index /= base;
+        if (sq >= previous || (occupied & SQUARE_BIT(sq))) return false;
+        previous = sq;
+        occupied |= SQUARE_BIT(sq);
+        pieces[side][pieceType] |= SQUARE_BIT(sq);
+      }
+    }
+  int wk = kkSquares[table.hasPawns][index][0], bk = kkSquares[table.hasPawns][index][1];
+  if (occupied & (SQUARE_BIT(wk) | SQUARE_BIT(bk))) return false;
+  pieces[0][KING] = SQUARE_BIT(wk);
+  pieces[1][KING] = SQUARE_BIT(bk);
+  for(int side = 0; side < 2; ++side)
+    for(int pieceType = KING; pieceType <= PAWN; ++pieceType) pieces[side][NO_UNIT] |= pieces[side][pieceType];
+  return true;
+}
+
+// Returns the table value of the position, flipping the colors if only the table of the other side is loaded.
+// Bare kings are a draw without a table. Returns -1 if there is no table.
+static int probe_value(const bitboard_t pieces[2][7], int sideToMove)
+{
+  int counts[2][7];
+  for(int side = 0; side < 2; ++side)
+    for(int pieceType = 0; pieceType < 7; ++pieceType) counts[side][pieceType] = popcount(pieces[side][pieceType]);
+  if (only_kings(counts)) return TB_VALUE_DRAW;
+
+  char name[16];
+  material_name(counts, name);
+  const TbTable *table = find_table(name);
+  uint64_t index;
+  if (table)
+  {
+    if (!table_index(*table, pieces, &index)) return TB_VALUE_ILLEGAL;
+    return table->values[sideToMove * table->size + index];
+  }
+
+  swap_colors(counts);
+  material_name(counts, name);
+  if (!(table = find_table(name))) return -1;
+  bitboard_t flipped[2][7];
+  for(int side = 0; side < 2; ++side)
+    for(int pieceType = 0; pieceType < 7; ++pieceType) flipped[side][pieceType] = __builtin_bswap64(pieces[1 - side][pieceType]);
+  if (!table_index(*table, flipped, &index)) return TB_VALUE_ILLEGAL;
+  return table->values[(1 - sideToMove) * table->size + index];
+}
+
+static void table_path(const char *directory, const char *material, char *path)
+{
+  snprintf(path, TB_MAX_PATH, "%s/%s.tctb", directory ? directory : ".", material);
+}
+
+static bool register_table(TbTable *table)
+{
+  if (numTables == TB_MAX_TABLES) return false;
+  tables[numTables++] = table;
+  int pieces = 0;
+  for(int side = 0; side < 2; ++side)
+    for(int pieceType = KING; pieceType <= PAWN; ++pieceType) pieces += table->counts[side][pieceType];
+  if (pieces > maxPieces) maxPieces = pieces;
+  return true;
+}
+
+static bool map_table(TbTable *table, const char *directory)
+{
+  char path[TB_MAX_PATH];
+  table_path(directory, table->material, path);
+  if (!table->file.open(path)) return false;
+  const uint8_t *header = table->file.data;
+  uint64_t size = 0;
+  if (table->file.size >= TB_HEADER_SIZE)
+    for(int i = 0; i < 8; ++i) size |= (uint64_t)header[24 + i] << (8*i);
+  if (table->file.size < TB_HEADER_SIZE || memcmp(header, TB_MAGIC, 8) || strncmp((const char *)header + 8, table->material, 16)
+    || size != table->size || table->file.size != TB_HEADER_SIZE + 2 * size)
+  {
+    table->file.close();
+    return false;
+  }
+  table->values = header + TB_HEADER_SIZE;
+  return true;
+}
+
+bool tb_load(const char *directory, const char *material)
+{
+  int counts[2][7];
+  if (!parse_material(material, counts)) return false;
+  char name[16];
+  material_name(counts, name);
+  if (find_table(name)) return true;
+  TbTable *table = new_table(counts);
+  if (!map_table(table, directory) || !register_table(table))
+  {
+    delete table;
+    return false;
+  }
+  return true;
+}
+
+// Loads the tables of every material of up to TB_MAX_PIECES pieces, adding pieces in kind order from pieceType on.
+static void load_materials(const char *directory, int counts[2][7], int numPieces, int side, int pieceType)
+{
+  if (side == 2)
+  {
+    char name[16];
+    material_name(counts, name);
+    if (!only_kings(counts)) tb_load(directory, name);
+    return;
+  }
+  if (pieceType > PAWN)
+  {
+    load_materials(directory, counts, numPieces, side + 1, QUEEN);
+    return;
+  }
+  load_materials(directory, counts, numPieces, side, pieceType + 1);
+  if (numPieces == TB_MAX_PIECES) return;
+  ++counts[side][pieceType];
+  load_materials(directory, counts, numPieces + 1, side, pieceType);
+  --counts[side][pieceType];
+}
+
+int tb_load_all(const char *directory)
+{
+  int counts[2][7] = {};
+  counts[0][KING] = counts[1][KING] = 1;
+  load_materials(directory, counts, 2, 0, QUEEN);
+  return numTables;
+}
+
+int tb_max_pieces()
+{
+  return maxPieces;
+}
+
+bool tb_probe(const Board &board, int *wdl, int *plies)
+{
+  if (popcount(board.occupied) > maxPieces) return false;
+  for(int side = 0; side < 2; ++side)
+    if ((board.castlingPiecesAtHome[side] & KINGSIDE_CASTLING_MASK) == KINGSIDE_CASTLING_MASK
+     || (board.castlingPiecesAtHome[side] & QUEENSIDE_CASTLING_MASK) == QUEENSIDE_CASTLING_MASK) return false;
+  if (board.enpassantX >= 0 && (pawnAttacks[COLOR_INDEX(OPPONENT_COLOR(board.currentPlayer))][SQUARE(board.enpassantX, board.enpassantY)] & board.pieces[COLOR_INDEX(board.currentPlayer)][PAWN]))
+    return false;
+
+  int value = probe_value(board.pieces, COLOR_INDEX(board.currentPlayer));
+  if (value < 0 || value == TB_VALUE_ILLEGAL || value == TB_VALUE_UNKNOWN) return false;
+  *wdl = (value == TB_VALUE_DRAW) ? TB_DRAW : (value & 1) ? TB_WIN : TB_LOSS;
+  *plies = (value == TB_VALUE_DRAW) ? 0 : value - 2;
+  return true;
+}
+
+bool tb_info(const char *material, TbInfo *info)
+{
+  int counts[2][7];
+  if (!parse_material(material, counts)) return false;
+  char name[16];
+  material_name(counts, name);
+  const TbTable *table = find_table(name);
+  if (!table)
+  {
+    swap_colors(counts);
+    material_name(counts, name);
+    if (!(table = find_table(name))) return false;
+  }
+  memset(info, 0, sizeof(*info));
+  for(uint64_t i = 0; i < 2 * table->size; ++i)
+  {
+    int value = table->values[i];
+    if (value == TB_VALUE_ILLEGAL) continue;
+    ++info->positions;
+    if (value == TB_VALUE_DRAW) ++info->draws;
+    else if (value & 1) ++info->wins;
+    else ++info->losses;
+    if (value != TB_VALUE_DRAW && value - 2 > info->longestMate) info->longestMate = value - 2;
+  }
+  return true;
+}
+
+// Generation. Every position starts out unknown. The first pass marks the illegal positions, the mates and
+// stalemates, and the moves that leave the table by a capture or promotion, whose values come from the smaller
+// tables. Then pass n finds the positions n plies from mate: those where a move reaches a position lost in n-1
+// plies are won, found by retracting the moves into the positions lost in n-1, and those where every move
+// reaches a won position are lost, checked by generating the moves of the positions retracted from the positions
+// won in n-1. What remains unknown once a pass finds nothing is a draw.
+struct TbGenerator
+{
+  TbTable *table;
+  uint8_t *values; // Accessed atomically, tasks resolve positions in each other's ranges
+  uint8_t *exitWins; // Plies to mate by the best capture or promotion that wins, 0 if there is none
+  int plies; // Of the current pass
+};
+
+struct TbTask
+{
+  TbGenerator *gen;
+  uint64_t begin, end; // Range of positions, both sides to move
+  uint64_t resolved;
+  int longestExit; // Plies of the longest mate found in the first pass
+  bool overflow; // A mate too long for the value format
+};
+
+static inline uint8_t load_value(const TbGenerator &gen, uint64_t i) { return __atomic_load_n(&gen.values[i], __ATOMIC_RELAXED); }
+
+// Sets the value of an unknown position, returns false if another task resolved it first.
+static inline bool resolve(TbGenerator &gen, uint64_t i, int value)
+{
+  uint8_t expected = TB_VALUE_UNKNOWN;
+  return __atomic_compare_exchange_n(&gen.values[i], &expected, (uint8_t)value, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+// Sets up the bitboards and state the legal move generator reads, board[][] and the hash key are not needed.
+static void setup_board(Board &board, const bitboard_t pieces[2][7], int sideToMove)
+{
+  memcpy(board.pieces, pieces, sizeof(board.pieces));
+  board.occupied = pieces[0][NO_UNIT] | pieces[1][NO_UNIT];
+  board.currentPlayer = sideToMove ? BLACK : WHITE;
+  board.castlingPiecesAtHome[0] = board.castlingPiecesAtHome[1] = 0;
+  board.enpassantX = board.enpassantY = -1;
+}
+
+static inline bool leaves_table(const bitboard_t pieces[2][7], int sideToMove, move_t move)
+{
+  return MOVE_TYPE(move) == MOVE_PROMOTION || (pieces[1 - sideToMove][NO_UNIT] & SQUARE_BIT(MOVE_DST(move)));
+}
+
+// Plays the move on the bitboards and returns the value of the resulting position for the opponent.
+static int successor_value(const TbGenerator &gen, const bitboard_t pieces[2][7], int sideToMove, move_t move)
+{
+  bitboard_t p[2][7];
+  memcpy(p, pieces, sizeof(p));
+  int us = sideToMove, them = 1 - sideToMove;
+  bitboard_t srcBit = SQUARE_BIT(MOVE_SRC(move)), dstBit = SQUARE_BIT(MOVE_DST(move));
+  int pieceType = KING;
+  while(!(p[us][pieceType] & srcBit)) ++pieceType;
+  bool leaves = false;
+  if (p[them][NO_UNIT] & dstBit)
+  {
+    for(int captured = QUEEN; captured <= PAWN; ++captured) p[them][captured] &= ~dstBit;
+    p[them][NO_UNIT] &= ~dstBit;
+    leaves = true;
+  }
+  p[us][pieceType] &= ~srcBit;
+  if (MOVE_TYPE(move) == MOVE_PROMOTION)
+  {
+    pieceType = MOVE_PROMOTION_PIECE(move);
+    leaves = true;
+  }
+  p[us][pieceType] |= dstBit;
+  p[us][NO_UNIT] ^= srcBit | dstBit;
+
+  if (leaves) return probe_value(p, them);
+  uint64_t index;
+  if (!table_index(*gen.table, p, &index)) return TB_VALUE_ILLEGAL;
+  return load_value(gen, them * gen.table->size + index);
+}
+
+static void initial_pass(void *arg)
+{
+  TbTask &task = *(TbTask *)arg;
+  TbGenerator &gen = *task.gen;
+  uint64_t size = gen.table->size;
+  Board board;
+  MoveList list;
+  for(uint64_t i = task.begin; i < task.end; ++i)
+  {
+    int sideToMove = (i >= size);
+    bitboard_t pieces[2][7];
+    gen.values[i] = TB_VALUE_UNKNOWN;
+    gen.exitWins[i] = 0;
+    uint64_t index;
+    if (!decode_index(*gen.table, i - sideToMove * size, pieces) || !table_index(*gen.table, pieces, &index) || index != i - sideToMove * size)
+    {
+      gen.values[i] = TB_VALUE_ILLEGAL;
+      continue;
+    }
+    setup_board(board, pieces, sideToMove);
+    if (board.is_square_attacked(lsb(pieces[1 - sideToMove][KING]), board.currentPlayer, board.occupied))
+    {
+      gen.values[i] = TB_VALUE_ILLEGAL; // The player not to move is in check
+      continue;
+    }
+    board.generate_all_moves(list);
+    if (list.size == 0)
+    {
+      gen.values[i] = board.is_king_in_check(board.currentPlayer) ? 2 : TB_VALUE_DRAW;
+      continue;
+    }
+
+    bool allLeave = true, draw = false;
+    int bestWin = 0, longestLoss = 0;
+    for(int m = 0; m < list.size; ++m)
+    {
+      if (!leaves_table(pieces, sideToMove, list.moves[m]))
+      {
+        allLeave = false;
+        continue;
+      }
+      int value = successor_value(gen, pieces, sideToMove, list.moves[m]);
+      if (value == TB_VALUE_DRAW) draw = true;
+      else if (value & 1) longestLoss = (value - 1 > longestLoss) ? value - 1 : longestLoss;
+      else bestWin = (!bestWin || value - 1 < bestWin) ? value - 1 : bestWin;
+    }
+    int plies = bestWin ? bestWin : (allLeave && !draw) ? longestLoss : -1;
+    if (plies > TB_MAX_PLIES)
+    {
+      task.overflow = true;
+      continue;
+    }
+    if (allLeave) gen.values[i] = (uint8_t)(plies >= 0 ? plies + 2 : TB_VALUE_DRAW);
+    else gen.exitWins[i] = (uint8_t)bestWin;
+    if (plies > task.longestExit) task.longestExit = plies;
+  }
+}
+
+// Resolves the positions from which the side that just moved into the given position had that move.
+static void retract(TbTask &task, const bitboard_t pieces[2][7], int sideToMove, int value, Board &board)
+{
+  TbGenerator &gen = *task.gen;
+  int mover = 1 - sideToMove;
+  bitboard_t occupied = pieces[0][NO_UNIT] | pieces[1][NO_UNIT];
+  bitboard_t p[2][7];
+  memcpy(p, pieces, sizeof(p));
+  MoveList list;
+
+  for(int pieceType = KING; pieceType <= PAWN; ++pieceType)
+    for(bitboard_t b = pieces[mover][pieceType]; b; )
+    {
+      int dst = pop_lsb(&b);
+      bitboard_t srcs;
+      switch(pieceType)
+      {
+      case KING: srcs = kingAttacks[dst]; break;
+      case QUEEN: srcs = queen_attacks(dst, occupied); break;
+      case ROOK: srcs = rook_attacks(dst, occupied); break;
+      case BISHOP: srcs = bishop_attacks(dst, occupied); break;
+      case KNIGHT: srcs = knightAttacks[dst]; break;
+      default: // Pawns step back, twice from the fourth rank. En passant rights are not tracked.
+        {
+          int back = mover ? 8 : -8, y = SQUARE_Y(dst);
+          int from = dst + back;
+          srcs = 0;
+          if ((mover ? y <= 5 : y >= 2) && !(occupied & SQUARE_BIT(from)))
+          {
+            srcs = SQUARE_BIT(from);
+            if (y == (mover ? 4 : 3) && !(occupied & SQUARE_BIT(from + back))) srcs |= SQUARE_BIT(from + back);
+          }
+        }
+      }
+      srcs &= ~occupied;
+
+      while(srcs)
+      {
+        int src = pop_lsb(&srcs);
+        bitboard_t moveBits = SQUARE_BIT(src) | SQUARE_BIT(dst);
+        p[mover][pieceType] ^= moveBits;
+        p[mover][NO_UNIT] ^= moveBits;
+        uint64_t index;
+        setup_board(board, p, mover);
+        // Before the move the player now to move must not have been in check.
+        if (table_index(*gen.table, p, &index)
+          && !board.is_square_attacked(lsb(p[sideToMove][KING]), board.currentPlayer, board.occupied))
+        {
+          uint64_t i = mover * gen.table->size + index;
+          if (load_value(gen, i) == TB_VALUE_UNKNOWN)
+          {
+            if (!(value & 1)) task.resolved += resolve(gen, i, gen.plies + 2); // Moving into a lost position wins
+            else
+            {
+              // Lost only if every move reaches a position won for the opponent.
+              board.generate_all_moves(list);
+              int longest = 0;
+              for(int m = 0; m < list.size; ++m)
+              {
+                int v = successor_value(gen, p, mover, list.moves[m]);
+                if (v == TB_VALUE_DRAW || v == TB_VALUE_UNKNOWN || !(v & 1)) { longest = -1; break; }
+                if (v - 1 > longest) longest = v - 1;
+              }
+              if (longest > TB_MAX_PLIES) task.overflow = true;
+              else if (longest > 0) task.resolved += resolve(gen, i, longest + 2);
+            }
+          }
+        }
+        p[mover][pieceType] ^= moveBits;
+        p[mover][NO_UNIT] ^= moveBits;
+      }
+    }
+}
+
+static void retrograde_pass(void *arg)
+{
+  TbTask &task = *(TbTask *)arg;
+  TbGenerator &gen = *task.gen;
+  uint64_t size = gen.table->size;
+  Board board;
+  for(uint64_t i = task.begin; i < task.end; ++i)
+  {
+    int value = load_value(gen, i);
+    if (value == TB_VALUE_UNKNOWN && gen.exitWins[i] == gen.plies) task.resolved += resolve(gen, i, gen.plies + 2);
+    else if (value == gen.plies + 1) // Resolved at gen.plies - 1
+    {
+      int sideToMove = (i >= size);
+      bitboard_t pieces[2][7];
+      decode_index(*gen.table, i - sideToMove * size, pieces);
+      retract(task, pieces, sideToMove, value, board);
+    }
+  }
+}
+
+// Runs the pass over all positions of the generator in parallel tasks, returns the number of positions resolved.
+static uint64_t run_pass(ThreadPool &pool, TbTask *tasks, int numTasks, TaskFunc pass)
+{
+  TaskGroup group;
+  for(int i = 0; i < numTasks; ++i)
+  {
+    tasks[i].resolved = 0;
+    pool.submit(group, pass, &tasks[i]);
+  }
+  pool.wait(group);
+  uint64_t resolved = 0;
+  for(int i = 0; i < numTasks; ++i) resolved += tasks[i].resolved;
+  return resolved;
+}
+
+static bool write_table(const TbTable &table, const char *directory)
+{
+  char path[TB_MAX_PATH];
+  table_path(directory, table.material, path);
+  FILE *out = fopen(path, "wb");
+  if (!out) return false;
+  uint8_t header[TB_HEADER_SIZE] = {};
+  memcpy(header, TB_MAGIC, 8);
+  memcpy(header + 8, table.material, strlen(table.material));
+  for(int i = 0; i < 8; ++i) header[24 + i] = (uint8_t)(table.size >> (8*i));
+  bool ok = fwrite(header, TB_HEADER_SIZE, 1, out) == 1 && fwrite(table.values, 1, 2 * table.size, out) == 2 * table.size;
+  return (fclose(out) == 0) && ok;
+}
+
+static bool generate_table(const int counts[2][7], const char *directory, ThreadPool &pool);
+
+// Makes sure the table for the material is loaded, for either color, loading or generating it if needed.
+static bool require_table(int counts[2][7], const char *directory, ThreadPool &pool)
+{
+  if (only_kings(counts)) return true;
+  char name[16], flippedName[16];
+  material_name(counts, name);
+  swap_colors(counts);
+  material_name(counts, flippedName);
+  swap_colors(counts);
+  if (find_table(name) || find_table(flippedName) || tb_load(directory, name) || tb_load(directory, flippedName)) return true;
+  return generate_table(counts, directory, pool);
+}
+
+static int material_value(const int counts[7])
+{
+  return counts[QUEEN] * 9 + counts[ROOK] * 5 + (counts[BISHOP] + counts[KNIGHT]) * 3 + counts[PAWN];
+}
+
+static bool generate_table(const int material[2][7], const char *directory, ThreadPool &pool)
+{
+  int counts[2][7];
+  memcpy(counts, material, sizeof(counts));
+  if (material_value(counts[1]) > material_value(counts[0])) swap_colors(counts);
+
+  // The tables reached by captures and promotions first.
+  for(int side = 0; side < 2; ++side)
+    for(int pieceType = QUEEN; pieceType <= PAWN; ++pieceType)
+    {
+      if (!counts[side][pieceType]) continue;
+      --counts[side][pieceType];
+      bool ok = require_table(counts, directory, pool);
+      if (pieceType == PAWN)
+        for(int promotion = QUEEN; promotion <= KNIGHT && ok; ++promotion)
+        {
+          ++counts[side][promotion];
+          ok = require_table(counts, directory, pool);
+          --counts[side][promotion];
+        }
+      ++counts[side][pieceType];
+      if (!ok) return false;
+    }
+
+  TbTable *table = new_table(counts);
+  TbGenerator gen;
+  gen.table = table;
+  gen.values = table->ownedValues = (uint8_t *)malloc(2 * table->size);
+  gen.exitWins = (uint8_t *)malloc(2 * table->size);
+  gen.plies = 0;
+  if (!gen.values || !gen.exitWins)
+  {
+    free(gen.values);
+    free(gen.exitWins);
+    delete table;
+    return false;
+  }
+  table->values = gen.values;
+
+  int numTasks = (pool.size() > 1 ? pool.size() : 1) * 16;
+  TbTask *tasks = new TbTask[numTasks];
+  for(int i = 0; i < numTasks; ++i)
+  {
+    tasks[i].gen = &gen;
+    tasks[i].begin = 2 * table->size * i / numTasks;
+    tasks[i].end = 2 * table->size * (i + 1) / numTasks;
+    tasks[i].longestExit = 0;
+    tasks[i].overflow = false;
+  }
+
+  run_pass(pool, tasks, numTasks, initial_pass);
+  int longestExit = 0;
+  for(int i = 0; i < numTasks; ++i)
+    if (tasks[i].longestExit > longestExit) longestExit = tasks[i].longestExit;
+  for(gen.plies = 1; gen.plies <= TB_MAX_PLIES; ++gen.plies)
+    if (!run_pass(pool, tasks, numTasks, retrograde_pass) && gen.plies > longestExit + 1) break;
+
+  bool overflow = gen.plies > TB_MAX_PLIES;
+  for(int i = 0; i < numTasks; ++i) overflow |= tasks[i].overflow;
+  delete[] tasks;
+  free(gen.exitWins);
+  for(uint64_t i = 0; i < 2 * table->size; ++i)
+    if (gen.values[i] == TB_VALUE_UNKNOWN) gen.values[i] = TB_VALUE_DRAW;
+
+  // From now on the table is read from its file, so that its pages can be dropped under memory pressure.
+  if (overflow || !write_table(*table, directory) || !map_table(table, directory) || !register_table(table))
+  {
+    free(table->ownedValues);
+    delete table;
+    return false;
+  }
+  free(table->ownedValues);
+  table->ownedValues = 0;
+  return true;
+}
+
+bool tb_generate(const char *material, const char *directory, ThreadPool &pool)
+{
+  int counts[2][7];
+  if (!parse_material(material, counts)) return false;
+  if (only_kings(counts)) return true;
+  return require_table(counts, directory, pool);
+}
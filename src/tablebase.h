@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include "board.h"
+#include "threadpool.h"
+
+// Most pieces, kings included, a table can have.
+#define TB_MAX_PIECES 5
+
+// Game theoretic result of a position for the player to move.
+#define TB_LOSS -1
+#define TB_DRAW 0
+#define TB_WIN 1
+
+// Endgame tablebases with the exact result and distance to mate of every position of a material, e.g.
+// "KQvKR": the pieces of white, 'v', the pieces of black, each side starting with its king.
+//
+// A table stores one byte per position and side to move. Positions are indexed by the squares of the pieces,
+// with the board mirrored so that the white king is in the a1-d1-d4 triangle (or on files a-d if there are
+// pawns), which shrinks the table about eightfold. A probe computes that index and reads one byte of the
+// memory mapped file. Positions with castling rights or an en passant capture aren't probed. En passant is also
+// left out while generating, so in the rare positions where the best move is a double pawn step that allows an
+// en passant capture the distance, or even the result, may be off.
+
+// Generates the table of the given material by retrograde analysis, using the threads of the pool, and
+// writes it to <directory>/<material>.tctb. The tables reached by captures and promotions are loaded from
+// the same directory, or generated first if they are not there. The material may be given for either color;
+// tables are made with the stronger side as white. Needs two bytes of memory per position while generating,
+// e.g. 7.6 MB for a 4 piece table without pawns and 484 MB for a 5 piece one.
+// Returns false if the material is invalid or a file can't be written.
+bool tb_generate(const char *material, const char *directory, ThreadPool &pool);
+
+// Memory maps the table of the given material from <directory>/<material>.tctb. A table serves both colors,
+// "KRvK" answers the positions of "KvKR" too. Returns true if the table is loaded, now or before.
+bool tb_load(const char *directory, const char *material);
+
+// Loads all tables found in the directory and returns how many there are.
+int tb_load_all(const char *directory);
+
+// Largest number of pieces of the loaded tables, 0 if there are none. Positions with more pieces can't be probed.
+int tb_max_pieces();
+
+// Looks up the position. Returns false if no loaded table has it, otherwise sets wdl to one of TB_LOSS, TB_DRAW
+// or TB_WIN and plies to the number of plies to mate with best play, 0 for a draw or if the player to move is mated.
+bool tb_probe(const Board &board, int *wdl, int *plies);
+
+// Counts of the positions of a loaded table, for both sides to move. Illegal positions aren't counted.
+struct TbInfo
+{
+  uint64_t positions, wins, draws, losses;
+  int longestMate; // Plies of the longest forced mate
+};
+
+// Returns false if the table of the material, for either color, is not loaded.
+bool tb_info(const char *material, TbInfo *info);
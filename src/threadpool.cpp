@@ -0,0 +1,141 @@
+#include "threadpool.h"
+
+// The worker running on the current thread, if it is one: the pool it belongs to and its index there. A worker
+// of one pool may submit to or wait on another, so the index only applies to its own pool.
+struct CurrentWorker
+{
+  const ThreadPool *pool;
+  int index;
+};
+static thread_local CurrentWorker currentWorker = { 0, -1 };
+
+// Index of the current thread among the workers of the given pool, or -1 if it is not one of them.
+static int worker_index(const ThreadPool *pool)
+{
+  return (currentWorker.pool == pool) ? currentWorker.index : -1;
+}
+
+ThreadPool::ThreadPool():workers(0), numWorkers(0), queuedTasks(0), nextQueue(0), quit(false)
+{
+}
+
+ThreadPool::~ThreadPool()
+{
+  stop();
+}
+
+void ThreadPool::start(int numThreads)
+{
+  stop();
+  if (numThreads <= 0) numThreads = (int)std::thread::hardware_concurrency();
+  if (numThreads <= 0) numThreads = 1;
+  quit = false;
+  queuedTasks = 0;
+  numWorkers = numThreads;
+  workers = new Worker[numThreads];
+  for(int i = 0; i < numThreads; ++i)
+    workers[i].thread = std::thread(worker_main, this, i);
+}
+
+void ThreadPool::stop()
+{
+  if (!workers) return;
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    quit = true;
+  }
+  wakeUp.notify_all();
+  for(int i = 0; i < numWorkers; ++i)
+    workers[i].thread.join();
+  delete[] workers;
+  workers = 0;
+  numWorkers = 0;
+}
+
+void ThreadPool::submit(TaskGroup &group, TaskFunc func, void *arg)
+{
+  Task task = { func, arg, &group };
+  group.pending.fetch_add(1, std::memory_order_relaxed);
+  if (!workers) // No workers, run inline
+  {
+    run(task);
+    return;
+  }
+
+  int self = worker_index(this);
+  int queue = (self >= 0) ? self : (int)(nextQueue.fetch_add(1, std::memory_order_relaxed) % numWorkers);
+  {
+    std::lock_guard<std::mutex> lock(workers[queue].mutex);
+    workers[queue].tasks.push_back(task);
+  }
+  queuedTasks.fetch_add(1);
+  // Take the sleep lock so that a worker that just found no work can't miss this wake up.
+  { std::lock_guard<std::mutex> lock(sleepMutex); }
+  wakeUp.notify_one();
+}
+
+bool ThreadPool::pop_or_steal(int self, Task *task)
+{
+  if (queuedTasks.load(std::memory_order_relaxed) == 0) return false;
+
+  if (self >= 0) // Newest task of our own deque first
+  {
+    std::lock_guard<std::mutex> lock(workers[self].mutex);
+    if (!workers[self].tasks.empty())
+    {
+      *task = workers[self].tasks.back();
+      workers[self].tasks.pop_back();
+      queuedTasks.fetch_sub(1);
+      return true;
+    }
+  }
+  for(int i = 1; i <= numWorkers; ++i) // Then the oldest task of someone else's
+  {
+    Worker &victim = workers[(self + i + numWorkers) % numWorkers];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty())
+    {
+      *task = victim.tasks.front();
+      victim.tasks.pop_front();
+      queuedTasks.fetch_sub(1);
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::run(const Task &task)
+{
+  task.func(task.arg);
+  task.group->pending.fetch_sub(1, std::memory_order_release);
+}
+
+void ThreadPool::wait(TaskGroup &group)
+{
+  while(group.pending.load(std::memory_order_acquire) > 0)
+  {
+    Task task;
+    if (workers && pop_or_steal(worker_index(this), &task)) run(task);
+    else std::this_thread::yield(); // The remaining tasks are running on other threads
+  }
+}
+
+void ThreadPool::worker_main(ThreadPool *pool, int index)
+{
+  currentWorker.pool = pool;
+  currentWorker.index = index;
+  for(;;)
+  {
+    Task task;
+    if (pool->pop_or_steal(index, &task))
+    {
+      pool->run(task);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(pool->sleepMutex);
+    if (pool->quit) break;
+    if (pool->queuedTasks.load() == 0) pool->wakeUp.wait(lock);
+  }
+  currentWorker.pool = 0;
+  currentWorker.index = -1;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+typedef void (*TaskFunc)(void *arg);
+
+// Counts the unfinished tasks submitted under it, see ThreadPool::wait().
+struct TaskGroup
+{
+  std::atomic<int> pending;
+  TaskGroup():pending(0) {}
+};
+
+// Fixed set of worker threads with one task deque each. A worker pushes and pops tasks it spawns at the
+// back of its own deque (depth first, cache warm), and when it runs dry steals the oldest task from the
+// front of another worker's deque, which tends to be the largest piece of remaining work.
+struct ThreadPool
+{
+  ThreadPool();
+  ~ThreadPool();
+
+  // Starts the given number of worker threads, or one per hardware thread if 0. Stops any running workers first.
+  void start(int numThreads);
+
+  // Waits for the workers to finish their current task and joins them. Tasks still queued are dropped.
+  void stop();
+
+  int size() const { return numWorkers; }
+
+  // Queues func(arg) to run on some worker. Called from a worker the task goes to its own deque,
+  // otherwise the deques are picked round robin.
+  void submit(TaskGroup &group, TaskFunc func, void *arg);
+
+  // Returns when all tasks of the group have finished. The calling thread runs queued tasks while it
+  // waits, so tasks may submit subtasks and wait for them without running out of workers.
+  void wait(TaskGroup &group);
+
+private:
+  struct Task
+  {
+    TaskFunc func;
+    void *arg;
+    TaskGroup *group;
+  };
+
+  struct Worker
+  {
+    std::thread thread;
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  Worker *workers;
+  int numWorkers;
+  std::atomic<int> queuedTasks;
+  std::atomic<unsigned> nextQueue;
+  std::atomic<bool> quit;
+  std::mutex sleepMutex;
+  std::condition_variable wakeUp;
+
+  bool pop_or_steal(int self, Task *task);
+  void run(const Task &task);
+  static void worker_main(ThreadPool *pool, int index);
+
+  ThreadPool(const ThreadPool &);
+  ThreadPool &operator=(const ThreadPool &);
+};
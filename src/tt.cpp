@@ -0,0 +1,148 @@
+#include "tt.h"
+#include <stdlib.h>
+
+// Layout of Entry::data, common to both kinds of entries:
+//   bits 0-7   depth (signed)
+//   bits 8-13  age of the search that stored the entry
+//   bits 14-15 bound type
+//   bits 16-63 search entries: bits 16-31 best move, bits 32-47 score
+//              perft entries: node count
+#define DATA_DEPTH(data) ((int8_t)((data) & 0xFF))
+#define DATA_AGE(data) (((data) >> 8) & 63)
+#define DATA_BOUND(data) (((data) >> 14) & 3)
+#define DATA_MOVE(data) ((move_t)((data) >> 16))
+#define DATA_SCORE(data) ((int16_t)((data) >> 32))
+#define DATA_NODES(data) ((data) >> 16)
+#define MAX_PERFT_NODES ((1ULL << 48) - 1)
+
+// Perft counts and search results of the same position must not be confused for each other.
+#define PERFT_KEY_SALT 0x5D1C8A3F67E2B94FULL
+
+TranspositionTable::TranspositionTable():buckets(0), numBuckets(0), allocation(0), age(0)
+{
+}
+
+TranspositionTable::~TranspositionTable()
+{
+  free(allocation);
+}
+
+bool TranspositionTable::resize(size_t megabytes)
+{
+  free(allocation);
+  numBuckets = megabytes * 1024 * 1024 / sizeof(Bucket);
+  allocation = numBuckets ? malloc(numBuckets * sizeof(Bucket) + 63) : 0;
+  if (!allocation)
+  {
+    buckets = 0;
+    numBuckets = 0;
+    return megabytes == 0;
+  }
+  buckets = (Bucket *)(((uintptr_t)allocation + 63) & ~(uintptr_t)63); // Align buckets to cache lines
+  clear();
+  return true;
+}
+
+void TranspositionTable::clear()
+{
+  for(size_t i = 0; i < numBuckets; ++i)
+    for(int j = 0; j < TT_BUCKET_SIZE; ++j)
+    {
+      buckets[i].entries[j].keyXorData.store(0, std::memory_order_relaxed);
+      buckets[i].entries[j].data.store(0, std::memory_order_relaxed);
+    }
+  age.store(0, std::memory_order_relaxed);
+}
+
+bool TranspositionTable::read(uint64_t key, uint64_t *data) const
+{
+  if (!numBuckets) return false;
+  const Bucket &bucket = bucket_for(key);
+  for(int i = 0; i < TT_BUCKET_SIZE; ++i)
+  {
+    uint64_t d = bucket.entries[i].data.load(std::memory_order_relaxed);
+    if ((bucket.entries[i].keyXorData.load(std::memory_order_relaxed) ^ d) == key && d)
+    {
+      *data = d;
+      return true;
+    }
+  }
+  return false;
+}
+
+void TranspositionTable::write(uint64_t key, uint64_t data, int depth)
+{
+  if (!numBuckets) return;
+  Bucket &bucket = bucket_for(key);
+
+  // Overwrite the entry of the same position if there is one, otherwise the least valuable entry,
+  // preferring shallow entries of old searches.
+  Entry *replace = &bucket.entries[0];
+  int lowestValue = 1 << 30;
+  uint64_t currentAge = current_age();
+  for(int i = 0; i < TT_BUCKET_SIZE; ++i)
+  {
+    Entry &entry = bucket.entries[i];
+    uint64_t d = entry.data.load(std::memory_order_relaxed);
+    if ((entry.keyXorData.load(std::memory_order_relaxed) ^ d) == key)
+    {
+      // Keep a deeper result of the current search for this position.
+      if (DATA_AGE(d) == currentAge && DATA_DEPTH(d) > depth + 2 && DATA_BOUND(d) == BOUND_EXACT) return;
+      replace = &entry;
+      break;
+    }
+    int value = DATA_DEPTH(d) - 8 * (int)((currentAge - DATA_AGE(d)) & 63);
+    if (value < lowestValue)
+    {
+      lowestValue = value;
+      replace = &entry;
+    }
+  }
+  replace->keyXorData.store(key ^ data, std::memory_order_relaxed);
+  replace->data.store(data, std::memory_order_relaxed);
+}
+
+bool TranspositionTable::probe(uint64_t key, TTData *data) const
+{
+  uint64_t d;
+  if (!read(key, &d)) return false;
+  data->move = DATA_MOVE(d);
+  data->score = DATA_SCORE(d);
+  data->depth = DATA_DEPTH(d);
+  data->bound = DATA_BOUND(d);
+  return true;
+}
+
+void TranspositionTable::store(uint64_t key, int depth, int score, int bound, move_t move)
+{
+  uint64_t data = (uint8_t)depth | ((uint64_t)current_age() << 8) | ((uint64_t)bound << 14) | ((uint64_t)move << 16) | ((uint64_t)(uint16_t)score << 32);
+  write(key, data, depth);
+}
+
+bool TranspositionTable::probe_perft(uint64_t key, int depth, uint64_t *nodes) const
+{
+  uint64_t d;
+  // The depth is part of the key, as the same position is reached at different remaining depths.
+  if (!read(key ^ PERFT_KEY_SALT ^ (uint64_t)depth, &d) || DATA_DEPTH(d) != depth) return false;
+  *nodes = DATA_NODES(d);
+  return true;
+}
+
+void TranspositionTable::store_perft(uint64_t key, int depth, uint64_t nodes)
+{
+  if (nodes > MAX_PERFT_NODES) return;
+  write(key ^ PERFT_KEY_SALT ^ (uint64_t)depth, (uint8_t)depth | ((uint64_t)current_age() << 8) | ((uint64_t)BOUND_EXACT << 14) | (nodes << 16), depth);
+}
+
+int TranspositionTable::hashfull() const
+{
+  int used = 0, sampled = 0;
+  uint64_t currentAge = current_age();
+  for(size_t i = 0; i < numBuckets && i < 1000 / TT_BUCKET_SIZE; ++i)
+    for(int j = 0; j < TT_BUCKET_SIZE; ++j, ++sampled)
+    {
+      uint64_t d = buckets[i].entries[j].data.load(std::memory_order_relaxed);
+      used += (d != 0 && DATA_AGE(d) == currentAge);
+    }
+  return sampled ? used * 1000 / sampled : 0;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "board.h"
+
+// Bound types of a stored search score.
+#define BOUND_NONE 0
+#define BOUND_UPPER 1 // Score is at most the stored value (failed low)
+#define BOUND_LOWER 2 // Score is at least the stored value (failed high)
+#define BOUND_EXACT (BOUND_UPPER|BOUND_LOWER)
+
+// Search result read back from the table.
+struct TTData
+{
+  move_t move;
+  int16_t score;
+  int8_t depth;
+  uint8_t bound;
+};
+
+// Fixed size hash table of search results and perft subtree counts, keyed by Board::hash.
+//
+// Any number of threads may probe and store at the same time without locking. Each entry stores the
+// key XORed with its data, so an entry that was torn by two threads writing it at once fails the key
+// check on probe and is treated as a miss, instead of returning data of another position.
+struct TranspositionTable
+{
+  TranspositionTable();
+  ~TranspositionTable();
+
+  // Reallocates the table to the given size and clears it. Returns false if the memory could not be
+  // allocated, in which case the table is empty. Must not be called while other threads use the table.
+  bool resize(size_t megabytes);
+
+  // Erases all entries. Must not be called while other threads use the table.
+  void clear();
+
+  // Call at the start of each new search, so that entries of earlier searches are replaced first. Searches
+  // sharing the table at the same time must share one age too, so call it once before starting them all.
+  void new_search() { age.store((age.load(std::memory_order_relaxed) + 1) & 63, std::memory_order_relaxed); }
+
+  // Returns true and fills in data if the position is in the table.
+  bool probe(uint64_t key, TTData *data) const;
+  void store(uint64_t key, int depth, int score, int bound, move_t move);
+
+  // Perft subtree node counts, kept apart from search results by salting the key.
+  bool probe_perft(uint64_t key, int depth, uint64_t *nodes) const;
+  void store_perft(uint64_t key, int depth, uint64_t nodes);
+
+  // Returns how many permille of a sample of entries are used by the current search.
+  int hashfull() const;
+
+private:
+  struct Entry
+  {
+    std::atomic<uint64_t> keyXorData;
+    std::atomic<uint64_t> data;
+  };
+
+  // One cache line of entries, all candidates for the same key.
+  #define TT_BUCKET_SIZE 4
+  struct alignas(64) Bucket
+  {
+    Entry entries[TT_BUCKET_SIZE];
+  };
+
+  Bucket *buckets;
+  size_t numBuckets;
+  void *allocation;
+  std::atomic<uint8_t> age; // Read by the threads storing entries while another may start a new search
+
+  uint8_t current_age() const { return age.load(std::memory_order_relaxed); }
+  Bucket &bucket_for(uint64_t key) const { return buckets[(size_t)(((key >> 32) * (uint64_t)numBuckets) >> 32)]; }
+  bool read(uint64_t key, uint64_t *data) const;
+  void write(uint64_t key, uint64_t data, int depth);
+
+  TranspositionTable(const TranspositionTable &);
+  TranspositionTable &operator=(const TranspositionTable &);
+};
@@ -1,28 +1,52 @@
 #include <stdio.h>
+#include <string.h>
 #include <GLES2/gl2.h>
 
 #ifdef __EMSCRIPTEN__
 #include <emscripten.h>
 #include <emscripten/html5.h>
-extern "C" void upload_unicode_char_to_texture(int unicodeChar, int charSize, bool applyShadow);
+extern "C" void upload_unicode_char_to_atlas(int unicodeChar, int charSize, bool applyShadow, int x, int y);
 EMSCRIPTEN_WEBGL_CONTEXT_HANDLE glContext;
 #endif // ~__EMSCRIPTEN__
 
 #include "board.h"
+#include "engine_channel.h"
+#include "renderer.h"
 
-GLuint quad, colorPos, matPos;
-GLuint textures[NUM_TEXTURES];
+Renderer renderer;
 Board board;
 int mouseHoverX = -1, mouseHoverY = -1;
 int mouseSelectX = -1, mouseSelectY = -1;
 bool uiNeedsRepaint = false;
 
+// Legal moves of the current position, generated once per move and used for the highlights and to validate clicks.
+struct LegalMoves
+{
+  bitboard_t movable; // Squares of the pieces that have a legal move
+  bitboard_t targets[64]; // Where the piece on each square can move to
+  int checkedKing; // Square of the king in check, -1 if none
+} legalMoves;
+
+// What each square showed when it was last drawn, see square_look(). Only the squares whose look changes are drawn again.
+#define LOOK_CHECK 0x100
+#define LOOK_TARGET 0x200
+#define LOOK_HOVER 0x400
+#define LOOK_SELECTED 0x800
+#define LOOK_UNKNOWN 0xFFFF
+uint16_t drawnLooks[64];
+
+// The engine plays black. Its searches run on the engine thread, and draw_board picks up the replies.
+EngineChannel engine;
+const int engineColor = BLACK;
+uint32_t engineSearchId = 0; // Of the search whose move the board waits for, 0 if none
+
 void create_context()
 {
 #ifdef __EMSCRIPTEN__
   EmscriptenWebGLContextAttributes attrs;
   emscripten_webgl_init_context_attributes(&attrs);
   attrs.alpha = 0;
+  attrs.preserveDrawingBuffer = 1; // Frames only draw the squares that changed on top of the previous one
   glContext = emscripten_webgl_create_context(0, &attrs);
   emscripten_webgl_make_context_current(glContext);
 #else
@@ -30,136 +54,78 @@ void create_context()
 #endif
 }
 
-GLuint compile_shader(GLenum shaderType, const char *src)
-{
-   GLuint shader = glCreateShader(shaderType);
-   glShaderSource(shader, 1, &src, NULL);
-   glCompileShader(shader);
-   return shader;
-}
-
-GLuint create_program(GLuint vertexShader, GLuint fragmentShader)
-{
-   GLuint program = glCreateProgram();
-   glAttachShader(program, vertexShader);
-   glAttachShader(program, fragmentShader);
-   glBindAttribLocation(program, 0, "pos");
-   glLinkProgram(program);
-   glUseProgram(program);
-   return program;
-}
-
 void init_gl()
 {
   create_context();
-
-  static const char vertex_shader[] =
-    "attribute vec4 pos;"
-    "varying vec2 uv;"
-    "uniform mat4 mat;"
-    "void main(){"
-      "uv=pos.xy;"
-      "gl_Position=mat*pos;"
-    "}";
-  GLuint vs = compile_shader(GL_VERTEX_SHADER, vertex_shader);
-
-  static const char fragment_shader[] =
-    "precision lowp float;"
-    "uniform sampler2D tex;"
-    "varying vec2 uv;"
-    "uniform vec4 color;"
-    "void main(){"
-      "gl_FragColor=color*texture2D(tex,uv);"
-    "}";
-  GLuint fs = compile_shader(GL_FRAGMENT_SHADER, fragment_shader);
-
-  GLuint program = create_program(vs, fs);
-  colorPos = glGetUniformLocation(program, "color");
-  matPos = glGetUniformLocation(program, "mat");
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-}
-
-GLuint create_texture()
-{
-  GLuint texture;
-  glGenTextures(1, &texture);
-  glBindTexture(GL_TEXTURE_2D, texture);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  return texture;
+  renderer.init();
+  for(int i = 0; i < 64; ++i) drawnLooks[i] = LOOK_UNKNOWN;
 }
 
 void load_assets()
 {
-  glGenBuffers(1, &quad);
-  glBindBuffer(GL_ARRAY_BUFFER, quad);
-  const float pos[] = { 0, 0, 1, 0, 0, 1, 1, 1 };
-  glBufferData(GL_ARRAY_BUFFER, sizeof(pos), pos, GL_STATIC_DRAW);
-  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
-  glEnableVertexAttribArray(0);
-
-  textures[NO_UNIT] = create_texture();
-  unsigned int whitePixel = 0xFFFFFFFF;
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, &whitePixel);
-
-  const int charSize = 60;
+  // The glyphs are rendered by the browser, straight into their cells of the atlas that init() left bound.
   for(int i = WHITE_KING_TEXTURE; i < NUM_TEXTURES; ++i)
   {
-    textures[i] = create_texture();
+    int x, y;
+    Renderer::atlas_cell_origin(i, &x, &y);
     const int UNICODE_WHITE_CHESS_KING = 0x2654;
-    upload_unicode_char_to_texture(UNICODE_WHITE_CHESS_KING + (i-1), charSize, IS_TEXTURE_FOR_WHITE_PIECE(i));
+    upload_unicode_char_to_atlas(UNICODE_WHITE_CHESS_KING + (i-1), GLYPH_SIZE, IS_TEXTURE_FOR_WHITE_PIECE(i), x, y);
   }
 }
 
-void draw(float x, float y, float w, float h, float r, float g, float b, float a, GLuint texture)
+void init_engine()
 {
-  float mat[16] = { w*2.f, 0, 0, 0, 0, h*2.f, 0, 0, 0, 0, 1, 0, x*2.f-1.f, y*2.f-1.f, 0, 1};
-  glUniformMatrix4fv(matPos, 1, 0, mat);
-  glUniform4f(colorPos, r, g, b, a);
-  glBindTexture(GL_TEXTURE_2D, texture);
-  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  engine.start(2); // The browser heap is small
 }
 
-const float boardScale = 1.f / 8.f; // TODO: Make this scale dynamically to resize to full screen size
-
-void draw_piece(float x, float y, int piece)
+void start_engine_search()
 {
-  int textureIndex = (IS_WHITE_PIECE(piece) ? SOLID_COLOR_TEXTURE : WHITE_PAWN_TEXTURE) + PIECE_TYPE(piece);
-  const float verticalOffset = -1.f / 480.f;
-  if (IS_WHITE_PIECE(piece)) draw(x * boardScale, y * boardScale + verticalOffset, boardScale, boardScale, 1.f, 1.f, 1.f, 1.f, textures[textureIndex]);
-  else draw(x * boardScale, y * boardScale + verticalOffset, boardScale, boardScale, 0.f, 0.f, 0.f, 1.f, textures[textureIndex]);
-}
-
-void draw_solid(float x, float y, float r, float g, float b, float a)
-{
-  draw(x * boardScale, y * boardScale, boardScale, boardScale, r, g, b, a, textures[SOLID_COLOR_TEXTURE]);
+  SearchLimits limits;
+#if ENGINE_THREADS
+  limits.movetime = 1000;
+#else
+  limits.movetime = 100; // Runs on the frame thread, see EngineChannel::poll()
+#endif
+  engineSearchId = engine.search(board, limits);
 }
 
-void draw_background()
+void update_legal_moves()
 {
-  for(int i = 0, y = 0; y < 8; ++y, ++i)
-    for(int x = 0; x < 8; ++x, ++i)
-    {
-      if (i % 2 == 0) draw_solid(x, y, 0.463f, 0.589f, 0.337f, 1.f); // Black background
-      else draw_solid(x, y, 0.933f, 0.933f, 0.834f, 1.f); // White background
-    }
+  MoveList list;
+  board.generate_all_moves(list);
+  legalMoves.movable = 0;
+  memset(legalMoves.targets, 0, sizeof(legalMoves.targets));
+  for(int i = 0; i < list.size; ++i)
+  {
+    legalMoves.movable |= SQUARE_BIT(MOVE_SRC(list.moves[i]));
+    legalMoves.targets[MOVE_SRC(list.moves[i])] |= SQUARE_BIT(MOVE_DST(list.moves[i]));
+  }
+  legalMoves.checkedKing = -1;
+  if (board.is_king_in_check(board.currentPlayer))
+    legalMoves.checkedKing = lsb(board.pieces[COLOR_INDEX(board.currentPlayer)][KING]);
 }
 
-void draw_pieces()
+// Applies the engine's move once it has one. Never waits for the engine.
+void poll_engine()
 {
-  for(int y = 0; y < 8; ++y)
-    for(int x = 0; x < 8; ++x)
-      if (board.board[y][x])
-        draw_piece(x, y, board.board[y][x]);
+  EngineResult result;
+  while(engine.poll(&result))
+  {
+    if (result.type != ENGINE_RESULT_BESTMOVE || result.searchId != engineSearchId) continue; // Info lines and stale replies
+    engineSearchId = 0;
+    if (result.bestMove) board.make_move(result.bestMove);
+    update_legal_moves();
+    uiNeedsRepaint = true;
+  }
 }
 
 void make_move(int srcX, int srcY, int dstX, int dstY)
 {
-  if (!board.is_valid_move(srcX, srcY, dstX, dstY)) return;
+  if (!(legalMoves.targets[SQUARE(srcX, srcY)] & SQUARE_BIT(SQUARE(dstX, dstY)))) return;
   board.make_move(srcX, srcY, dstX, dstY);
+  update_legal_moves();
   mouseSelectX = -1;
+  if (board.currentPlayer == engineColor) start_engine_search();
 }
 
 EM_BOOL mouse_callback(int eventType, const EmscriptenMouseEvent *e, void *)
@@ -185,9 +151,16 @@ EM_BOOL mouse_callback(int eventType, const EmscriptenMouseEvent *e, void *)
       }
       break;
     case EMSCRIPTEN_EVENT_MOUSEDOWN:
+      if (engineSearchId)
+      {
+        // Clicking while the engine thinks makes it move now, with the best move it has found so far, which
+        // poll_engine plays when it comes back. Nothing to stop until it has completed an iteration.
+        if (engine.best_move(engineSearchId)) engine.cancel();
+        break;
+      }
       if (mouseSelectX == -1)
       {
-        if (PLAYER_COLOR(board.At(x, y)) == board.currentPlayer && board.has_valid_moves(x, y))
+        if (legalMoves.movable & SQUARE_BIT(SQUARE(x, y)))
           mouseSelectX = x, mouseSelectY = y;
       }
       else if (mouseSelectX == x && mouseSelectY == y) mouseSelectX = -1;
@@ -198,38 +171,53 @@ EM_BOOL mouse_callback(int eventType, const EmscriptenMouseEvent *e, void *)
   return EM_FALSE;
 }
 
+// The highlights and the piece that the square should show now.
+uint16_t square_look(int square)
+{
+  uint16_t look = board.board[SQUARE_Y(square)][SQUARE_X(square)];
+  if (square == legalMoves.checkedKing) look |= LOOK_CHECK;
+  if (mouseSelectX >= 0 && (legalMoves.targets[SQUARE(mouseSelectX, mouseSelectY)] & SQUARE_BIT(square))) look |= LOOK_TARGET;
+  if (mouseHoverX >= 0 && square == SQUARE(mouseHoverX, mouseHoverY)) look |= LOOK_HOVER;
+  if (mouseSelectX >= 0 && square == SQUARE(mouseSelectX, mouseSelectY)) look |= LOOK_SELECTED;
+  return look;
+}
+
 void draw_board()
 {
+  poll_engine();
   if (!uiNeedsRepaint) return;
-  glBindBuffer(GL_ARRAY_BUFFER, quad); // TODO: Remove this line, specified as a workaround to -s OFFSCREEN_FRAMEBUFFER=1 bug
-  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0); // TODO: Remove this line, specified as a workaround to -s OFFSCREEN_FRAMEBUFFER=1 bug
-  glEnableVertexAttribArray(0); // TODO: Remove this line, specified as a workaround to -s OFFSCREEN_FRAMEBUFFER=1 bug
-  glDisable(GL_BLEND);
-  draw_background();
-  glEnable(GL_BLEND);
-  // Draw a hint square if king is in check
-  if (board.is_king_in_check(board.currentPlayer))
+  uiNeedsRepaint = false;
+  bitboard_t dirty = 0;
+  for(int i = 0; i < 64; ++i)
   {
-    int kingX, kingY;
-    board.find_king(board.currentPlayer == WHITE ? WHITE_KING : BLACK_KING, &kingX, &kingY);
-    draw_solid(kingX, kingY, 1.f, 0.3f, 0.3f, 0.8f);
+    uint16_t look = square_look(i);
+    if (look != drawnLooks[i]) dirty |= SQUARE_BIT(i);
+    drawnLooks[i] = look;
   }
-  // If player has activate a piece for move, draw hint squares for legal positions to move to.
-  if (mouseSelectX >= 0)
+  if (!dirty) return;
+
+  // The changed squares are built on the CPU and drawn in at most two calls, see Renderer::flush().
+  renderer.begin();
+  renderer.add_background(dirty);
+  for(bitboard_t squares = dirty; squares; squares &= squares - 1)
   {
-    int moves[48*2];
-    int *end = board.generate_moves(mouseSelectX, mouseSelectY, moves);
-    for(int *m = moves; m != end; m += 2)
-      draw_solid(m[0], m[1], 1.f, 0.8f, 0.6f, 0.8f);
+    int x = SQUARE_X(lsb(squares)), y = SQUARE_Y(lsb(squares));
+    uint16_t look = drawnLooks[lsb(squares)];
+    if (look & LOOK_CHECK) renderer.add_square(x, y, 1.f, 0.3f, 0.3f, 0.8f); // Hint square for a king in check
+    if (look & LOOK_TARGET) renderer.add_square(x, y, 1.f, 0.8f, 0.6f, 0.8f); // Legal destinations of the selected piece
+    if (look & LOOK_HOVER) renderer.add_square(x, y, 0.7f, 0.7f, 1.f, 0.6f); // Highlight square under mouse cursor
+    if (look & LOOK_SELECTED) renderer.add_square(x, y, 0.5f, 0.5f, 1.f, 1.f); // Even stronger highlight square under the selected piece
   }
-  if (mouseHoverX >= 0) draw_solid(mouseHoverX, mouseHoverY, 0.7f, 0.7f, 1.f, 0.6f); // Draw highlight square under mouse cursor
-  if (mouseSelectX >= 0) draw_solid(mouseSelectX, mouseSelectY, 0.5f, 0.5f, 1.f, 1.f); // Draw even stronger highlight square under the selected piece
-  draw_pieces();
-  uiNeedsRepaint = false;
+  renderer.add_pieces(board, dirty);
+  renderer.flush();
 }
 
 void new_game()
 {
+  engine.cancel();
+  engineSearchId = 0;
   board.new_game();
+  mouseSelectX = -1;
+  update_legal_moves();
   uiNeedsRepaint = true;
 }
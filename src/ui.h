@@ -2,6 +2,7 @@
 
 void init_gl();
 void load_assets();
+void init_engine();
 void new_game();
 void draw_board();
 
@@ -0,0 +1,165 @@
+// Throughput benchmark of evaluate_batch() over positions sampled from random games.
+//
+// Usage: tiny_chess_batch [options]
+//   -positions N      Number of positions in the batch (default 1000000)
+//   -repeat N         Number of times to evaluate the whole batch (default 5)
+//   -threads N        Split the batch over N threads (default 1)
+//   -seed N           Seed of the random games (default 1)
+//   -verify           Check every result against the one position at a time Board functions
+//
+// Exits with a nonzero status if -verify finds a mismatch.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "batch.h"
+#include "evaluate.h"
+#include "threadpool.h"
+
+static uint64_t rngState;
+
+static uint64_t next_random()
+{
+  rngState ^= rngState >> 12;
+  rngState ^= rngState << 25;
+  rngState ^= rngState >> 27;
+  return rngState * 2685821657736338717ULL;
+}
+
+// Plays random games from the initial position and adds every position along the way, until the batch is full.
+static void fill_batch(PositionBatch &batch, int numPositions)
+{
+  Board board;
+  MoveList list;
+  board.new_game();
+  while(batch.size < numPositions)
+  {
+    board.generate_all_moves(list);
+    if (!list.size || board.halfmoveClock >= 100 || board.historyLength >= 300) board.new_game();
+    else board.make_move(list.moves[next_random() % list.size]);
+    batch.add(board);
+  }
+}
+
+// The same score as evaluate_batch() computes, from the Board functions.
+static int reference_score(const Board &board)
+{
+  int score = 0;
+  for(int side = 0; side < 2; ++side)
+  {
+    int color = side ? BLACK : WHITE;
+    int material = popcount(board.controlled_squares(color) & ~board.pieces[side][NO_UNIT]) * BATCH_MOBILITY_WEIGHT;
+    for(int pieceType = QUEEN; pieceType <= PAWN; ++pieceType)
+      material += popcount(board.pieces[side][pieceType]) * pieceValues[pieceType];
+    score += side ? -material : material;
+  }
+  return (board.currentPlayer == WHITE) ? score : -score;
+}
+
+static int verify(const PositionBatch &batch, const BatchResults &results)
+{
+  int failures = 0;
+  Board board;
+  MoveList list;
+  for(int i = 0; i < batch.size && failures < 10; ++i)
+  {
+    batch.get(i, board);
+    board.generate_all_moves(list);
+    int inCheck = board.is_king_in_check(board.currentPlayer);
+    int score = reference_score(board);
+    if (results.legalMoves[i] != list.size || results.inCheck[i] != inCheck || results.scores[i] != score)
+    {
+      printf("FAIL  position %d: moves %d/%d, check %d/%d, score %d/%d (batch/reference)\n", i,
+        results.legalMoves[i], list.size, results.inCheck[i], inCheck, results.scores[i], score);
+      ++failures;
+    }
+  }
+  return failures;
+}
+
+struct BatchTask
+{
+  const PositionBatch *batch;
+  BatchResults *results;
+  int begin, end;
+};
+
+static void run_batch_task(void *arg)
+{
+  BatchTask *task = (BatchTask *)arg;
+  evaluate_batch(*task->batch, task->begin, task->end, *task->results);
+}
+
+int main(int argc, char **argv)
+{
+  int numPositions = 1000000, repeat = 5, numThreads = 1;
+  bool doVerify = false;
+  rngState = 1;
+
+  for(int i = 1; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "-positions") && i+1 < argc) numPositions = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-repeat") && i+1 < argc) repeat = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-threads") && i+1 < argc) numThreads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-seed") && i+1 < argc) rngState = strtoull(argv[++i], 0, 10) | 1;
+    else if (!strcmp(argv[i], "-verify")) doVerify = true;
+    else
+    {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+  if (numPositions < 1 || repeat < 1 || numThreads < 1)
+  {
+    fprintf(stderr, "Invalid options\n");
+    return 2;
+  }
+
+  static PositionBatch batch;
+  static BatchResults results;
+  if (!batch.reserve(numPositions) || !results.reserve(numPositions))
+  {
+    fprintf(stderr, "Unable to allocate %d positions\n", numPositions);
+    return 2;
+  }
+  fill_batch(batch, numPositions);
+
+  static ThreadPool pool;
+  if (numThreads > 1) pool.start(numThreads);
+  BatchTask *tasks = new BatchTask[numThreads];
+  for(int t = 0; t < numThreads; ++t)
+  {
+    tasks[t].batch = &batch;
+    tasks[t].results = &results;
+    tasks[t].begin = (int)((int64_t)batch.size * t / numThreads);
+    tasks[t].end = (int)((int64_t)batch.size * (t + 1) / numThreads);
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for(int r = 0; r < repeat; ++r)
+  {
+    TaskGroup group;
+    for(int t = 0; t < numThreads; ++t)
+      pool.submit(group, run_batch_task, &tasks[t]);
+    pool.wait(group);
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  double positionsPerSecond = seconds > 0 ? (double)batch.size * repeat / seconds : 0.0;
+#ifdef __AVX2__
+  const char *kernel = "avx2";
+#else
+  const char *kernel = "scalar";
+#endif
+  printf("%d positions x %d, %d threads, %s kernel: %.3f s, %.2f Mpositions/s, %.2f Mpositions/s per core\n", batch.size, repeat,
+    numThreads, kernel, seconds, positionsPerSecond / 1e6, positionsPerSecond / 1e6 / numThreads);
+
+  delete[] tasks;
+  if (doVerify)
+  {
+    int failures = verify(batch, results);
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures ? 1 : 0;
+  }
+  return 0;
+}
@@ -0,0 +1,383 @@
+// Microbenchmarks of the public Board operations over a fixed corpus of middlegame and endgame positions.
+//
+// Usage: tiny_chess_bench [options]
+//   -runs N             Time each benchmark N times and keep the fastest run (default 5)
+//   -mintime MS         Repeat each run over the corpus until it has taken at least MS milliseconds (default 100)
+//   -filter name        Only run the benchmarks whose name contains the given string
+//   -json file.json     Write the results as JSON, "-" for stdout
+//   -baseline file.json Compare against results written earlier with -json
+//   -tolerance PERCENT  Regression allowed against the baseline before failing (default 10)
+//
+// Exits with a nonzero status if any benchmark is more than -tolerance percent slower than in the baseline.
+// Times are in nanoseconds per operation; make_move counts a make_move and the unmake_move after it as one.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "board.h"
+
+// Middlegames with both sides castled, uncastled, with open files and with locked centers, then endgames from
+// pawn endings to queen endings. The last few are in check, so that the check evasion paths get timed too.
+static const char *corpus[] = {
+  "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+  "r1bq1rk1/pp2bppp/2n1pn2/2pp4/3P4/2PBPN2/PP1N1PPP/R1BQ1RK1 w - - 0 8",
+  "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+  "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+  "r2q1rk1/pb1nbppp/1p2pn2/2pp4/2PP4/1PN1PN2/PB2BPPP/R2Q1RK1 b - - 3 10",
+  "2rq1rk1/pp1bppbp/3p1np1/4n3/3NP3/1BN1BP2/PPPQ2PP/2KR3R w - - 9 13",
+  "r1b2rk1/2q1bppp/p2ppn2/1p6/3BPP2/2NB4/PPPQ2PP/2KR3R b - - 2 13",
+  "rnbqkb1r/pp3ppp/4pn2/2pp4/3P1B2/4PN2/PPP2PPP/RN1QKB1R w KQkq c6 0 5",
+  "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+  "8/8/4k3/3p4/3P1K2/8/8/8 w - - 0 1",
+  "8/5pk1/6p1/7p/3R3P/6P1/r4PK1/8 b - - 3 41",
+  "6k1/5ppp/8/8/8/8/1B3PPP/6K1 w - - 0 1",
+  "8/8/3k4/8/2Q5/8/4K3/3q4 w - - 0 60",
+  "8/3b4/2k5/8/1P6/2K1N3/8/8 b - - 0 55",
+  "rnb1kbnr/pppp1ppp/8/4p3/6Pq/5P2/PPPPP2P/RNBQKBNR w KQkq - 1 3",
+  "r1bqkbnr/ppp2Qpp/2np4/4p3/2B1P3/8/PPPP1PPP/RNB1K1NR b KQkq - 0 4",
+  "8/8/8/4k3/8/8/3r4/4K3 w - - 0 50",
+};
+#define NUM_POSITIONS ((int)(sizeof(corpus) / sizeof(corpus[0])))
+
+// A (src, dst) pair asked from is_valid_move, legal or not.
+struct Query
+{
+  int8_t srcX, srcY, dstX, dstY;
+};
+
+// Each position with what the benchmarks need precomputed, so that only the operation itself is timed.
+struct Position
+{
+  Board board;
+  MoveList moves;
+  int numPieces; // Squares with a piece of the side to move
+  int8_t pieceX[16], pieceY[16];
+  int numQueries;
+  Query queries[128];
+};
+
+static Position positions[NUM_POSITIONS];
+
+// Results are folded into this, so that the compiler can't drop the calls being timed.
+static volatile uint64_t sink;
+
+static bool setup_positions()
+{
+  uint32_t rng = 12345;
+  for(int i = 0; i < NUM_POSITIONS; ++i)
+  {
+    Position &p = positions[i];
+    if (!p.board.load_fen(corpus[i]))
+    {
+      fprintf(stderr, "Invalid FEN in the corpus: %s\n", corpus[i]);
+      return false;
+    }
+    p.board.generate_all_moves(p.moves);
+    p.numPieces = 0;
+    for(int y = 0; y < 8; ++y)
+      for(int x = 0; x < 8; ++x)
+        if (PLAYER_COLOR(p.board.board[y][x]) == p.board.currentPlayer && p.numPieces < 16)
+        {
+          p.pieceX[p.numPieces] = (int8_t)x;
+          p.pieceY[p.numPieces] = (int8_t)y;
+          ++p.numPieces;
+        }
+    // Half of the queries are legal moves, the other half go from a piece of the side to move to a random square.
+    p.numQueries = 0;
+    for(int j = 0; j < p.moves.size && p.numQueries < 64; ++j)
+    {
+      move_t m = p.moves.moves[j];
+      p.queries[p.numQueries++] = { (int8_t)SQUARE_X(MOVE_SRC(m)), (int8_t)SQUARE_Y(MOVE_SRC(m)), (int8_t)SQUARE_X(MOVE_DST(m)), (int8_t)SQUARE_Y(MOVE_DST(m)) };
+    }
+    for(int j = 0; j < 64 && p.numPieces > 0; ++j)
+    {
+      rng = rng * 1664525 + 1013904223;
+      int piece = (rng >> 16) % p.numPieces, dst = (rng >> 8) & 63;
+      p.queries[p.numQueries++] = { p.pieceX[piece], p.pieceY[piece], (int8_t)SQUARE_X(dst), (int8_t)SQUARE_Y(dst) };
+    }
+  }
+  return true;
+}
+
+// One pass of a benchmark over the whole corpus. Returns the number of operations done.
+typedef int (*BenchFunc)();
+
+static int bench_new_game()
+{
+  static Board board;
+  uint64_t sum = 0;
+  for(int i = 0; i < NUM_POSITIONS; ++i)
+  {
+    board.new_game();
+    sum += board.hash;
+  }
+  sink += sum;
+  return NUM_POSITIONS;
+}
+
+static int bench_make_move()
+{
+  int ops = 0;
+  uint64_t sum = 0;
+  for(int i = 0; i < NUM_POSITIONS; ++i)
+  {
+    Board &board = positions[i].board;
+    const MoveList &moves = positions[i].moves;
+    for(int j = 0; j < moves.size; ++j)
+    {
+      board.make_move(moves.moves[j]);
+      sum += board.hash;
+      board.unmake_move();
+    }
+    ops += moves.size;
+  }
+  sink += sum;
+  return ops;
+}
+
+static int bench_generate_moves()
+{
+  int ops = 0;
+  uint64_t sum = 0;
+  int moves[48*2];
+  for(int i = 0; i < NUM_POSITIONS; ++i)
+  {
+    Position &p = positions[i];
+    for(int j = 0; j < p.numPieces; ++j)
+      sum += p.board.generate_moves(p.pieceX[j], p.pieceY[j], moves) - moves;
+    ops += p.numPieces;
+  }
+  sink += sum;
+  return ops;
+}
+
+static int bench_is_valid_move()
+{
+  int ops = 0;
+  uint64_t sum = 0;
+  for(int i = 0; i < NUM_POSITIONS; ++i)
+  {
+    Position &p = positions[i];
+    for(int j = 0; j < p.numQueries; ++j)
+      sum += p.board.is_valid_move(p.queries[j].srcX, p.queries[j].srcY, p.queries[j].dstX, p.queries[j].dstY);
+    ops += p.numQueries;
+  }
+  sink += sum;
+  return ops;
+}
+
+static int bench_has_valid_moves()
+{
+  int ops = 0;
+  uint64_t sum = 0;
+  for(int i = 0; i < NUM_POSITIONS; ++i)
+  {
+    Position &p = positions[i];
+    for(int j = 0; j < p.numPieces; ++j)
+      sum += p.board.has_valid_moves(p.pieceX[j], p.pieceY[j]);
+    ops += p.numPieces;
+  }
+  sink += sum;
+  return ops;
+}
+
+static int bench_is_king_in_check()
+{
+  uint64_t sum = 0;
+  for(int i = 0; i < NUM_POSITIONS; ++i)
+    sum += positions[i].board.is_king_in_check(WHITE) + positions[i].board.is_king_in_check(BLACK);
+  sink += sum;
+  return NUM_POSITIONS * 2;
+}
+
+static int bench_mark_controlled_squares()
+{
+  uint64_t sum = 0;
+  int squares[8][8];
+  for(int i = 0; i < NUM_POSITIONS; ++i)
+  {
+    positions[i].board.mark_controlled_squares(WHITE, squares);
+    sum += squares[3][4];
+    positions[i].board.mark_controlled_squares(BLACK, squares);
+    sum += squares[4][3];
+  }
+  sink += sum;
+  return NUM_POSITIONS * 2;
+}
+
+static int bench_find_king()
+{
+  uint64_t sum = 0;
+  for(int i = 0; i < NUM_POSITIONS; ++i)
+  {
+    int x = 0, y = 0;
+    positions[i].board.find_king(WHITE_KING, &x, &y);
+    sum += x + y;
+    positions[i].board.find_king(BLACK_KING, &x, &y);
+    sum += x + y;
+  }
+  sink += sum;
+  return NUM_POSITIONS * 2;
+}
+
+struct Benchmark
+{
+  const char *name;
+  BenchFunc func;
+  double nsPerOp; // Fastest of the runs
+  uint64_t ops;   // Operations in that run, 0 if not run yet
+};
+
+static Benchmark benchmarks[] = {
+  { "new_game", bench_new_game, 0, 0 },
+  { "make_move", bench_make_move, 0, 0 },
+  { "generate_moves", bench_generate_moves, 0, 0 },
+  { "is_valid_move", bench_is_valid_move, 0, 0 },
+  { "has_valid_moves", bench_has_valid_moves, 0, 0 },
+  { "is_king_in_check", bench_is_king_in_check, 0, 0 },
+  { "mark_controlled_squares", bench_mark_controlled_squares, 0, 0 },
+  { "find_king", bench_find_king, 0, 0 },
+};
+#define NUM_BENCHMARKS ((int)(sizeof(benchmarks) / sizeof(benchmarks[0])))
+
+// Times one run of the benchmark and keeps it if it is the fastest so far.
+static void run_benchmark(Benchmark &b, double minSeconds)
+{
+  if (b.ops == 0) b.func(); // Warm up the caches and the branch predictors before the first run
+  uint64_t ops = 0;
+  double seconds = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  do
+  {
+    for(int i = 0; i < 16; ++i) ops += b.func(); // Check the clock only every 16 passes
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  } while(seconds < minSeconds);
+  double nsPerOp = seconds * 1e9 / ops;
+  if (b.ops == 0 || nsPerOp < b.nsPerOp)
+  {
+    b.nsPerOp = nsPerOp;
+    b.ops = ops;
+  }
+}
+
+static void write_json(FILE *handle)
+{
+  fprintf(handle, "{\n  \"positions\": %d,\n  \"benchmarks\": {\n", NUM_POSITIONS);
+  bool first = true;
+  for(int i = 0; i < NUM_BENCHMARKS; ++i)
+  {
+    if (benchmarks[i].ops == 0) continue;
+    fprintf(handle, "%s    \"%s\": { \"ns_per_op\": %.3f, \"ops\": %llu }", first ? "" : ",\n", benchmarks[i].name, benchmarks[i].nsPerOp, (unsigned long long)benchmarks[i].ops);
+    first = false;
+  }
+  fprintf(handle, "\n  }\n}\n");
+}
+
+// Reads the whole file into a null terminated buffer that the caller frees, or returns null.
+static char *read_file(const char *filename)
+{
+  FILE *handle = fopen(filename, "rb");
+  if (!handle) return 0;
+  fseek(handle, 0, SEEK_END);
+  long size = ftell(handle);
+  fseek(handle, 0, SEEK_SET);
+  char *data = (size >= 0) ? (char *)malloc(size + 1) : 0;
+  if (data && fread(data, 1, size, handle) == (size_t)size) data[size] = 0;
+  else
+  {
+    free(data);
+    data = 0;
+  }
+  fclose(handle);
+  return data;
+}
+
+// Finds "name": { "ns_per_op": x } in JSON written by write_json. Returns false if the benchmark is not there.
+static bool find_baseline(const char *json, const char *name, double *nsPerOp)
+{
+  char key[64];
+  snprintf(key, sizeof(key), "\"%s\"", name);
+  const char *p = strstr(json, key);
+  if (!p) return false;
+  const char *end = strchr(p, '}');
+  p = strstr(p, "\"ns_per_op\"");
+  if (!p || (end && p > end)) return false;
+  return sscanf(p, "\"ns_per_op\" : %lf", nsPerOp) == 1;
+}
+
+int main(int argc, char **argv)
+{
+  int runs = 5;
+  double minSeconds = 0.1, tolerance = 10;
+  const char *filter = 0, *jsonFile = 0, *baselineFile = 0;
+
+  for(int i = 1; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "-runs") && i+1 < argc) runs = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-mintime") && i+1 < argc) minSeconds = atof(argv[++i]) / 1000.0;
+    else if (!strcmp(argv[i], "-filter") && i+1 < argc) filter = argv[++i];
+    else if (!strcmp(argv[i], "-json") && i+1 < argc) jsonFile = argv[++i];
+    else if (!strcmp(argv[i], "-baseline") && i+1 < argc) baselineFile = argv[++i];
+    else if (!strcmp(argv[i], "-tolerance") && i+1 < argc) tolerance = atof(argv[++i]);
+    else
+    {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+  if (runs < 1) runs = 1;
+
+  char *baseline = 0;
+  if (baselineFile && !(baseline = read_file(baselineFile)))
+  {
+    fprintf(stderr, "Unable to read the baseline %s\n", baselineFile);
+    return 2;
+  }
+  if (!setup_positions()) return 2;
+
+  // With the JSON on stdout the table goes to stderr, so that the output can be piped into a file as is.
+  FILE *table = (jsonFile && !strcmp(jsonFile, "-")) ? stderr : stdout;
+  // The runs of different benchmarks are interleaved, so that a slow spell of the machine, e.g. from another
+  // process or frequency scaling, doesn't make all the runs of one benchmark slow.
+  for(int run = 0; run < runs; ++run)
+    for(int i = 0; i < NUM_BENCHMARKS; ++i)
+      if (!filter || strstr(benchmarks[i].name, filter))
+        run_benchmark(benchmarks[i], minSeconds);
+
+  int regressions = 0;
+  for(int i = 0; i < NUM_BENCHMARKS; ++i)
+  {
+    Benchmark &b = benchmarks[i];
+    if (b.ops == 0) continue;
+    fprintf(table, "%-24s %10.1f ns/op", b.name, b.nsPerOp);
+    double base;
+    if (baseline && find_baseline(baseline, b.name, &base) && base > 0)
+    {
+      double change = (b.nsPerOp - base) * 100.0 / base;
+      bool regressed = change > tolerance;
+      regressions += regressed;
+      fprintf(table, "  baseline %10.1f ns/op  %+6.1f%%%s", base, change, regressed ? "  REGRESSION" : "");
+    }
+    else if (baseline) fprintf(table, "  not in baseline");
+    fprintf(table, "\n");
+  }
+  fflush(table);
+
+  if (jsonFile && !strcmp(jsonFile, "-")) write_json(stdout);
+  else if (jsonFile)
+  {
+    FILE *handle = fopen(jsonFile, "w");
+    if (!handle)
+    {
+      fprintf(stderr, "Unable to write %s\n", jsonFile);
+      return 2;
+    }
+    write_json(handle);
+    fclose(handle);
+  }
+
+  free(baseline);
+  if (regressions) fprintf(table, "%d benchmark%s regressed more than %.1f%% against %s\n", regressions, regressions == 1 ? "" : "s", tolerance, baselineFile);
+  return regressions ? 1 : 0;
+}
@@ -0,0 +1,193 @@
+// Builds Polyglot opening books from PGN files, and lists the book moves of a position.
+//
+// Usage: tiny_chess_book [options] -build out.bin file.pgn [file2.pgn ...]
+//        tiny_chess_book [options] -probe book.bin [-fen "<fen>"] [-moves m1 m2 ...]
+//   -plies N          Only put the first N plies of each game in the book (default 24)
+//
+// Like Polyglot, a move scores 2 for each game it was played in and won, and 1 for each draw.
+// Moves that only lost are left out.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "book.h"
+#include "mapped_file.h"
+#include "pgn.h"
+
+#define CHUNK_BYTES (1 << 20)
+
+struct BookBuilder
+{
+  PolyglotEntry *entries;
+  size_t numEntries, capacity;
+  int maxPlies;
+};
+
+static bool add_entry(BookBuilder &builder, uint64_t key, uint16_t move, int score)
+{
+  if (builder.numEntries == builder.capacity)
+  {
+    size_t capacity = builder.capacity ? builder.capacity * 2 : 65536;
+    PolyglotEntry *entries = (PolyglotEntry *)realloc(builder.entries, capacity * sizeof(PolyglotEntry));
+    if (!entries) return false;
+    builder.entries = entries;
+    builder.capacity = capacity;
+  }
+  PolyglotEntry &entry = builder.entries[builder.numEntries++];
+  entry.key = key;
+  entry.move = move;
+  entry.weight = (uint16_t)score;
+  entry.learn = 0;
+  return true;
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+  const PolyglotEntry *x = (const PolyglotEntry *)a, *y = (const PolyglotEntry *)b;
+  if (x->key != y->key) return (x->key < y->key) ? -1 : 1;
+  return (int)x->move - (int)y->move;
+}
+
+// Adds the first plies of the game to the builder. Returns false on an illegal move or out of memory.
+static bool add_game(BookBuilder &builder, const PgnGame &game, Board &board)
+{
+  if (game.tag("FEN")) return true; // Not from the initial position
+  int whiteScore = !strcmp(game.result, "1-0") ? 2 : !strcmp(game.result, "1/2-1/2") ? 1 : 0;
+  int blackScore = !strcmp(game.result, "0-1") ? 2 : !strcmp(game.result, "1/2-1/2") ? 1 : 0;
+  board.new_game();
+  for(int i = 0; i < game.numMoves && i < builder.maxPlies; ++i)
+  {
+    move_t move = board.parse_san_move(game.moves[i]);
+    if (!move) return false;
+    int score = (board.currentPlayer == WHITE) ? whiteScore : blackScore;
+    if (score && !add_entry(builder, polyglot_key(board), move_to_polyglot(move), score)) return false;
+    board.make_move(move);
+  }
+  return true;
+}
+
+static int build_book(const char *outFilename, char **pgnFilenames, int numPgnFiles, int maxPlies)
+{
+  BookBuilder builder = { 0, 0, 0, maxPlies };
+  static Board board;
+  Arena arena;
+  int games = 0, errors = 0;
+  for(int f = 0; f < numPgnFiles; ++f)
+  {
+    MappedFile file;
+    if (!file.open(pgnFilenames[f], true))
+    {
+      fprintf(stderr, "Unable to open %s\n", pgnFilenames[f]);
+      return 2;
+    }
+    const char *p = (const char *)file.data, *end = p + file.size;
+    while(p < end)
+    {
+      const char *chunkEnd = (end - p > CHUNK_BYTES) ? find_pgn_game_start(p + CHUNK_BYTES, end) : end;
+      arena.reset();
+      for(const PgnGame *game = parse_pgn(p, chunkEnd - p, arena, &errors); game; game = game->next, ++games)
+        errors += !add_game(builder, *game, board);
+      p = chunkEnd;
+    }
+  }
+
+  // Merge the entries of the same move in the same position, then scale all weights to fit 16 bits.
+  qsort(builder.entries, builder.numEntries, sizeof(PolyglotEntry), compare_entries);
+  uint64_t *weights = (uint64_t *)malloc((builder.numEntries + 1) * sizeof(uint64_t));
+  size_t numMerged = 0;
+  uint64_t maxWeight = 1;
+  for(size_t i = 0; i < builder.numEntries; ++i)
+  {
+    if (numMerged > 0 && !compare_entries(&builder.entries[numMerged - 1], &builder.entries[i])) weights[numMerged - 1] += builder.entries[i].weight;
+    else builder.entries[numMerged] = builder.entries[i], weights[numMerged++] = builder.entries[i].weight;
+    if (weights[numMerged - 1] > maxWeight) maxWeight = weights[numMerged - 1];
+  }
+
+  FILE *out = fopen(outFilename, "wb");
+  if (!out)
+  {
+    fprintf(stderr, "Unable to create %s\n", outFilename);
+    return 2;
+  }
+  for(size_t i = 0; i < numMerged; ++i)
+  {
+    uint64_t weight = (maxWeight > 65535) ? weights[i] * 65535 / maxWeight : weights[i];
+    builder.entries[i].weight = (uint16_t)(weight ? weight : 1);
+    uint8_t bytes[16];
+    write_polyglot_entry(builder.entries[i], bytes);
+    fwrite(bytes, sizeof(bytes), 1, out);
+  }
+  fclose(out);
+  free(weights);
+  free(builder.entries);
+  printf("%d games, %d errors, %llu entries written to %s\n", games, errors, (unsigned long long)numMerged, outFilename);
+  return errors ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+  const char *buildFilename = 0, *probeFilename = 0, *fen = 0;
+  int maxPlies = 24, firstArg = argc;
+
+  for(int i = 1; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "-build") && i+1 < argc) buildFilename = argv[++i];
+    else if (!strcmp(argv[i], "-probe") && i+1 < argc) probeFilename = argv[++i];
+    else if (!strcmp(argv[i], "-fen") && i+1 < argc) fen = argv[++i];
+    else if (!strcmp(argv[i], "-plies") && i+1 < argc) maxPlies = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-moves")) { firstArg = i+1; break; }
+    else if (argv[i][0] != '-') { firstArg = i; break; }
+    else
+    {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+
+  if (buildFilename) return build_book(buildFilename, argv + firstArg, argc - firstArg, maxPlies);
+  if (!probeFilename)
+  {
+    fprintf(stderr, "Usage: tiny_chess_book -build out.bin file.pgn ... or tiny_chess_book -probe book.bin\n");
+    return 2;
+  }
+
+  static Board board;
+  board.new_game();
+  if (fen && !board.load_fen(fen))
+  {
+    fprintf(stderr, "Invalid FEN: %s\n", fen);
+    return 2;
+  }
+  for(int i = firstArg; i < argc; ++i)
+  {
+    move_t move = board.parse_uci_move(argv[i]);
+    if (!move) move = board.parse_san_move(argv[i]);
+    if (!move)
+    {
+      fprintf(stderr, "Illegal move: %s\n", argv[i]);
+      return 2;
+    }
+    board.make_move(move);
+  }
+
+  static OpeningBook book;
+  if (!book.open(probeFilename))
+  {
+    fprintf(stderr, "Unable to open %s\n", probeFilename);
+    return 2;
+  }
+  BookMove moves[MAX_BOOK_MOVES];
+  int numMoves = book.probe(board, moves, MAX_BOOK_MOVES);
+  int totalWeight = 0;
+  for(int i = 0; i < numMoves; ++i)
+    totalWeight += moves[i].weight;
+  printf("key %016llx, %d book moves\n", (unsigned long long)polyglot_key(board), numMoves);
+  for(int i = 0; i < numMoves; ++i)
+  {
+    char san[MAX_SAN_LENGTH];
+    board.move_to_san(moves[i].move, san);
+    printf("%-8s weight %5d %5.1f%%\n", san, moves[i].weight, 100.0 * moves[i].weight / totalWeight);
+  }
+  return 0;
+}
@@ -0,0 +1,317 @@
+// Runs the perft and best move checks of an EPD test suite, in parallel over all records.
+//
+// Usage: tiny_chess_epd [options] file.epd
+//   -depth N          Only check perft counts up to this depth (default 6)
+//   -searchdepth N    Depth to search best move records to (default 6 unless -nodes or -movetime are given)
+//   -nodes N          Nodes to search best move records for
+//   -movetime MS      Milliseconds to search best move records for
+//   -noperft          Skip the perft checks
+//   -nosearch         Skip the best move checks
+//   -threads N        Number of threads (default one per hardware thread)
+//   -hash MB          Transposition table size shared by all threads (default 16)
+//   -verbose          Print a line for each record that passes too
+//
+// Each line is a FEN or EPD position followed by operations separated by semicolons:
+//   D<n> <count>      Perft count at depth n, e.g. "D5 4865609", as in the usual perft suites
+//   bm <moves>        The search must pick one of the given moves
+//   am <moves>        The search must not pick any of the given moves
+//   id "<name>"       Name of the record for the report
+// Moves are in standard algebraic notation, or in UCI long algebraic notation. Lines starting with # are comments.
+//
+// The file is memory mapped and scanned in place, a wave of chunks of lines at a time, so memory use does not
+// grow with the file size and no record is copied anywhere but to a buffer on the stack.
+//
+// Exits with a nonzero status if any record fails or can't be parsed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "board.h"
+#include "mapped_file.h"
+#include "perft.h"
+#include "search.h"
+#include "threadpool.h"
+
+#define MAX_LINE_LENGTH 1024
+#define CHUNK_LINES 16 // Lines per task, small enough to spread a short suite of slow searches over all threads
+#define CHUNK_BYTES (1 << 20)
+#define MAX_CHUNKS_IN_FLIGHT 256
+#define MAX_EPD_MOVES 16
+
+static int maxPerftDepth = 6;
+static bool doPerft = true, doSearch = true, verbose = false;
+static SearchLimits searchLimits;
+static TranspositionTable tt;
+
+struct RunnerStats
+{
+  uint64_t records, passed, failed, invalid, perftNodes, searchNodes;
+};
+
+struct Chunk
+{
+  const char *begin, *end;
+  RunnerStats stats;
+  Board board;
+  Searcher *searcher; // Allocated on the first best move record, and reused for the chunks that later use this slot
+};
+
+// Reads the moves of a bm or am operation. Returns false if some move is not legal in the position.
+static bool parse_epd_moves(Board &board, const char *args, move_t *moves, int *numMoves)
+{
+  *numMoves = 0;
+  char token[16];
+  int len;
+  while(sscanf(args, " %15[^ ;]%n", token, &len) == 1)
+  {
+    args += len;
+    move_t move = board.parse_san_move(token);
+    if (!move) move = board.parse_uci_move(token);
+    if (!move) return false;
+    if (*numMoves < MAX_EPD_MOVES) moves[(*numMoves)++] = move;
+  }
+  return true;
+}
+
+static bool contains(const move_t *moves, int numMoves, move_t move)
+{
+  for(int i = 0; i < numMoves; ++i)
+    if (moves[i] == move) return true;
+  return false;
+}
+
+// Checks one record. The line is a zero terminated copy on the caller's stack, and is modified.
+static void run_record(Chunk &chunk, char *line)
+{
+  RunnerStats &stats = chunk.stats;
+  Board &board = chunk.board;
+  const char *ops;
+  if (!board.load_fen(line, &ops))
+  {
+    printf("FAIL  invalid FEN: %s\n", line);
+    ++stats.invalid;
+    return;
+  }
+  ++stats.records;
+
+  char name[MAX_LINE_LENGTH] = "";
+  move_t bestMoves[MAX_EPD_MOVES], avoidMoves[MAX_EPD_MOVES];
+  int numBestMoves = 0, numAvoidMoves = 0;
+  bool ok = true;
+  char message[256] = "";
+
+  // Split the operations at semicolons, but not at those inside a quoted name.
+  char *op = line + (ops - line);
+  while(*op)
+  {
+    while(*op == ' ' || *op == ';') ++op;
+    if (!*op) break;
+    char *end = op;
+    for(bool quoted = false; *end && (quoted || *end != ';'); ++end)
+      if (*end == '"') quoted = !quoted;
+    char next = *end;
+    *end = 0;
+
+    int depth;
+    unsigned long long expected;
+    if (!strncmp(op, "id ", 3))
+    {
+      const char *start = strchr(op, '"');
+      const char *stop = start ? strchr(start + 1, '"') : 0;
+      if (stop) memcpy(name, start + 1, stop - start - 1), name[stop - start - 1] = 0;
+    }
+    else if (!strncmp(op, "bm ", 3) || !strncmp(op, "am ", 3))
+    {
+      bool best = (op[0] == 'b');
+      if (!parse_epd_moves(board, op + 3, best ? bestMoves : avoidMoves, best ? &numBestMoves : &numAvoidMoves))
+      {
+        snprintf(message, sizeof(message), "illegal move in \"%s\"", op);
+        ok = false;
+      }
+    }
+    else if (sscanf(op, "D%d %llu", &depth, &expected) == 2 && doPerft && depth <= maxPerftDepth)
+    {
+      uint64_t nodes = perft(board, depth, &tt);
+      stats.perftNodes += nodes;
+      if (nodes != expected && ok)
+      {
+        snprintf(message, sizeof(message), "depth %d: expected %llu, got %llu", depth, expected, (unsigned long long)nodes);
+        ok = false;
+      }
+    }
+
+    *end = next;
+    op = end;
+  }
+
+  if (ok && doSearch && (numBestMoves || numAvoidMoves))
+  {
+    if (!chunk.searcher)
+    {
+      chunk.searcher = new Searcher;
+      chunk.searcher->tt = &tt;
+    }
+    // The chunks in flight share the table, and main starts its new search once per wave of them.
+    move_t move = chunk.searcher->think(board, searchLimits, false);
+    stats.searchNodes += chunk.searcher->result.nodes;
+    if ((numBestMoves && !contains(bestMoves, numBestMoves, move)) || contains(avoidMoves, numAvoidMoves, move))
+    {
+      char uci[6] = "0000";
+      if (move) move_to_uci(move, uci);
+      snprintf(message, sizeof(message), "search played %s", uci);
+      ok = false;
+    }
+  }
+
+  // Print the name, or the position if the record has none.
+  if (!name[0])
+  {
+    size_t len = ops - line;
+    memcpy(name, line, len);
+    while(len > 0 && name[len-1] == ' ') --len;
+    name[len] = 0;
+  }
+  if (ok)
+  {
+    ++stats.passed;
+    if (verbose) printf("ok    %s\n", name);
+  }
+  else
+  {
+    ++stats.failed;
+    printf("FAIL  %s: %s\n", name, message);
+  }
+}
+
+static void run_chunk(void *arg)
+{
+  Chunk &chunk = *(Chunk *)arg;
+  char line[MAX_LINE_LENGTH];
+  for(const char *p = chunk.begin; p < chunk.end; )
+  {
+    const char *eol = (const char *)memchr(p, '\n', chunk.end - p);
+    if (!eol) eol = chunk.end;
+    size_t len = eol - p;
+    while(len > 0 && (p[len-1] == '\r' || p[len-1] == ' ')) --len;
+    if (len >= MAX_LINE_LENGTH)
+    {
+      printf("FAIL  line longer than %d chars\n", MAX_LINE_LENGTH - 1);
+      ++chunk.stats.invalid;
+    }
+    else if (len > 0 && p[0] != '#')
+    {
+      memcpy(line, p, len);
+      line[len] = 0;
+      run_record(chunk, line);
+    }
+    p = eol + 1;
+  }
+}
+
+// Returns the end of the chunk starting at p: after CHUNK_LINES lines or at the first line end past CHUNK_BYTES.
+static const char *chunk_end(const char *p, const char *end)
+{
+  const char *limit = (end - p > CHUNK_BYTES) ? p + CHUNK_BYTES : end;
+  for(int lines = 0; p < limit && lines < CHUNK_LINES; ++lines)
+  {
+    const char *eol = (const char *)memchr(p, '\n', limit - p);
+    p = eol ? eol + 1 : limit;
+  }
+  if (p < end && p[-1] != '\n') // Hit the byte limit in the middle of a line
+  {
+    const char *eol = (const char *)memchr(p, '\n', end - p);
+    p = eol ? eol + 1 : end;
+  }
+  return p;
+}
+
+int main(int argc, char **argv)
+{
+  int numThreads = 0, hashMegabytes = 16;
+  const char *filename = 0;
+
+  for(int i = 1; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "-depth") && i+1 < argc) maxPerftDepth = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-searchdepth") && i+1 < argc) searchLimits.depth = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-nodes") && i+1 < argc) searchLimits.nodes = strtoull(argv[++i], 0, 10);
+    else if (!strcmp(argv[i], "-movetime") && i+1 < argc) searchLimits.movetime = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-threads") && i+1 < argc) numThreads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-hash") && i+1 < argc) hashMegabytes = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-noperft")) doPerft = false;
+    else if (!strcmp(argv[i], "-nosearch")) doSearch = false;
+    else if (!strcmp(argv[i], "-verbose")) verbose = true;
+    else if (argv[i][0] != '-' && !filename) filename = argv[i];
+    else
+    {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+  if (!filename)
+  {
+    fprintf(stderr, "Usage: tiny_chess_epd [options] file.epd\n");
+    return 2;
+  }
+  if (!searchLimits.depth && !searchLimits.nodes && !searchLimits.movetime) searchLimits.depth = 6;
+  if (!tt.resize(hashMegabytes))
+  {
+    fprintf(stderr, "Unable to allocate %d MB of hash\n", hashMegabytes);
+    return 2;
+  }
+
+  MappedFile file;
+  if (!file.open(filename, true))
+  {
+    fprintf(stderr, "Unable to open %s\n", filename);
+    return 2;
+  }
+
+  static ThreadPool pool;
+  pool.start(numThreads);
+  Chunk *chunks = new Chunk[MAX_CHUNKS_IN_FLIGHT];
+  for(int i = 0; i < MAX_CHUNKS_IN_FLIGHT; ++i)
+    chunks[i].searcher = 0;
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  RunnerStats total = {};
+  const char *p = (const char *)file.data, *end = p + file.size;
+  while(p < end)
+  {
+    TaskGroup group;
+    int numChunks = 0;
+    tt.new_search();
+    for(; p < end && numChunks < MAX_CHUNKS_IN_FLIGHT; ++numChunks)
+    {
+      Chunk &chunk = chunks[numChunks];
+      chunk.begin = p;
+      chunk.end = p = chunk_end(p, end);
+      memset(&chunk.stats, 0, sizeof(chunk.stats));
+      pool.submit(group, run_chunk, &chunk);
+    }
+    pool.wait(group);
+    for(int i = 0; i < numChunks; ++i)
+    {
+      const RunnerStats &s = chunks[i].stats;
+      total.records += s.records;
+      total.passed += s.passed;
+      total.failed += s.failed;
+      total.invalid += s.invalid;
+      total.perftNodes += s.perftNodes;
+      total.searchNodes += s.searchNodes;
+    }
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  for(int i = 0; i < MAX_CHUNKS_IN_FLIGHT; ++i)
+    delete chunks[i].searcher;
+  delete[] chunks;
+
+  bool failed = total.failed || total.invalid;
+  printf("%s: %llu records, %llu passed, %llu failed, %llu invalid, %llu perft nodes, %llu search nodes, %.3f s, %.0f records/s\n",
+    failed ? "FAILED" : "PASSED", (unsigned long long)total.records, (unsigned long long)total.passed, (unsigned long long)total.failed,
+    (unsigned long long)total.invalid, (unsigned long long)total.perftNodes, (unsigned long long)total.searchNodes, seconds,
+    seconds > 0 ? total.records / seconds : 0.0);
+  return failed ? 1 : 0;
+}
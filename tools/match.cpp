@@ -0,0 +1,382 @@
+// Self-play match between two players, many games at once on all cores, with an SPRT to stop as soon as the
+// result is clear. Each opening is played twice, with colors swapped.
+//
+// Usage: tiny_chess_match [options]
+//   -a player         First player, whose result is reported (default depth=4)
+//   -b player         Second player (default random)
+//   -games N          Most games to play (default 1000)
+//   -threads N        Play games on N threads at once (default 0, one per hardware thread)
+//   -hash MB          Transposition table size of each searching player on each thread (default 1)
+//   -openings N       Random plies played before each game pair (default 8)
+//   -maxplies N       Adjudicate a draw after this many plies (default 400)
+//   -sprt E0 E1       Elo bounds of the hypotheses (default 0 10)
+//   -alpha A          False positive rate (default 0.05)
+//   -beta B           False negative rate (default 0.05)
+//   -seed N           Seed of the openings and the random players (default 1)
+//   -eval file        Load piece values and piece-square tables for both players, see load_evaluation()
+//   -nnue file.nnue   Evaluate with the given HalfKP 256x2-32-32 network in both players' searches, see nnue.h
+//
+// Players: random (uniform random legal moves), greedy (the move with the best static evaluation, mate first),
+// or the built-in search with depth=N, nodes=N, movetime=MS or tc=SECONDS+INCREMENT, e.g. tc=10+0.1, a game clock
+// that the search budgets its moves from and that loses the game if it runs out.
+//
+// Games end by mate, stalemate, threefold repetition, the 50 move rule, insufficient material, a clock running
+// out or -maxplies.
+// Each thread keeps its boards, move lists, searchers and tables for all its games, so playing allocates nothing.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <mutex>
+#include "board.h"
+#include "evaluate.h"
+#include "nnue.h"
+#include "search.h"
+#include "threadpool.h"
+
+#define MIN(x, y) ((x) <= (y) ? (x) : (y))
+#define MAX(x, y) ((x) >= (y) ? (x) : (y))
+
+#define PLAYER_RANDOM 0
+#define PLAYER_GREEDY 1
+#define PLAYER_SEARCH 2
+
+struct PlayerSpec
+{
+  int type;
+  SearchLimits limits;
+  const char *name;
+};
+
+static bool parse_player(const char *str, PlayerSpec *spec)
+{
+  spec->name = str;
+  spec->type = PLAYER_SEARCH;
+  spec->limits = SearchLimits();
+  if (!strcmp(str, "random")) spec->type = PLAYER_RANDOM;
+  else if (!strcmp(str, "greedy")) spec->type = PLAYER_GREEDY;
+  else if (!strncmp(str, "depth=", 6)) spec->limits.depth = atoi(str + 6);
+  else if (!strncmp(str, "nodes=", 6)) spec->limits.nodes = strtoull(str + 6, 0, 10);
+  else if (!strncmp(str, "movetime=", 9)) spec->limits.movetime = atoi(str + 9);
+  else if (!strncmp(str, "tc=", 3))
+  {
+    // The same clock for both colors, the one of the color played is used.
+    char *end;
+    spec->limits.time[0] = spec->limits.time[1] = (int)(strtod(str + 3, &end) * 1000);
+    if (*end == '+') spec->limits.increment[0] = spec->limits.increment[1] = (int)(strtod(end + 1, &end) * 1000);
+    if (*end) return false;
+  }
+  else return false;
+  return spec->type != PLAYER_SEARCH || spec->limits.depth > 0 || spec->limits.nodes > 0 || spec->limits.movetime > 0
+    || spec->limits.time[0] > 0;
+}
+
+#define RESULT_WHITE_WINS 0
+#define RESULT_BLACK_WINS 1
+#define RESULT_DRAW 2
+
+#define END_MATE 0
+#define END_STALEMATE 1
+#define END_REPETITION 2
+#define END_FIFTY_MOVES 3
+#define END_MATERIAL 4
+#define END_LENGTH 5
+#define END_TIME 6
+#define NUM_ENDS 7
+static const char *endNames[NUM_ENDS] = { "mate", "stalemate", "repetition", "50 moves", "material", "length", "time" };
+
+static uint64_t next_random(uint64_t *state)
+{
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 2685821657736338717ULL;
+}
+
+// Options, shared read only by all threads.
+static PlayerSpec players[2];
+static int maxGames = 1000, openingPlies = 8, maxPlies = 400, hashMegabytes = 1;
+static double elo0 = 0, elo1 = 10, alpha = 0.05, beta = 0.05;
+static uint64_t seed = 1;
+
+// Results so far, from the point of view of player A.
+static std::mutex resultsMutex;
+static int wins, draws, losses, ends[NUM_ENDS];
+static std::atomic<int> nextGame(0);
+static std::atomic<bool> sprtDone(false);
+static std::chrono::steady_clock::time_point startTime;
+
+// Everything one thread needs to play its games, set up once.
+struct MatchWorker
+{
+  Board board;
+  MoveList list, replies;
+  Searcher searchers[2];
+  TranspositionTable tts[2];
+  uint64_t rng;
+};
+
+static bool is_insufficient_material(const Board &board)
+{
+  const bitboard_t (*p)[7] = board.pieces;
+  if (p[0][PAWN] | p[1][PAWN] | p[0][ROOK] | p[1][ROOK] | p[0][QUEEN] | p[1][QUEEN]) return false;
+  return !more_than_one(p[0][KNIGHT] | p[1][KNIGHT] | p[0][BISHOP] | p[1][BISHOP]);
+}
+
+// Returns true and sets the result if the game is over. Leaves the legal moves in worker.list.
+static bool adjudicate(MatchWorker &worker, int *result, int *end)
+{
+  Board &board = worker.board;
+  board.generate_all_moves(worker.list);
+  *result = RESULT_DRAW;
+  if (!worker.list.size)
+  {
+    bool mate = board.is_king_in_check(board.currentPlayer);
+    if (mate) *result = (board.currentPlayer == WHITE) ? RESULT_BLACK_WINS : RESULT_WHITE_WINS;
+    *end = mate ? END_MATE : END_STALEMATE;
+  }
+  else if (board.halfmoveClock >= 100) *end = END_FIFTY_MOVES;
+  else if (board.repetition_count() >= 2) *end = END_REPETITION;
+  else if (is_insufficient_material(board)) *end = END_MATERIAL;
+  else if (board.historyLength >= maxPlies) *end = END_LENGTH;
+  else return false;
+  return true;
+}
+
+// The legal move with the best static evaluation for the player to move, a mate if there is one. Ties go to a random one.
+static move_t greedy_move(MatchWorker &worker)
+{
+  Board &board = worker.board;
+  const MoveList &moves = worker.list;
+  move_t best = NO_MOVE;
+  int bestScore = -SCORE_INFINITE, numBest = 0;
+  for(int i = 0; i < moves.size; ++i)
+  {
+    board.make_move(moves.moves[i]);
+    board.generate_all_moves(worker.replies);
+    int score;
+    if (!worker.replies.size) score = board.is_king_in_check(board.currentPlayer) ? SCORE_MATE : 0;
+    else score = -evaluate(board);
+    board.unmake_move();
+    if (score > bestScore) bestScore = score, best = moves.moves[i], numBest = 1;
+    else if (score == bestScore && next_random(&worker.rng) % ++numBest == 0) best = moves.moves[i];
+  }
+  return best;
+}
+
+static move_t pick_move(MatchWorker &worker, int player, const SearchLimits &limits)
+{
+  switch(players[player].type)
+  {
+  case PLAYER_RANDOM: return worker.list.moves[next_random(&worker.rng) % worker.list.size];
+  case PLAYER_GREEDY: return greedy_move(worker);
+  default: return worker.searchers[player].think(worker.board, limits);
+  }
+}
+
+// Plays game number game and returns its result for player A: 1 for a win, 0 for a draw, -1 for a loss.
+static int play_game(MatchWorker &worker, int game, int *end)
+{
+  Board &board = worker.board;
+  board.new_game();
+
+  // Both games of a pair start from the same random opening, one with A as white and the other with A as black.
+  uint64_t openingRng = seed ^ ((uint64_t)(game / 2) * 0x9E3779B97F4A7C15ULL);
+  next_random(&openingRng);
+  for(int ply = 0; ply < openingPlies; ++ply)
+  {
+    board.generate_all_moves(worker.list);
+    if (!worker.list.size) break;
+    board.make_move(worker.list.moves[next_random(&openingRng) % worker.list.size]);
+  }
+  int whitePlayer = game & 1;
+  for(int i = 0; i < 2; ++i) worker.tts[i].clear();
+  int clocks[2] = { players[0].limits.time[0], players[1].limits.time[0] }; // Milliseconds left, 0 without a clock
+
+  int result;
+  while(!adjudicate(worker, &result, end))
+  {
+    int player = (board.currentPlayer == WHITE) ? whitePlayer : 1 - whitePlayer;
+    SearchLimits limits = players[player].limits;
+    limits.time[COLOR_INDEX(board.currentPlayer)] = clocks[player];
+    limits.time[1 - COLOR_INDEX(board.currentPlayer)] = clocks[1 - player];
+    std::chrono::steady_clock::time_point moveStart = std::chrono::steady_clock::now();
+    move_t move = pick_move(worker, player, limits);
+    if (clocks[player])
+    {
+      clocks[player] -= (int)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - moveStart).count();
+      if (clocks[player] <= 0)
+      {
+        result = (board.currentPlayer == WHITE) ? RESULT_BLACK_WINS : RESULT_WHITE_WINS;
+        *end = END_TIME;
+        break;
+      }
+      clocks[player] += limits.increment[COLOR_INDEX(board.currentPlayer)];
+    }
+    if (!move) move = worker.list.moves[0]; // A stopped search, can't happen without a stop flag
+    board.make_move(move);
+  }
+  if (result == RESULT_DRAW) return 0;
+  return ((result == RESULT_WHITE_WINS) == (whitePlayer == 0)) ? 1 : -1;
+}
+
+// Elo difference of the given expected score.
+static double score_to_elo(double score)
+{
+  return -400.0 * log10(1.0 / score - 1.0);
+}
+
+static double elo_to_score(double elo)
+{
+  return 1.0 / (1.0 + pow(10.0, -elo / 400.0));
+}
+
+// Log likelihood ratio of elo1 against elo0 for the games so far, with the normal approximation of the trinomial
+// distribution of the game results. Half a game of each result is added, so that one sided results, e.g. all wins,
+// still have a variance.
+static double log_likelihood_ratio(int w, int d, int l)
+{
+  if (!(w + d + l)) return 0;
+  double pw = w + 0.5, pd = d + 0.5, pl = l + 0.5, n = pw + pd + pl;
+  double score = (pw + 0.5 * pd) / n;
+  double variance = (pw * (1 - score) * (1 - score) + pd * (0.5 - score) * (0.5 - score) + pl * score * score) / n;
+  double s0 = elo_to_score(elo0), s1 = elo_to_score(elo1);
+  return n * (s1 - s0) * (2 * score - s0 - s1) / (2 * variance);
+}
+
+static void print_results(const char *prefix)
+{
+  int n = wins + draws + losses;
+  double score = n ? (wins + 0.5 * draws) / n : 0.5;
+  char elo[48] = "Elo unbounded"; // All wins or all losses
+  if (n && score > 0 && score < 1)
+  {
+    // 95% confidence interval of the score, mapped to Elo.
+    double variance = (wins * (1 - score) * (1 - score) + draws * (0.5 - score) * (0.5 - score) + losses * score * score) / n;
+    double deviation = 1.96 * sqrt(variance / n);
+    double margin = (score_to_elo(MIN(score + deviation, 0.999)) - score_to_elo(MAX(score - deviation, 0.001))) / 2;
+    snprintf(elo, sizeof(elo), "Elo %.1f +- %.1f", score_to_elo(score), margin);
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+  printf("%s %d games in %.1f s, %s vs %s: +%d =%d -%d, score %.1f%%, %s, LLR %.2f [%.2f, %.2f]\n", prefix, n, seconds,
+    players[0].name, players[1].name, wins, draws, losses, score * 100, elo,
+    log_likelihood_ratio(wins, draws, losses), log(beta / (1 - alpha)), log((1 - beta) / alpha));
+  fflush(stdout);
+}
+
+static void record_result(int result, int end)
+{
+  std::lock_guard<std::mutex> lock(resultsMutex);
+  if (sprtDone.load()) return; // The test is already decided, games still running don't count
+  if (result > 0) ++wins;
+  else if (result < 0) ++losses;
+  else ++draws;
+  ++ends[end];
+
+  double llr = log_likelihood_ratio(wins, draws, losses);
+  if (llr >= log((1 - beta) / alpha) || llr <= log(beta / (1 - alpha))) sprtDone = true;
+  int n = wins + draws + losses;
+  if (n % 100 == 0 && !sprtDone.load()) print_results("After");
+}
+
+static void run_worker(void *arg)
+{
+  MatchWorker &worker = *(MatchWorker *)arg;
+  for(;;)
+  {
+    int game = nextGame.fetch_add(1);
+    if (game >= maxGames || sprtDone.load()) return;
+    int end;
+    int result = play_game(worker, game, &end);
+    record_result(result, end);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int numThreads = 0;
+  parse_player("depth=4", &players[0]);
+  parse_player("random", &players[1]);
+
+  for(int i = 1; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "-a") && i+1 < argc && parse_player(argv[i+1], &players[0])) ++i;
+    else if (!strcmp(argv[i], "-b") && i+1 < argc && parse_player(argv[i+1], &players[1])) ++i;
+    else if (!strcmp(argv[i], "-games") && i+1 < argc) maxGames = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-threads") && i+1 < argc) numThreads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-hash") && i+1 < argc) hashMegabytes = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-openings") && i+1 < argc) openingPlies = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-maxplies") && i+1 < argc) maxPlies = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-sprt") && i+2 < argc) elo0 = atof(argv[++i]), elo1 = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-alpha") && i+1 < argc) alpha = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-beta") && i+1 < argc) beta = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-seed") && i+1 < argc) seed = strtoull(argv[++i], 0, 10);
+    else if (!strcmp(argv[i], "-nnue") && i+1 < argc)
+    {
+      if (!nnue_load(argv[++i]))
+      {
+        fprintf(stderr, "Unable to load a HalfKP 256x2-32-32 network from %s\n", argv[i]);
+        return 2;
+      }
+    }
+    else if (!strcmp(argv[i], "-eval") && i+1 < argc)
+    {
+      if (!load_evaluation(argv[++i]))
+      {
+        fprintf(stderr, "Unable to load the evaluation from %s\n", argv[i]);
+        return 2;
+      }
+    }
+    else
+    {
+      fprintf(stderr, "Unknown option or player %s\n", argv[i]);
+      return 2;
+    }
+  }
+  // The board keeps at most MAX_HISTORY plies of history.
+  if (maxGames < 1 || numThreads < 0 || hashMegabytes < 1 || openingPlies < 0 || maxPlies < 1 || maxPlies >= MAX_HISTORY
+    || elo1 <= elo0 || alpha <= 0 || alpha >= 1 || beta <= 0 || beta >= 1)
+  {
+    fprintf(stderr, "Invalid options\n");
+    return 2;
+  }
+
+  static ThreadPool pool;
+  pool.start(numThreads);
+  int numWorkers = pool.size();
+  MatchWorker *workers = new MatchWorker[numWorkers];
+  for(int t = 0; t < numWorkers; ++t)
+  {
+    workers[t].rng = (seed + t + 1) * 0x2545F4914F6CDD1DULL | 1;
+    for(int i = 0; i < 2; ++i)
+    {
+      if (players[i].type != PLAYER_SEARCH) continue;
+      if (!workers[t].tts[i].resize(hashMegabytes))
+      {
+        fprintf(stderr, "Unable to allocate %d MB of hash\n", hashMegabytes);
+        return 2;
+      }
+      workers[t].searchers[i].tt = &workers[t].tts[i];
+    }
+  }
+
+  printf("%s vs %s, up to %d games on %d threads, SPRT elo0 %.1f elo1 %.1f alpha %.3f beta %.3f\n", players[0].name,
+    players[1].name, maxGames, numWorkers, elo0, elo1, alpha, beta);
+  startTime = std::chrono::steady_clock::now();
+  TaskGroup group;
+  for(int t = 0; t < numWorkers; ++t)
+    pool.submit(group, run_worker, &workers[t]);
+  pool.wait(group);
+
+  double llr = log_likelihood_ratio(wins, draws, losses);
+  print_results("Finished:");
+  printf("Ends:");
+  for(int i = 0; i < NUM_ENDS; ++i) printf(" %s %d%s", endNames[i], ends[i], i + 1 < NUM_ENDS ? "," : "\n");
+  if (llr >= log((1 - beta) / alpha)) printf("SPRT: H1 accepted, %s is at least %.1f Elo stronger\n", players[0].name, elo1);
+  else if (llr <= log(beta / (1 - alpha))) printf("SPRT: H0 accepted, %s is not %.1f Elo stronger\n", players[0].name, elo1);
+  else printf("SPRT: inconclusive\n");
+  delete[] workers;
+  return 0;
+}
@@ -0,0 +1,265 @@
+// Headless perft driver for the move generator in board.cpp.
+//
+// Usage: tiny_chess_perft [options]
+//   -depth N          Search depth (default 5)
+//   -fen "<fen>"      Start from the given position instead of the initial position
+//   -moves m1 m2 ...  Apply the given moves in UCI notation (e.g. e2e4) first, must be the last option
+//   -divide           Print the node count under each root move
+//   -suite file.epd   Check the node counts of each line "<fen> ;D1 n1 ;D2 n2 ..." up to -depth
+//   -check            Check the node counts of the built-in reference positions up to -depth
+//   -hash MB          Cache subtree node counts in a transposition table of the given size
+//   -threads N        Count subtrees in parallel on N threads (0 for one per hardware thread)
+//   -scaling          Time the position on 1, 2, 4, ... up to -threads threads and print the speedup
+//
+// Exits with a nonzero status if any count differs from the reference.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "board.h"
+#include "perft.h"
+#include "threadpool.h"
+
+static TranspositionTable tt;
+static bool useHash = false;
+static ThreadPool pool;
+
+// Number of plies from the root at which the tree is split into parallel tasks. Two plies give some
+// four hundred tasks in typical positions, enough for the workers to balance out uneven subtrees.
+#define SPLIT_PLIES 2
+
+struct PerftTask
+{
+  Board board;
+  int depth;
+  int splitPlies;
+  uint64_t nodes;
+};
+
+static uint64_t parallel_perft(Board &board, int depth, int splitPlies);
+
+static void run_perft_task(void *arg)
+{
+  PerftTask *task = (PerftTask *)arg;
+  task->nodes = parallel_perft(task->board, task->depth, task->splitPlies);
+}
+
+// Like perft(), but each subtree of the first splitPlies plies is counted in its own task on its own
+// copy of the board. All tasks share the transposition table.
+static uint64_t parallel_perft(Board &board, int depth, int splitPlies)
+{
+  if (splitPlies <= 0 || depth <= 2 || pool.size() <= 1) return perft(board, depth, useHash ? &tt : 0);
+
+  uint64_t nodes = 0;
+  if (useHash && tt.probe_perft(board.hash, depth, &nodes)) return nodes;
+
+  MoveList list;
+  board.generate_all_moves(list);
+  PerftTask *tasks = new PerftTask[(unsigned)list.size]; // Unsigned, so that GCC can see that the size fits
+  TaskGroup group;
+  for(int i = 0; i < list.size; ++i)
+  {
+    tasks[i].board = board;
+    tasks[i].board.make_move(list.moves[i]);
+    tasks[i].depth = depth - 1;
+    tasks[i].splitPlies = splitPlies - 1;
+    pool.submit(group, run_perft_task, &tasks[i]);
+  }
+  pool.wait(group);
+  for(int i = 0; i < list.size; ++i)
+    nodes += tasks[i].nodes;
+  delete[] tasks;
+
+  if (useHash) tt.store_perft(board.hash, depth, nodes);
+  return nodes;
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void print_result(int depth, uint64_t nodes, double seconds)
+{
+  printf("perft(%d) = %llu nodes, %.3f s, %.2f Mnodes/s\n", depth, (unsigned long long)nodes, seconds, seconds > 0 ? nodes / seconds / 1e6 : 0.0);
+}
+
+static uint64_t divide(Board &board, int depth)
+{
+  MoveList list;
+  board.generate_all_moves(list);
+  uint64_t total = 0;
+  for(int i = 0; i < list.size; ++i)
+  {
+    char uci[6];
+    move_to_uci(list.moves[i], uci);
+    board.make_move(list.moves[i]);
+    uint64_t nodes = parallel_perft(board, depth - 1, SPLIT_PLIES);
+    board.unmake_move();
+    printf("%s: %llu\n", uci, (unsigned long long)nodes);
+    total += nodes;
+  }
+  return total;
+}
+
+// Runs perft on one line of a perft suite, "<fen> ;D1 20 ;D2 400 ...", up to maxDepth. Returns false on mismatch.
+static bool check_suite_line(const char *line, int maxDepth, uint64_t *totalNodes)
+{
+  char fen[256];
+  const char *semicolon = strchr(line, ';');
+  size_t len = semicolon ? (size_t)(semicolon - line) : strlen(line);
+  if (len >= sizeof(fen)) len = sizeof(fen) - 1;
+  while(len > 0 && (line[len-1] == ' ' || line[len-1] == '\n' || line[len-1] == '\r')) --len;
+  memcpy(fen, line, len);
+  fen[len] = 0;
+
+  Board board;
+  if (!board.load_fen(fen))
+  {
+    printf("FAIL  invalid FEN: %s\n", fen);
+    return false;
+  }
+
+  bool ok = true;
+  for(const char *p = semicolon; p; p = strchr(p + 1, ';'))
+  {
+    int depth;
+    unsigned long long expected;
+    if (sscanf(p, " ;D%d %llu", &depth, &expected) != 2 || depth > maxDepth) continue;
+    uint64_t nodes = parallel_perft(board, depth, SPLIT_PLIES);
+    *totalNodes += nodes;
+    if (nodes != expected)
+    {
+      printf("FAIL  %s depth %d: expected %llu, got %llu\n", fen, depth, expected, (unsigned long long)nodes);
+      ok = false;
+    }
+  }
+  if (ok) printf("ok    %s\n", fen);
+  return ok;
+}
+
+// Well known positions that exercise castling, en passant, promotions, pins and checks.
+static const char *referencePositions[] = {
+  "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1 ;D1 20 ;D2 400 ;D3 8902 ;D4 197281 ;D5 4865609 ;D6 119060324",
+  "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1 ;D1 48 ;D2 2039 ;D3 97862 ;D4 4085603 ;D5 193690690",
+  "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1 ;D1 14 ;D2 191 ;D3 2812 ;D4 43238 ;D5 674624 ;D6 11030083",
+  "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1 ;D1 6 ;D2 264 ;D3 9467 ;D4 422333 ;D5 15833292",
+  "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8 ;D1 44 ;D2 1486 ;D3 62379 ;D4 2103487 ;D5 89941194",
+  "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10 ;D1 46 ;D2 2079 ;D3 89890 ;D4 3894594 ;D5 164075551",
+};
+
+// Counts the position with 1, 2, 4, ... up to maxThreads threads. The hash table is cleared before each
+// run so that every run does the same work.
+static void print_scaling(Board &board, int depth, int maxThreads)
+{
+  double baseSeconds = 0;
+  for(int threads = 1; threads <= maxThreads; threads = (threads < maxThreads && threads * 2 > maxThreads) ? maxThreads : threads * 2)
+  {
+    pool.start(threads);
+    if (useHash) tt.clear();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t nodes = parallel_perft(board, depth, SPLIT_PLIES);
+    double seconds = seconds_since(start);
+    if (threads == 1) baseSeconds = seconds;
+    printf("%3d threads: %llu nodes, %.3f s, %.2f Mnodes/s, speedup %.2fx\n", threads, (unsigned long long)nodes, seconds,
+      seconds > 0 ? nodes / seconds / 1e6 : 0.0, seconds > 0 ? baseSeconds / seconds : 0.0);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int depth = 5, numThreads = 1;
+  bool doDivide = false, doCheck = false, doScaling = false;
+  const char *fen = 0, *suite = 0;
+  int firstMove = argc;
+
+  for(int i = 1; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "-depth") && i+1 < argc) depth = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-fen") && i+1 < argc) fen = argv[++i];
+    else if (!strcmp(argv[i], "-suite") && i+1 < argc) suite = argv[++i];
+    else if (!strcmp(argv[i], "-hash") && i+1 < argc)
+    {
+      if (!tt.resize(atoi(argv[++i])))
+      {
+        fprintf(stderr, "Unable to allocate %s MB of hash\n", argv[i]);
+        return 2;
+      }
+      useHash = true;
+    }
+    else if (!strcmp(argv[i], "-threads") && i+1 < argc)
+    {
+      numThreads = atoi(argv[++i]);
+      if (numThreads <= 0) numThreads = (int)std::thread::hardware_concurrency();
+      if (numThreads <= 0) numThreads = 1;
+    }
+    else if (!strcmp(argv[i], "-scaling")) doScaling = true;
+    else if (!strcmp(argv[i], "-divide")) doDivide = true;
+    else if (!strcmp(argv[i], "-check")) doCheck = true;
+    else if (!strcmp(argv[i], "-moves")) { firstMove = i+1; break; }
+    else
+    {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+
+  if (numThreads > 1 && !doScaling) pool.start(numThreads);
+
+  if (doCheck || suite)
+  {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t nodes = 0;
+    int failures = 0;
+    if (doCheck)
+      for(size_t i = 0; i < sizeof(referencePositions) / sizeof(referencePositions[0]); ++i)
+        failures += !check_suite_line(referencePositions[i], depth, &nodes);
+    if (suite)
+    {
+      FILE *handle = fopen(suite, "r");
+      if (!handle)
+      {
+        fprintf(stderr, "Unable to open %s\n", suite);
+        return 2;
+      }
+      char line[1024];
+      while(fgets(line, sizeof(line), handle))
+        if (line[0] != '#' && line[0] != '\n' && line[0] != '\r')
+          failures += !check_suite_line(line, depth, &nodes);
+      fclose(handle);
+    }
+    double seconds = seconds_since(start);
+    printf("%s: %llu nodes, %.3f s, %.2f Mnodes/s\n", failures ? "FAILED" : "PASSED", (unsigned long long)nodes, seconds, seconds > 0 ? nodes / seconds / 1e6 : 0.0);
+    return failures ? 1 : 0;
+  }
+
+  Board board;
+  board.new_game();
+  if (fen && !board.load_fen(fen))
+  {
+    fprintf(stderr, "Invalid FEN: %s\n", fen);
+    return 2;
+  }
+  for(int i = firstMove; i < argc; ++i)
+  {
+    move_t move = board.parse_uci_move(argv[i]);
+    if (!move)
+    {
+      fprintf(stderr, "Illegal move: %s\n", argv[i]);
+      return 2;
+    }
+    board.make_move(move);
+  }
+
+  if (doScaling)
+  {
+    print_scaling(board, depth, numThreads);
+    return 0;
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  uint64_t nodes = doDivide ? divide(board, depth) : parallel_perft(board, depth, SPLIT_PLIES);
+  print_result(depth, nodes, seconds_since(start));
+  return 0;
+}
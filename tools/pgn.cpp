@@ -0,0 +1,226 @@
+// Replays PGN archives through the move generator and reports statistics, optionally writing every position.
+//
+// Usage: tiny_chess_pgn [options] file.pgn [file2.pgn ...]
+//   -threads N        Number of threads (default one per hardware thread)
+//   -epd out.epd      Write the FEN of each position after each move, in file order
+//
+// Each file is memory mapped and split into chunks at game boundaries. Every chunk goes through a parse
+// task, that turns its text into game records in the chunk's arena, which then queues a replay task that
+// plays the games on the chunk's board. A wave of chunks is in flight at a time, and once it is done the
+// arenas are reset in bulk for the next wave.
+//
+// Exits with a nonzero status if any game can't be parsed or has an illegal move.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "arena.h"
+#include "board.h"
+#include "mapped_file.h"
+#include "pgn.h"
+#include "threadpool.h"
+
+#define CHUNK_BYTES (1 << 20)
+#define CHUNKS_PER_THREAD 4
+
+struct PgnStats
+{
+  uint64_t games, plies, errors, illegal;
+  uint64_t whiteWins, blackWins, draws, unfinished;
+  uint64_t captures, castles, promotions, endsInCheck, endsInMate;
+};
+
+struct Chunk
+{
+  const char *begin, *end;
+  TaskGroup *group;
+  ThreadPool *pool;
+  Arena arena;
+  PgnGame *games;
+  Board board;
+  PgnStats stats;
+
+  // FEN lines of the positions, if they are written out. Kept allocated between waves.
+  char *output;
+  size_t outputSize, outputCapacity;
+};
+
+static bool writeEpd = false;
+
+static void append_output(Chunk &chunk, const char *str, size_t len)
+{
+  if (chunk.outputSize + len > chunk.outputCapacity)
+  {
+    size_t capacity = chunk.outputCapacity ? chunk.outputCapacity * 2 : CHUNK_BYTES * 8;
+    while(capacity < chunk.outputSize + len) capacity *= 2;
+    char *output = (char *)realloc(chunk.output, capacity);
+    if (!output) return;
+    chunk.output = output;
+    chunk.outputCapacity = capacity;
+  }
+  memcpy(chunk.output + chunk.outputSize, str, len);
+  chunk.outputSize += len;
+}
+
+static void count_move(const Board &board, move_t move, void *userData)
+{
+  Chunk &chunk = *(Chunk *)userData;
+  PgnStats &stats = chunk.stats;
+  const UndoRecord &undo = board.history[board.historyLength - 1];
+  ++stats.plies;
+  stats.captures += undo.captured != 0;
+  stats.castles += MOVE_TYPE(move) == MOVE_CASTLING;
+  stats.promotions += MOVE_TYPE(move) == MOVE_PROMOTION;
+  if (writeEpd)
+  {
+    char fen[MAX_FEN_LENGTH + 1];
+    board.to_fen(fen);
+    size_t len = strlen(fen);
+    fen[len++] = '\n';
+    append_output(chunk, fen, len);
+  }
+}
+
+static void replay_chunk(void *arg)
+{
+  Chunk &chunk = *(Chunk *)arg;
+  PgnStats &stats = chunk.stats;
+  for(const PgnGame *game = chunk.games; game; game = game->next)
+  {
+    ++stats.games;
+    if (!replay_pgn_game(*game, chunk.board, count_move, &chunk))
+    {
+      ++stats.illegal;
+      continue;
+    }
+    if (chunk.board.is_king_in_check(chunk.board.currentPlayer))
+    {
+      ++stats.endsInCheck;
+      MoveList list;
+      chunk.board.generate_all_moves(list);
+      stats.endsInMate += list.size == 0;
+    }
+    if (!strcmp(game->result, "1-0")) ++stats.whiteWins;
+    else if (!strcmp(game->result, "0-1")) ++stats.blackWins;
+    else if (!strcmp(game->result, "1/2-1/2")) ++stats.draws;
+    else ++stats.unfinished;
+  }
+}
+
+static void parse_chunk(void *arg)
+{
+  Chunk &chunk = *(Chunk *)arg;
+  int errors = 0;
+  chunk.games = parse_pgn(chunk.begin, chunk.end - chunk.begin, chunk.arena, &errors);
+  chunk.stats.errors += errors;
+  chunk.pool->submit(*chunk.group, replay_chunk, &chunk); // Next stage, on this worker's own queue
+}
+
+static void add_stats(PgnStats &total, const PgnStats &s)
+{
+  total.games += s.games; total.plies += s.plies; total.errors += s.errors; total.illegal += s.illegal;
+  total.whiteWins += s.whiteWins; total.blackWins += s.blackWins; total.draws += s.draws; total.unfinished += s.unfinished;
+  total.captures += s.captures; total.castles += s.castles; total.promotions += s.promotions;
+  total.endsInCheck += s.endsInCheck; total.endsInMate += s.endsInMate;
+}
+
+int main(int argc, char **argv)
+{
+  int numThreads = 0;
+  const char *epdFilename = 0;
+  int firstFile = argc;
+
+  for(int i = 1; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "-threads") && i+1 < argc) numThreads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-epd") && i+1 < argc) epdFilename = argv[++i];
+    else if (argv[i][0] != '-') { firstFile = i; break; }
+    else
+    {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+  if (firstFile == argc)
+  {
+    fprintf(stderr, "Usage: tiny_chess_pgn [options] file.pgn [file2.pgn ...]\n");
+    return 2;
+  }
+
+  FILE *epd = 0;
+  if (epdFilename)
+  {
+    epd = fopen(epdFilename, "wb");
+    if (!epd)
+    {
+      fprintf(stderr, "Unable to create %s\n", epdFilename);
+      return 2;
+    }
+    writeEpd = true;
+  }
+
+  static ThreadPool pool;
+  pool.start(numThreads);
+  int maxChunks = (pool.size() > 1 ? pool.size() : 1) * CHUNKS_PER_THREAD;
+  Chunk *chunks = new Chunk[maxChunks];
+  for(int i = 0; i < maxChunks; ++i)
+  {
+    chunks[i].pool = &pool;
+    chunks[i].output = 0;
+    chunks[i].outputCapacity = 0;
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  PgnStats total = {};
+  uint64_t bytes = 0;
+  for(int f = firstFile; f < argc; ++f)
+  {
+    MappedFile file;
+    if (!file.open(argv[f], true))
+    {
+      fprintf(stderr, "Unable to open %s\n", argv[f]);
+      return 2;
+    }
+    bytes += file.size;
+    const char *p = (const char *)file.data, *end = p + file.size;
+    while(p < end)
+    {
+      TaskGroup group;
+      int numChunks = 0;
+      for(; p < end && numChunks < maxChunks; ++numChunks)
+      {
+        Chunk &chunk = chunks[numChunks];
+        chunk.begin = p;
+        chunk.end = p = (end - p > CHUNK_BYTES) ? find_pgn_game_start(p + CHUNK_BYTES, end) : end;
+        chunk.group = &group;
+        chunk.arena.reset();
+        chunk.outputSize = 0;
+        memset(&chunk.stats, 0, sizeof(chunk.stats));
+        pool.submit(group, parse_chunk, &chunk);
+      }
+      pool.wait(group);
+      for(int i = 0; i < numChunks; ++i)
+      {
+        add_stats(total, chunks[i].stats);
+        if (epd) fwrite(chunks[i].output, 1, chunks[i].outputSize, epd);
+      }
+    }
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  for(int i = 0; i < maxChunks; ++i)
+    free(chunks[i].output);
+  delete[] chunks;
+  if (epd) fclose(epd);
+
+  printf("games %llu, plies %llu, parse errors %llu, illegal moves %llu\n", (unsigned long long)total.games, (unsigned long long)total.plies,
+    (unsigned long long)total.errors, (unsigned long long)total.illegal);
+  printf("results: 1-0 %llu, 0-1 %llu, 1/2-1/2 %llu, * %llu\n", (unsigned long long)total.whiteWins, (unsigned long long)total.blackWins,
+    (unsigned long long)total.draws, (unsigned long long)total.unfinished);
+  printf("captures %llu, castles %llu, promotions %llu, ending in check %llu, ending in mate %llu\n", (unsigned long long)total.captures,
+    (unsigned long long)total.castles, (unsigned long long)total.promotions, (unsigned long long)total.endsInCheck, (unsigned long long)total.endsInMate);
+  printf("%.3f s, %.2f MB/s, %.0f games/minute, %d threads\n", seconds, seconds > 0 ? bytes / seconds / 1e6 : 0.0,
+    seconds > 0 ? total.games / seconds * 60 : 0.0, pool.size());
+  return (total.errors || total.illegal) ? 1 : 0;
+}
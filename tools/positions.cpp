@@ -0,0 +1,207 @@
+// Builds and reads position files, sorted and deduplicated arrays of 28 byte packed positions, see packed.h.
+//
+// Usage: tiny_chess_positions [options] -pack out.pos file.epd [file2.epd ...]
+//        tiny_chess_positions -merge out.pos in.pos [in2.pos ...]
+//        tiny_chess_positions -list in.pos
+//        tiny_chess_positions -find in.pos -fen "<fen>"
+//   -chunk N          Sort at most N positions in memory at a time (default 4194304, about 112 MB)
+//
+// -pack reads a FEN or EPD position from each line, anything after the position is ignored, as are empty lines
+// and lines starting with #. Inputs with more positions than -chunk are sorted in chunks, written next to the
+// output and merged into it. -find exits with a nonzero status if the position is not in the file.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "board.h"
+#include "packed.h"
+
+#define MAX(x, y) ((x) >= (y) ? (x) : (y))
+
+struct Packer
+{
+  PackedPosition *positions;
+  size_t numPositions, chunkSize;
+  const char *output;
+  int numChunks;
+  uint64_t numRead, numInvalid;
+};
+
+static void chunk_filename(const char *output, int chunk, char *filename, size_t size)
+{
+  snprintf(filename, size, "%s.chunk%d", output, chunk);
+}
+
+// Sorts the positions gathered so far and writes them out as the next chunk.
+static bool flush_chunk(Packer &packer)
+{
+  char filename[1024];
+  chunk_filename(packer.output, packer.numChunks, filename, sizeof(filename));
+  size_t n = sort_packed_positions(packer.positions, packer.numPositions);
+  if (!write_packed_positions(filename, packer.positions, n))
+  {
+    fprintf(stderr, "Unable to write %s\n", filename);
+    return false;
+  }
+  ++packer.numChunks;
+  packer.numPositions = 0;
+  return true;
+}
+
+static bool pack_file(Packer &packer, const char *filename)
+{
+  FILE *handle = fopen(filename, "r");
+  if (!handle)
+  {
+    fprintf(stderr, "Unable to open %s\n", filename);
+    return false;
+  }
+  char line[1024];
+  Board board;
+  bool ok = true;
+  while(ok && fgets(line, sizeof(line), handle))
+  {
+    const char *p = line;
+    while(*p == ' ' || *p == '\t') ++p;
+    if (*p == 0 || *p == '\n' || *p == '\r' || *p == '#') continue;
+    ++packer.numRead;
+    if (!board.load_fen(p) || !pack_position(board, &packer.positions[packer.numPositions]))
+    {
+      ++packer.numInvalid;
+      continue;
+    }
+    if (++packer.numPositions == packer.chunkSize) ok = flush_chunk(packer);
+  }
+  fclose(handle);
+  return ok;
+}
+
+static int pack(const char *output, const char *const *inputs, int numInputs, size_t chunkSize)
+{
+  Packer packer = {};
+  packer.chunkSize = chunkSize;
+  packer.output = output;
+  packer.positions = (PackedPosition *)malloc(chunkSize * sizeof(PackedPosition));
+  if (!packer.positions)
+  {
+    fprintf(stderr, "Unable to allocate %llu positions\n", (unsigned long long)chunkSize);
+    return 2;
+  }
+
+  bool ok = true;
+  for(int i = 0; i < numInputs && ok; ++i)
+    ok = pack_file(packer, inputs[i]);
+
+  if (ok && packer.numChunks == 0)
+  {
+    // Everything fit in one chunk, so it is written as is.
+    size_t n = sort_packed_positions(packer.positions, packer.numPositions);
+    ok = write_packed_positions(output, packer.positions, n);
+    if (!ok) fprintf(stderr, "Unable to write %s\n", output);
+  }
+  else if (ok)
+  {
+    if (packer.numPositions) ok = flush_chunk(packer);
+    char (*filenames)[1024] = new char[(unsigned)packer.numChunks][1024];
+    const char **chunks = new const char *[(unsigned)packer.numChunks];
+    for(int i = 0; i < packer.numChunks; ++i)
+    {
+      chunk_filename(output, i, filenames[i], sizeof(filenames[i]));
+      chunks[i] = filenames[i];
+    }
+    if (ok && !merge_position_files(output, chunks, packer.numChunks))
+    {
+      fprintf(stderr, "Unable to merge the chunks into %s\n", output);
+      ok = false;
+    }
+    for(int i = 0; i < packer.numChunks; ++i)
+      remove(chunks[i]);
+    delete[] chunks;
+    delete[] filenames;
+  }
+  free(packer.positions);
+
+  PositionFile file;
+  if (ok && file.open(output))
+    printf("%llu positions read, %llu invalid, %llu unique positions written to %s\n", (unsigned long long)packer.numRead,
+      (unsigned long long)packer.numInvalid, (unsigned long long)file.size(), output);
+  return ok ? 0 : 2;
+}
+
+int main(int argc, char **argv)
+{
+  const char *packOutput = 0, *mergeOutput = 0, *listFile = 0, *findFile = 0, *fen = 0;
+  size_t chunkSize = 4194304;
+  int firstInput = argc;
+
+  for(int i = 1; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "-chunk") && i+1 < argc) chunkSize = (size_t)MAX(atoll(argv[i+1]), 1LL), ++i;
+    else if (!strcmp(argv[i], "-fen") && i+1 < argc) fen = argv[++i];
+    else if (!strcmp(argv[i], "-list") && i+1 < argc) listFile = argv[++i];
+    else if (!strcmp(argv[i], "-find") && i+1 < argc) findFile = argv[++i];
+    else if ((!strcmp(argv[i], "-pack") || !strcmp(argv[i], "-merge")) && i+1 < argc)
+    {
+      (argv[i][1] == 'p' ? packOutput : mergeOutput) = argv[i+1];
+      firstInput = i+2;
+      break;
+    }
+    else
+    {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+
+  if (packOutput) return pack(packOutput, argv + firstInput, argc - firstInput, chunkSize);
+
+  if (mergeOutput)
+  {
+    if (!merge_position_files(mergeOutput, argv + firstInput, argc - firstInput))
+    {
+      fprintf(stderr, "Unable to merge into %s\n", mergeOutput);
+      return 2;
+    }
+    return 0;
+  }
+
+  const char *filename = listFile ? listFile : findFile;
+  if (!filename)
+  {
+    fprintf(stderr, "Usage: tiny_chess_positions -pack out.pos file.epd ... | -merge out.pos in.pos ... | -list in.pos | -find in.pos -fen \"<fen>\"\n");
+    return 2;
+  }
+  PositionFile file;
+  if (!file.open(filename))
+  {
+    fprintf(stderr, "Unable to open %s\n", filename);
+    return 2;
+  }
+
+  Board board;
+  if (listFile)
+  {
+    char str[MAX_FEN_LENGTH];
+    for(size_t i = 0; i < file.size(); ++i)
+    {
+      if (!unpack_position(file[i], board))
+      {
+        fprintf(stderr, "Invalid position at index %llu\n", (unsigned long long)i);
+        return 2;
+      }
+      board.to_fen(str);
+      printf("%s\n", str);
+    }
+    return 0;
+  }
+
+  if (!fen || !board.load_fen(fen))
+  {
+    fprintf(stderr, "-find needs a valid -fen\n");
+    return 2;
+  }
+  int64_t index = file.find(board);
+  if (index < 0) printf("not found\n");
+  else printf("found at index %lld\n", (long long)index);
+  return index < 0 ? 1 : 0;
+}
@@ -0,0 +1,300 @@
+// Frame time benchmark of the board renderer, headless on EGL, so that it runs on machines without a GPU or a
+// display, e.g. with Mesa's software rasterizer. Draws the frames of a game in progress, with a piece selected
+// and the hover highlight moving a square every frame, into an offscreen framebuffer of the size of the browser canvas.
+// The piece glyphs are placeholders, since there is no font rendering here.
+//
+// Usage: tiny_chess_render_bench [options]
+//   -frames N         Number of frames to draw (default 2000)
+//   -legacy           Draw every quad with a call of its own, with a texture per glyph, as the UI used to
+//   -hover            Only draw the two squares that each hover move changes, as the UI does, not whole frames
+//   -out file.ppm     Write the last frame to an image, to check that the frames look right
+//
+// With Mesa, LIBGL_ALWAYS_SOFTWARE=1 forces the software rasterizer when there is a GPU.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include "renderer.h"
+
+#define CANVAS_SIZE 480 // Of tiny_chess_shell.html
+
+static bool create_headless_context()
+{
+  // Prefer Mesa's surfaceless platform, which needs neither X nor Wayland nor a GPU device.
+  EGLDisplay display = EGL_NO_DISPLAY;
+  const char *extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+  if (extensions && strstr(extensions, "EGL_MESA_platform_surfaceless") && getPlatformDisplay)
+    display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0);
+  if (display == EGL_NO_DISPLAY) display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  if (display == EGL_NO_DISPLAY || !eglInitialize(display, 0, 0)) return false;
+
+  // The surface type defaults to windows, which the surfaceless platform has none of.
+  const EGLint configAttribs[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT, EGL_NONE };
+  EGLConfig config;
+  EGLint numConfigs = 0;
+  if (!eglBindAPI(EGL_OPENGL_ES_API) || !eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) || numConfigs < 1) return false;
+  const EGLint contextAttribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+  EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+  // No window surface: frames go to a framebuffer object, see create_framebuffer().
+  return context != EGL_NO_CONTEXT && eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+}
+
+static bool create_framebuffer()
+{
+  GLuint texture, framebuffer;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, CANVAS_SIZE, CANVAS_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+  glGenFramebuffers(1, &framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+  glViewport(0, 0, CANVAS_SIZE, CANVAS_SIZE);
+  return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+}
+
+static GLuint compile_shader(GLenum shaderType, const char *src)
+{
+   GLuint shader = glCreateShader(shaderType);
+   glShaderSource(shader, 1, &src, NULL);
+   glCompileShader(shader);
+   return shader;
+}
+
+// The renderer the UI had before the atlas: a uniform upload, a texture bind and a draw call per quad.
+struct LegacyRenderer
+{
+  GLuint program, quad, colorPos, matPos;
+  GLuint textures[NUM_TEXTURES];
+  int numDrawCalls;
+
+  void init()
+  {
+    static const char vertex_shader[] =
+      "attribute vec4 pos;"
+      "varying vec2 uv;"
+      "uniform mat4 mat;"
+      "void main(){"
+        "uv=pos.xy;"
+        "gl_Position=mat*pos;"
+      "}";
+    static const char fragment_shader[] =
+      "precision lowp float;"
+      "uniform sampler2D tex;"
+      "varying vec2 uv;"
+      "uniform vec4 color;"
+      "void main(){"
+        "gl_FragColor=color*texture2D(tex,uv);"
+      "}";
+    program = glCreateProgram();
+    glAttachShader(program, compile_shader(GL_VERTEX_SHADER, vertex_shader));
+    glAttachShader(program, compile_shader(GL_FRAGMENT_SHADER, fragment_shader));
+    glBindAttribLocation(program, 0, "pos");
+    glLinkProgram(program);
+    colorPos = glGetUniformLocation(program, "color");
+    matPos = glGetUniformLocation(program, "mat");
+
+    glGenBuffers(1, &quad);
+    glBindBuffer(GL_ARRAY_BUFFER, quad);
+    const float pos[] = { 0, 0, 1, 0, 0, 1, 1, 1 };
+    glBufferData(GL_ARRAY_BUFFER, sizeof(pos), pos, GL_STATIC_DRAW);
+
+    // Glyphs of the same size as the atlas ones, a disc in each.
+    static uint32_t pixels[GLYPH_SIZE * GLYPH_SIZE];
+    for(int y = 0; y < GLYPH_SIZE; ++y)
+      for(int x = 0; x < GLYPH_SIZE; ++x)
+      {
+        int dx = 2*x + 1 - GLYPH_SIZE, dy = 2*y + 1 - GLYPH_SIZE;
+        pixels[y * GLYPH_SIZE + x] = dx*dx + dy*dy < GLYPH_SIZE*GLYPH_SIZE * 3 / 4 ? 0xFFFFFFFFu : 0;
+      }
+    glGenTextures(NUM_TEXTURES, textures);
+    for(int i = 0; i < NUM_TEXTURES; ++i)
+    {
+      glBindTexture(GL_TEXTURE_2D, textures[i]);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      uint32_t whitePixel = 0xFFFFFFFFu;
+      if (i == SOLID_COLOR_TEXTURE) glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, &whitePixel);
+      else glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, GLYPH_SIZE, GLYPH_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    }
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  }
+
+  void begin()
+  {
+    numDrawCalls = 0;
+    glUseProgram(program);
+    glBindBuffer(GL_ARRAY_BUFFER, quad);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
+    glEnableVertexAttribArray(0);
+    glDisableVertexAttribArray(1);
+    glDisableVertexAttribArray(2);
+  }
+
+  void draw(float x, float y, float w, float h, float r, float g, float b, float a, GLuint texture)
+  {
+    float mat[16] = { w*2.f, 0, 0, 0, 0, h*2.f, 0, 0, 0, 0, 1, 0, x*2.f-1.f, y*2.f-1.f, 0, 1};
+    glUniformMatrix4fv(matPos, 1, 0, mat);
+    glUniform4f(colorPos, r, g, b, a);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    ++numDrawCalls;
+  }
+
+  void add_square(int x, int y, float r, float g, float b, float a)
+  {
+    draw(x / 8.f, y / 8.f, 1.f / 8.f, 1.f / 8.f, r, g, b, a, textures[SOLID_COLOR_TEXTURE]);
+  }
+
+  void add_piece(int x, int y, piece_t piece)
+  {
+    int textureIndex = (IS_WHITE_PIECE(piece) ? SOLID_COLOR_TEXTURE : WHITE_PAWN_TEXTURE) + PIECE_TYPE(piece);
+    float c = IS_WHITE_PIECE(piece) ? 1.f : 0.f;
+    draw(x / 8.f, y / 8.f - 1.f / 480.f, 1.f / 8.f, 1.f / 8.f, c, c, c, 1.f, textures[textureIndex]);
+  }
+
+  void add_background(bitboard_t squares)
+  {
+    glDisable(GL_BLEND);
+    for(int i = 0, y = 0; y < 8; ++y, ++i)
+      for(int x = 0; x < 8; ++x, ++i)
+      {
+        if (!(squares & SQUARE_BIT(SQUARE(x, y)))) continue;
+        if (i % 2 == 0) add_square(x, y, 0.463f, 0.589f, 0.337f, 1.f);
+        else add_square(x, y, 0.933f, 0.933f, 0.834f, 1.f);
+      }
+    glEnable(GL_BLEND);
+  }
+
+  void add_pieces(const Board &board, bitboard_t squares)
+  {
+    for(int y = 0; y < 8; ++y)
+      for(int x = 0; x < 8; ++x)
+        if (board.board[y][x] && (squares & SQUARE_BIT(SQUARE(x, y))))
+          add_piece(x, y, board.board[y][x]);
+  }
+
+  int flush() { return numDrawCalls; }
+};
+
+// Draws the given squares of the board the way draw_board() in ui.cpp does.
+template<typename R>
+static int draw_frame(R &renderer, Board &board, bitboard_t squares, int selectX, int selectY, int hoverX, int hoverY)
+{
+  renderer.begin();
+  renderer.add_background(squares);
+  int kingSquare = lsb(board.pieces[COLOR_INDEX(board.currentPlayer)][KING]);
+  bitboard_t targets = 0;
+  int moves[48*2];
+  int *end = board.generate_moves(selectX, selectY, moves);
+  for(int *m = moves; m != end; m += 2)
+    targets |= SQUARE_BIT(SQUARE(m[0], m[1]));
+  for(bitboard_t b = squares; b; b &= b - 1)
+  {
+    int x = SQUARE_X(lsb(b)), y = SQUARE_Y(lsb(b));
+    if (lsb(b) == kingSquare && board.is_king_in_check(board.currentPlayer)) renderer.add_square(x, y, 1.f, 0.3f, 0.3f, 0.8f);
+    if (targets & SQUARE_BIT(lsb(b))) renderer.add_square(x, y, 1.f, 0.8f, 0.6f, 0.8f);
+    if (x == hoverX && y == hoverY) renderer.add_square(x, y, 0.7f, 0.7f, 1.f, 0.6f);
+    if (x == selectX && y == selectY) renderer.add_square(x, y, 0.5f, 0.5f, 1.f, 1.f);
+  }
+  renderer.add_pieces(board, squares);
+  return renderer.flush();
+}
+
+static bool write_ppm(const char *filename)
+{
+  static uint8_t pixels[CANVAS_SIZE * CANVAS_SIZE * 4];
+  glReadPixels(0, 0, CANVAS_SIZE, CANVAS_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+  FILE *handle = fopen(filename, "wb");
+  if (!handle) return false;
+  fprintf(handle, "P6\n%d %d\n255\n", CANVAS_SIZE, CANVAS_SIZE);
+  for(int y = CANVAS_SIZE - 1; y >= 0; --y) // GL rows go bottom up
+    for(int x = 0; x < CANVAS_SIZE; ++x)
+      fwrite(pixels + (y * CANVAS_SIZE + x) * 4, 1, 3, handle);
+  return fclose(handle) == 0;
+}
+
+template<typename R>
+static void run(R &renderer, Board &board, int numFrames, bool hoverOnly, const char *name)
+{
+  // The white queen on f3 is selected, and the mouse sweeps over the board.
+  const int selectX = 5, selectY = 2;
+  int drawCalls = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  draw_frame(renderer, board, ~0ULL, selectX, selectY, -1, -1);
+  for(int frame = 0; frame < numFrames; ++frame)
+  {
+    int hover = frame % 64, previousHover = (frame + 63) % 64;
+    bitboard_t squares = hoverOnly ? SQUARE_BIT(hover) | SQUARE_BIT(previousHover) : ~0ULL;
+    drawCalls = draw_frame(renderer, board, squares, selectX, selectY, SQUARE_X(hover), SQUARE_Y(hover));
+    glFinish(); // Count the rasterization too, not only the submission
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("%s renderer%s: %d frames, %d draw calls per frame: %.3f s, %.3f ms per frame, %.0f fps\n", name, hoverOnly ? ", hover changes only" : "",
+    numFrames, drawCalls, seconds, seconds * 1000.0 / numFrames, seconds > 0 ? numFrames / seconds : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+  int numFrames = 2000;
+  bool legacy = false, hoverOnly = false;
+  const char *outFile = 0;
+
+  for(int i = 1; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "-frames") && i+1 < argc) numFrames = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-legacy")) legacy = true;
+    else if (!strcmp(argv[i], "-hover")) hoverOnly = true;
+    else if (!strcmp(argv[i], "-out") && i+1 < argc) outFile = argv[++i];
+    else
+    {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+  if (numFrames < 1)
+  {
+    fprintf(stderr, "Invalid options\n");
+    return 2;
+  }
+
+  if (!create_headless_context() || !create_framebuffer())
+  {
+    fprintf(stderr, "Unable to create a headless OpenGL ES 2 context\n");
+    return 1;
+  }
+  printf("%s, %s\n", (const char *)glGetString(GL_RENDERER), (const char *)glGetString(GL_VERSION));
+
+  Board board;
+  board.load_fen("r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5Q2/PPPP1PPP/RNB1K1NR w KQkq - 4 4");
+
+  static Renderer renderer;
+  static LegacyRenderer legacyRenderer;
+  if (legacy)
+  {
+    legacyRenderer.init();
+    run(legacyRenderer, board, numFrames, hoverOnly, "legacy");
+  }
+  else
+  {
+    if (!renderer.init())
+    {
+      fprintf(stderr, "Unable to create the renderer\n");
+      return 1;
+    }
+    renderer.upload_placeholder_glyphs();
+    run(renderer, board, numFrames, hoverOnly, "batched");
+  }
+
+  if (outFile && !write_ppm(outFile))
+  {
+    fprintf(stderr, "Unable to write %s\n", outFile);
+    return 1;
+  }
+  return glGetError() == GL_NO_ERROR ? 0 : 1;
+}
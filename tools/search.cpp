@@ -0,0 +1,202 @@
+// Command line front end to the built-in search, prints one UCI style info line per iteration.
+//
+// Usage: tiny_chess_search [options]
+//   -depth N          Maximum search depth
+//   -nodes N          Maximum number of nodes to search
+//   -movetime MS      Milliseconds to search for
+//   -wtime MS         White's clock, for the time manager to budget the move from, see budget_search_time()
+//   -btime MS         Black's clock
+//   -winc MS          White's increment per move
+//   -binc MS          Black's increment per move
+//   -movestogo N      Moves until the next time control (default 0, the rest of the game)
+//   -hash MB          Transposition table size (default 16)
+//   -threads N        Search with N threads sharing the transposition table (Lazy SMP)
+//   -book file.bin    Play the best move of the given Polyglot book instead of searching if there is one
+//   -tb path          Load the endgame tables in the given directory, see tiny_chess_tb
+//   -nnue file.nnue   Evaluate with the given HalfKP 256x2-32-32 network instead, see nnue.h
+//   -eval file        Load piece values and piece-square tables from the given file, see load_evaluation()
+//   -saveeval file    Write the piece values and piece-square tables in use to the given file, to tune them
+//   -fen "<fen>"      Search the given position instead of the initial position
+//   -stoplatency N    Instead of searching once, start N unlimited searches on an EngineChannel, stop each after
+//                     1-100 ms, and report how long the best move took to come back after the stop
+//   -moves m1 m2 ...  Apply the given moves in UCI notation first, must be the last option
+//
+// Without any limits, searches to depth 8.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include "board.h"
+#include "search.h"
+#include "book.h"
+#include "engine_channel.h"
+#include "evaluate.h"
+#include "nnue.h"
+#include "tablebase.h"
+
+static void print_iteration(const SearchIteration &it, void *)
+{
+  if (it.score >= SCORE_MATE_IN_MAX_PLY) printf("info depth %d score mate %d", it.depth, (SCORE_MATE - it.score + 1) / 2);
+  else if (it.score <= -SCORE_MATE_IN_MAX_PLY) printf("info depth %d score mate -%d", it.depth, (SCORE_MATE + it.score) / 2);
+  else printf("info depth %d score cp %d", it.depth, it.score);
+  printf(" nodes %llu nps %llu time %d pv", (unsigned long long)it.nodes, (unsigned long long)it.nps, it.milliseconds);
+  for(int i = 0; i < it.pvLength; ++i)
+  {
+    char uci[6];
+    move_to_uci(it.pv[i], uci);
+    printf(" %s", uci);
+  }
+  printf("\n");
+  fflush(stdout);
+}
+
+// Stops searches as the UI does when the user wants the engine to move now, and times the best move's arrival.
+static int measure_stop_latency(const Board &board, int numSearches, int hashMegabytes)
+{
+  static EngineChannel channel;
+  if (!channel.start(hashMegabytes))
+  {
+    fprintf(stderr, "Unable to allocate %d MB of hash\n", hashMegabytes);
+    return 2;
+  }
+  double total = 0, worst = 0;
+  int numWithoutBest = 0;
+  for(int i = 0; i < numSearches; ++i)
+  {
+    uint32_t searchId = channel.search(board, SearchLimits());
+    std::this_thread::sleep_for(std::chrono::milliseconds(1 + i * 37 % 100));
+    if (!channel.best_move(searchId)) ++numWithoutBest;
+
+    std::chrono::steady_clock::time_point stopTime = std::chrono::steady_clock::now();
+    channel.cancel();
+    EngineResult result;
+    while(!channel.poll(&result) || result.type != ENGINE_RESULT_BESTMOVE || result.searchId != searchId)
+      std::this_thread::yield();
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stopTime).count();
+    total += ms;
+    if (ms > worst) worst = ms;
+  }
+  channel.quit();
+  printf("stop latency over %d searches: average %.3f ms, max %.3f ms\n", numSearches, total / numSearches, worst);
+  printf("no best move yet at the stop in %d searches\n", numWithoutBest);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  SearchLimits limits;
+  int hashMegabytes = 16, numThreads = 1, numLatencySearches = 0;
+  const char *fen = 0, *bookFilename = 0;
+  int firstMove = argc;
+
+  for(int i = 1; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "-depth") && i+1 < argc) limits.depth = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-nodes") && i+1 < argc) limits.nodes = strtoull(argv[++i], 0, 10);
+    else if (!strcmp(argv[i], "-movetime") && i+1 < argc) limits.movetime = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-wtime") && i+1 < argc) limits.time[COLOR_INDEX(WHITE)] = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-btime") && i+1 < argc) limits.time[COLOR_INDEX(BLACK)] = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-winc") && i+1 < argc) limits.increment[COLOR_INDEX(WHITE)] = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-binc") && i+1 < argc) limits.increment[COLOR_INDEX(BLACK)] = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-movestogo") && i+1 < argc) limits.movestogo = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-stoplatency") && i+1 < argc) numLatencySearches = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-hash") && i+1 < argc) hashMegabytes = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-threads") && i+1 < argc) numThreads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-book") && i+1 < argc) bookFilename = argv[++i];
+    else if (!strcmp(argv[i], "-tb") && i+1 < argc) tb_load_all(argv[++i]);
+    else if (!strcmp(argv[i], "-nnue") && i+1 < argc)
+    {
+      if (!nnue_load(argv[++i]))
+      {
+        fprintf(stderr, "Unable to load a HalfKP 256x2-32-32 network from %s\n", argv[i]);
+        return 2;
+      }
+    }
+    else if (!strcmp(argv[i], "-eval") && i+1 < argc)
+    {
+      if (!load_evaluation(argv[++i]))
+      {
+        fprintf(stderr, "Unable to load the evaluation from %s\n", argv[i]);
+        return 2;
+      }
+    }
+    else if (!strcmp(argv[i], "-saveeval") && i+1 < argc)
+    {
+      FILE *handle = fopen(argv[++i], "w");
+      if (!handle)
+      {
+        fprintf(stderr, "Unable to write %s\n", argv[i]);
+        return 2;
+      }
+      write_evaluation(handle);
+      fclose(handle);
+    }
+    else if (!strcmp(argv[i], "-fen") && i+1 < argc) fen = argv[++i];
+    else if (!strcmp(argv[i], "-moves")) { firstMove = i+1; break; }
+    else
+    {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+  Board board;
+  board.new_game();
+  if (fen && !board.load_fen(fen))
+  {
+    fprintf(stderr, "Invalid FEN: %s\n", fen);
+    return 2;
+  }
+  for(int i = firstMove; i < argc; ++i)
+  {
+    move_t move = board.parse_uci_move(argv[i]);
+    if (!move)
+    {
+      fprintf(stderr, "Illegal move: %s\n", argv[i]);
+      return 2;
+    }
+    board.make_move(move);
+  }
+  if (numLatencySearches > 0) return measure_stop_latency(board, numLatencySearches, hashMegabytes);
+  if (!limits.depth && !limits.nodes && !limits.movetime && !limits.time[COLOR_INDEX(board.currentPlayer)]) limits.depth = 8;
+
+  char uci[6] = "0000";
+  if (bookFilename)
+  {
+    static OpeningBook book;
+    if (!book.open(bookFilename))
+    {
+      fprintf(stderr, "Unable to open %s\n", bookFilename);
+      return 2;
+    }
+    move_t bookMove = book.pick(board, true, 0);
+    if (bookMove)
+    {
+      move_to_uci(bookMove, uci);
+      printf("info string book move\nbestmove %s\n", uci);
+      return 0;
+    }
+  }
+
+  static TranspositionTable tt;
+  if (!tt.resize(hashMegabytes))
+  {
+    fprintf(stderr, "Unable to allocate %d MB of hash\n", hashMegabytes);
+    return 2;
+  }
+  if (numThreads < 1) numThreads = 1;
+  Searcher **searchers = new Searcher*[numThreads]; // Each too large for the stack
+  for(int i = 0; i < numThreads; ++i)
+    searchers[i] = new Searcher;
+  searchers[0]->tt = &tt;
+  searchers[0]->report = print_iteration;
+
+  static ThreadPool pool;
+  if (numThreads > 1) pool.start(numThreads - 1); // The main searcher runs on this thread
+
+  move_t best = think_parallel(pool, searchers, numThreads, board, limits);
+  if (best) move_to_uci(best, uci);
+  printf("bestmove %s\n", uci);
+  return 0;
+}
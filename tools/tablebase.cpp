@@ -0,0 +1,134 @@
+// Generates endgame tablebases, and looks up positions in them.
+//
+// Usage: tiny_chess_tb [options] -generate KQvK [KRvK KQvKR ...]
+//        tiny_chess_tb [options] -probe "<fen>"
+//   -dir path         Directory of the table files (default .)
+//   -threads N        Number of threads to generate with (default one per hardware thread)
+//
+// Generating a table also generates the smaller tables it depends on, unless they are in the directory already.
+// Probing lists the result of every legal move, best first.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "board.h"
+#include "tablebase.h"
+#include "threadpool.h"
+
+static void print_result(int wdl, int plies)
+{
+  if (wdl == TB_WIN) printf("win, mate in %d (%d plies)", (plies + 1) / 2, plies);
+  else if (wdl == TB_LOSS) printf("loss, mated in %d (%d plies)", plies / 2, plies);
+  else printf("draw");
+}
+
+// Orders results from the point of view of the player to move: quick wins, then draws, then slow losses.
+static int result_rank(int wdl, int plies)
+{
+  return (wdl == TB_WIN) ? 1000 - plies : (wdl == TB_DRAW) ? 0 : -1000 + plies;
+}
+
+static int probe(const char *fen)
+{
+  static Board board;
+  if (!board.load_fen(fen))
+  {
+    fprintf(stderr, "Invalid FEN: %s\n", fen);
+    return 2;
+  }
+  int wdl, plies;
+  if (!tb_probe(board, &wdl, &plies))
+  {
+    fprintf(stderr, "Position not in the loaded tables\n");
+    return 1;
+  }
+  print_result(wdl, plies);
+  printf("\n");
+
+  MoveList list;
+  board.generate_all_moves(list);
+  int ranks[MAX_MOVES];
+  char san[MAX_MOVES][MAX_SAN_LENGTH];
+  int results[MAX_MOVES][2];
+  for(int i = 0; i < list.size; ++i)
+  {
+    board.move_to_san(list.moves[i], san[i]);
+    board.make_move(list.moves[i]);
+    int w = TB_DRAW, p = 0;
+    bool found = tb_probe(board, &w, &p);
+    board.unmake_move();
+    // The result after the move is for the opponent, one ply later.
+    results[i][0] = found ? -w : 2;
+    results[i][1] = found && w != TB_DRAW ? p + 1 : 0;
+    ranks[i] = found ? result_rank(results[i][0], results[i][1]) : -2000;
+  }
+  for(int i = 0; i < list.size; ++i)
+  {
+    int best = i;
+    for(int j = i + 1; j < list.size; ++j)
+      if (ranks[j] > ranks[best]) best = j;
+    printf("%-8s ", san[best]);
+    if (results[best][0] == 2) printf("unknown");
+    else print_result(results[best][0], results[best][1]);
+    printf("\n");
+    ranks[best] = ranks[i], results[best][0] = results[i][0], results[best][1] = results[i][1];
+    memcpy(san[best], san[i], MAX_SAN_LENGTH);
+  }
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  const char *directory = ".", *fen = 0;
+  int numThreads = 0, firstMaterial = argc;
+  bool generate = false;
+
+  for(int i = 1; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "-dir") && i+1 < argc) directory = argv[++i];
+    else if (!strcmp(argv[i], "-threads") && i+1 < argc) numThreads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-probe") && i+1 < argc) fen = argv[++i];
+    else if (!strcmp(argv[i], "-generate")) { generate = true; firstMaterial = i+1; break; }
+    else
+    {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+
+  if (generate)
+  {
+    static ThreadPool pool;
+    pool.start(numThreads);
+    for(int i = firstMaterial; i < argc; ++i)
+    {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      if (!tb_generate(argv[i], directory, pool))
+      {
+        fprintf(stderr, "Unable to generate %s into %s\n", argv[i], directory);
+        return 1;
+      }
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      TbInfo info;
+      printf("%s: %.3f s, %d threads", argv[i], seconds, pool.size());
+      if (tb_info(argv[i], &info))
+        printf(", %llu positions, %llu wins, %llu draws, %llu losses, longest mate %d plies", (unsigned long long)info.positions,
+          (unsigned long long)info.wins, (unsigned long long)info.draws, (unsigned long long)info.losses, info.longestMate);
+      printf("\n");
+    }
+    return 0;
+  }
+
+  if (!fen)
+  {
+    fprintf(stderr, "Usage: tiny_chess_tb -generate KQvK ... or tiny_chess_tb -probe \"<fen>\"\n");
+    return 2;
+  }
+  if (!tb_load_all(directory))
+  {
+    fprintf(stderr, "No tables found in %s\n", directory);
+    return 2;
+  }
+  return probe(fen);
+}